@@ -0,0 +1,130 @@
+#include "hyper_asset_pack.hh"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <iostream>
+
+namespace hyper
+{
+  static bool
+  is_valid_pack (std::byte const *data, size_t size)
+  {
+    if (size < sizeof (Asset_pack_header))
+      return false;
+
+    auto const *header = reinterpret_cast<Asset_pack_header const *> (data);
+    if (header->magic != asset_pack_magic || header->version != asset_pack_version || header->size != size)
+      return false;
+
+    if (header->entries_offset % alignof (Asset_entry) != 0 || header->entries_offset > size
+        || (size - header->entries_offset) / sizeof (Asset_entry) < header->entry_count)
+      return false;
+
+    // Only the entry table gets read here, not the assets
+    auto const *entries = reinterpret_cast<Asset_entry const *> (data + header->entries_offset);
+
+    for (u32 i = 0; i < header->entry_count; ++i)
+      {
+        Asset_entry const &entry = entries[i];
+
+        if (entry.type >= Asset_type::count || entry.offset % asset_pack_alignment != 0
+            || entry.offset > size || entry.size > size - entry.offset
+            || entry.size != entry.count * get_asset_element_size (entry.type))
+          return false;
+
+        // Lookups are a binary search
+        if (i > 0 && entries[i - 1].name_hash > entry.name_hash)
+          return false;
+      }
+
+    return true;
+  }
+
+  bool
+  asset_pack_open (Asset_pack &pack, char const *path)
+  {
+    i32 const fd = open (path, O_RDONLY | O_CLOEXEC);
+    if (fd == -1)
+      {
+        std::cerr << "couldn't open " << path << ": " << strerror (errno) << '\n';
+        return false;
+      }
+
+    struct stat file_stat;
+    if (fstat (fd, &file_stat) == -1 || file_stat.st_size <= 0)
+      {
+        std::cerr << "couldn't read " << path << '\n';
+        close (fd);
+        return false;
+      }
+
+    size_t const size = (size_t) file_stat.st_size;
+    void *mapping = mmap (nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close (fd);
+
+    if (mapping == MAP_FAILED)
+      {
+        std::cerr << "couldn't map " << path << ": " << strerror (errno) << '\n';
+        return false;
+      }
+
+    // Assets are touched here and there, read ahead would only bring in
+    // the neighbours
+    madvise (mapping, size, MADV_RANDOM);
+
+    auto const *data = static_cast<std::byte const *> (mapping);
+    if (!is_valid_pack (data, size))
+      {
+        std::cerr << path << " isn't a valid asset pack\n";
+        munmap (mapping, size);
+        return false;
+      }
+
+    auto const *header = reinterpret_cast<Asset_pack_header const *> (data);
+
+    pack.data = data;
+    pack.size = size;
+    pack.entries = reinterpret_cast<Asset_entry const *> (data + header->entries_offset);
+    pack.entry_count = header->entry_count;
+
+    return true;
+  }
+
+  void
+  asset_pack_close (Asset_pack &pack)
+  {
+    if (pack.data)
+      munmap (const_cast<std::byte *> (pack.data), pack.size);
+
+    pack.data = nullptr;
+    pack.size = 0;
+    pack.entries = nullptr;
+    pack.entry_count = 0;
+  }
+
+  Asset_entry const *
+  asset_pack_find (Asset_pack const &pack, u64 name_hash, Asset_type type)
+  {
+    u32 low = 0;
+    u32 high = pack.entry_count;
+
+    while (low < high)
+      {
+        u32 const middle = low + (high - low) / 2;
+
+        if (pack.entries[middle].name_hash < name_hash)
+          low = middle + 1;
+        else
+          high = middle;
+      }
+
+    if (low == pack.entry_count || pack.entries[low].name_hash != name_hash || pack.entries[low].type != type)
+      return nullptr;
+
+    return &pack.entries[low];
+  }
+};
@@ -0,0 +1,144 @@
+//
+// Asset packs. One file baked offline by hyper-asset-baker and mapped
+// read only at startup, the structures in it are used where they are.
+// Opening only reads the header and the entry table, the pages of an
+// asset get loaded the first time it's touched.
+//
+// Layout: header, entries sorted by name hash, then every asset's data
+// starting on a cache line.
+//
+#pragma once
+
+#include "hyper_common.hh"
+#include "hyper_math.hh"
+#include "hyper_colour.hh"
+#include "hyper_geometry.hh"
+
+#include <cstddef>
+
+namespace hyper
+{
+  inline constexpr u32 asset_pack_magic = 0x4B435041; // "APCK"
+  inline constexpr u32 asset_pack_version = 1;
+  inline constexpr u64 asset_pack_alignment = 64;
+
+  enum class Asset_type : u32
+    {
+      // Vec2<f32>, outlines and triangles
+      vertices,
+      // Quad
+      quads,
+      // Colour
+      palette,
+      // Spawn
+      spawns,
+
+      count
+    };
+
+  // Something placed in a level, kind is up to the game
+  struct Spawn
+  {
+    Vec2<f32> position;
+    f32 rotation;
+    u32 kind;
+  };
+
+  struct Asset_pack_header
+  {
+    u32 magic;
+    u32 version;
+    u32 entry_count;
+    u32 reserved;
+    // Whole file, catches truncated packs
+    u64 size;
+    u64 entries_offset;
+  };
+
+  struct Asset_entry
+  {
+    u64 name_hash;
+    Asset_type type;
+    // Elements, not bytes
+    u32 count;
+    u64 offset;
+    u64 size;
+  };
+
+  // The layout is the file format, these can't change without a new
+  // version
+  static_assert (sizeof (Vec2<f32>) == 8);
+  static_assert (sizeof (Quad) == 16);
+  static_assert (sizeof (Colour) == 4);
+  static_assert (sizeof (Spawn) == 16);
+  static_assert (sizeof (Asset_pack_header) == 32);
+  static_assert (sizeof (Asset_entry) == 32);
+
+  inline constexpr u64
+  get_asset_element_size (Asset_type type)
+  {
+    switch (type)
+      {
+      case Asset_type::vertices:
+        return sizeof (Vec2<f32>);
+      case Asset_type::quads:
+        return sizeof (Quad);
+      case Asset_type::palette:
+        return sizeof (Colour);
+      case Asset_type::spawns:
+        return sizeof (Spawn);
+      default:
+        return 0;
+      }
+  }
+
+  // FNV-1a, names never make it into the pack
+  inline constexpr u64
+  get_asset_name_hash (char const *name)
+  {
+    u64 hash = 0xCBF29CE484222325ull;
+
+    for (; *name; ++name)
+      {
+        hash ^= (u8) *name;
+        hash *= 0x100000001B3ull;
+      }
+
+    return hash;
+  }
+
+  template <typename T> struct Asset_traits;
+  template <> struct Asset_traits<Vec2<f32>> { static constexpr Asset_type type = Asset_type::vertices; };
+  template <> struct Asset_traits<Quad> { static constexpr Asset_type type = Asset_type::quads; };
+  template <> struct Asset_traits<Colour> { static constexpr Asset_type type = Asset_type::palette; };
+  template <> struct Asset_traits<Spawn> { static constexpr Asset_type type = Asset_type::spawns; };
+
+  struct Asset_pack
+  {
+    std::byte const *data;
+    size_t size;
+    Asset_entry const *entries;
+    u32 entry_count;
+  };
+
+  // Maps the file and checks the header and entries. Returns false if
+  // it can't be read or isn't a valid pack.
+  bool asset_pack_open (Asset_pack &, char const *);
+
+  // Everything that came from the pack is gone after this
+  void asset_pack_close (Asset_pack &);
+
+  // Null if there's no asset with that name and type
+  Asset_entry const *asset_pack_find (Asset_pack const &, u64, Asset_type);
+
+  // Points into the mapping, null and count 0 if it's not there
+  template <typename T>
+  inline T const *
+  asset_pack_get (Asset_pack const &pack, char const *name, u32 &count)
+  {
+    Asset_entry const *entry = asset_pack_find (pack, get_asset_name_hash (name), Asset_traits<T>::type);
+    count = entry ? entry->count : 0;
+
+    return entry ? reinterpret_cast<T const *> (pack.data + entry->offset) : nullptr;
+  }
+};
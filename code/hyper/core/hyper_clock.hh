@@ -0,0 +1,26 @@
+#pragma once
+
+#include "hyper_common.hh"
+
+#include <time.h>
+
+namespace hyper
+{
+  inline constexpr u64 nanoseconds_per_second = 1'000'000'000ull;
+
+  // Monotonic, nanoseconds since some unspecified point
+  inline u64
+  get_time_ns ()
+  {
+    struct timespec time;
+    clock_gettime (CLOCK_MONOTONIC, &time);
+
+    return (u64) time.tv_sec * nanoseconds_per_second + (u64) time.tv_nsec;
+  }
+
+  inline f32
+  get_seconds (u64 nanoseconds)
+  {
+    return (f32) ((f64) nanoseconds / (f64) nanoseconds_per_second);
+  }
+};
@@ -52,9 +52,61 @@ namespace hyper
       }
   }
 
-  inline u32
+  // Layout of a pixel as a native u32, highest byte first. The X
+  // variants of these (XRGB8888...) have the same layout, the alpha
+  // byte just gets ignored
+  enum class Pixel_format : u8
+    {
+      rgba8888,
+      argb8888,
+      abgr8888,
+      bgra8888,
+    };
+
+  // How a colour gets combined with what's already in the framebuffer,
+  // alpha comes from the colour
+  enum class Blend_mode : u8
+    {
+      opaque,
+      alpha,
+      additive,
+
+      count
+    };
+
+  template <Pixel_format format>
+  inline constexpr u32
   get_colour_uint (Colour colour)
   {
-    return (u32) (colour.r) << 24 | (u32) (colour.g) << 16 | (u32) (colour.b) << 8 | (u32) colour.a;
+    u32 const r = colour.r;
+    u32 const g = colour.g;
+    u32 const b = colour.b;
+    u32 const a = colour.a;
+
+    if constexpr (format == Pixel_format::rgba8888)
+      return r << 24 | g << 16 | b << 8 | a;
+    else if constexpr (format == Pixel_format::argb8888)
+      return a << 24 | r << 16 | g << 8 | b;
+    else if constexpr (format == Pixel_format::abgr8888)
+      return a << 24 | b << 16 | g << 8 | r;
+    else
+      return b << 24 | g << 16 | r << 8 | a;
+  }
+
+  inline u32
+  get_colour_uint (Pixel_format format, Colour colour)
+  {
+    switch (format)
+      {
+      case Pixel_format::argb8888:
+        return get_colour_uint<Pixel_format::argb8888> (colour);
+      case Pixel_format::abgr8888:
+        return get_colour_uint<Pixel_format::abgr8888> (colour);
+      case Pixel_format::bgra8888:
+        return get_colour_uint<Pixel_format::bgra8888> (colour);
+      case Pixel_format::rgba8888:
+      default:
+        return get_colour_uint<Pixel_format::rgba8888> (colour);
+      }
   }
 };
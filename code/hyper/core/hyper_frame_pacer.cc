@@ -0,0 +1,116 @@
+#include "hyper_frame_pacer.hh"
+#include "hyper_clock.hh"
+#include "hyper_math.hh"
+
+#include <immintrin.h>
+#include <errno.h>
+#include <sys/prctl.h>
+#include <time.h>
+
+namespace hyper
+{
+  // Bounds for the busy wait at the end of a sleep
+  static constexpr u64 min_spin_ns = 100'000;
+  static constexpr u64 max_spin_ns = 2'000'000;
+  // Extra room when starting just in time, a late frame is worse than
+  // a slightly early one
+  static constexpr u64 just_in_time_margin_ns = 500'000;
+
+  void
+  frame_pacer_init (Frame_pacer &pacer, f32 target_fps, bool just_in_time)
+  {
+    // Default timer slack is 50us, it would eat most of the precision
+    // clock_nanosleep gives me
+    prctl (PR_SET_TIMERSLACK, 1UL);
+
+    pacer.oversleep_ns = 250'000;
+    pacer.work_ns = 0;
+    pacer.just_in_time = just_in_time;
+    pacer.frame_start_ns = get_time_ns ();
+    frame_pacer_set_target_fps (pacer, target_fps);
+  }
+
+  void
+  frame_pacer_set_target_fps (Frame_pacer &pacer, f32 target_fps)
+  {
+    pacer.period_ns = target_fps > 0.0f ? (u64) ((f64) nanoseconds_per_second / (f64) target_fps) : 0;
+    pacer.deadline_ns = get_time_ns () + pacer.period_ns;
+  }
+
+  u64
+  frame_pacer_wait_until (u64 deadline_ns, u64 spin_ns)
+  {
+    u64 const sleep_until_ns = deadline_ns > spin_ns ? deadline_ns - spin_ns : 0;
+    u64 oversleep_ns = 0;
+
+    if (get_time_ns () < sleep_until_ns)
+      {
+        struct timespec until;
+        until.tv_sec = (time_t) (sleep_until_ns / nanoseconds_per_second);
+        until.tv_nsec = (long) (sleep_until_ns % nanoseconds_per_second);
+
+        while (clock_nanosleep (CLOCK_MONOTONIC, TIMER_ABSTIME, &until, nullptr) == EINTR)
+          ;
+
+        u64 const woke_up_ns = get_time_ns ();
+        oversleep_ns = woke_up_ns > sleep_until_ns ? woke_up_ns - sleep_until_ns : 0;
+      }
+
+    while (get_time_ns () < deadline_ns)
+      _mm_pause ();
+
+    return oversleep_ns;
+  }
+
+  u64
+  frame_pacer_get_next_start (Frame_pacer const &pacer)
+  {
+    if (pacer.period_ns == 0)
+      return 0;
+
+    if (!pacer.just_in_time)
+      return pacer.deadline_ns;
+
+    u64 const lead_ns = hyper::min (pacer.work_ns + just_in_time_margin_ns, pacer.period_ns);
+    return pacer.deadline_ns - lead_ns;
+  }
+
+  u64
+  frame_pacer_begin_frame (Frame_pacer &pacer)
+  {
+    if (pacer.period_ns == 0)
+      {
+        pacer.frame_start_ns = get_time_ns ();
+        return pacer.frame_start_ns;
+      }
+
+    u64 const start_ns = frame_pacer_get_next_start (pacer);
+    u64 const spin_ns = hyper::min (pacer.oversleep_ns + min_spin_ns, max_spin_ns);
+    u64 const oversleep_ns = frame_pacer_wait_until (start_ns, spin_ns);
+
+    // Decaying maximum, one bad wake up shouldn't make me spin forever
+    pacer.oversleep_ns = hyper::max (oversleep_ns, pacer.oversleep_ns - (pacer.oversleep_ns >> 4));
+    pacer.frame_start_ns = get_time_ns ();
+
+    return pacer.frame_start_ns;
+  }
+
+  void
+  frame_pacer_end_frame (Frame_pacer &pacer)
+  {
+    u64 const now_ns = get_time_ns ();
+    u64 const work_ns = now_ns - pacer.frame_start_ns;
+
+    pacer.work_ns = hyper::max (work_ns, pacer.work_ns - (pacer.work_ns >> 4));
+
+    if (pacer.period_ns == 0)
+      return;
+
+    pacer.deadline_ns += pacer.period_ns;
+
+    // Missed it by more than a frame, don't try to catch up with a burst
+    // of frames, start counting again from here
+    if (now_ns > pacer.deadline_ns + pacer.period_ns)
+      pacer.deadline_ns = now_ns + pacer.period_ns;
+  }
+};
@@ -0,0 +1,45 @@
+//
+// Frame rate limiter. Frames are scheduled against absolute deadlines
+// so errors don't accumulate, and waiting is done by sleeping until
+// shortly before the deadline and spinning the rest of the way, the
+// scheduler isn't precise enough on its own.
+//
+#pragma once
+
+#include "hyper_common.hh"
+
+namespace hyper
+{
+  struct Frame_pacer
+  {
+    // 0 means uncapped
+    u64 period_ns;
+    u64 deadline_ns;
+    u64 frame_start_ns;
+    // How late clock_nanosleep wakes up, it decides the spin tail
+    u64 oversleep_ns;
+    // Decaying maximum of the frame's work, used to start just in time
+    u64 work_ns;
+    // Start the frame as late as possible so it finishes right at the
+    // deadline, input is sampled later and latency drops
+    bool just_in_time;
+  };
+
+  // 0 fps means uncapped
+  void frame_pacer_init (Frame_pacer &, f32, bool);
+
+  void frame_pacer_set_target_fps (Frame_pacer &, f32);
+
+  // Waits until the frame should start, returns the time it started
+  u64 frame_pacer_begin_frame (Frame_pacer &);
+
+  void frame_pacer_end_frame (Frame_pacer &);
+
+  // When the next frame will start, between end and begin the time
+  // until then is free. 0 when uncapped, it starts right away.
+  u64 frame_pacer_get_next_start (Frame_pacer const &);
+
+  // Sleeps until spin_ns before the deadline and spins the rest,
+  // returns how late the sleep woke up
+  u64 frame_pacer_wait_until (u64, u64);
+};
@@ -26,6 +26,15 @@ namespace hyper
     f32 radius;
   };
 
+  inline constexpr u32 polygon_max_vertices = 16;
+
+  // Simple polygon, convex or not, in order around its outline
+  struct Polygon
+  {
+    std::array<Vec2<f32>, polygon_max_vertices> vertices;
+    u32 vertex_count;
+  };
+
   struct Quad
   {
     // Bottom left
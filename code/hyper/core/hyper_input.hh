@@ -0,0 +1,112 @@
+//
+// Platform independent input. The platform layer translates its
+// events into these and hands them to the simulation one fixed tick
+// at a time, which is what makes recording and replaying possible.
+//
+// Events are key transitions, repeats aren't. Whatever the simulation
+// does while a key is held comes from how long it was held inside the
+// tick, so it doesn't depend on the frame rate or the repeat rate.
+//
+#pragma once
+
+#include "hyper_common.hh"
+
+#include <array>
+#include <atomic>
+
+namespace hyper
+{
+  enum class Key : u8
+    {
+      up,
+      down,
+      left,
+      right,
+
+      count
+    };
+
+  struct Input_event
+  {
+    // Microseconds since the start of the tick the event belongs to
+    u32 timestamp_us;
+    Key key;
+    bool down;
+  };
+
+  inline constexpr u32 tick_input_max_events = 32;
+
+  struct Tick_input
+  {
+    std::array<Input_event, tick_input_max_events> events;
+    u32 event_count;
+  };
+
+  // Returns false if the tick is full, the event is dropped
+  inline bool
+  tick_input_push (Tick_input &input, Input_event const &event)
+  {
+    if (input.event_count == tick_input_max_events)
+      return false;
+
+    input.events[input.event_count++] = event;
+
+    return true;
+  }
+
+  // A transition as the platform saw it, before it's known which tick
+  // it lands on
+  struct Input_sample
+  {
+    // Platform clock, nanoseconds
+    u64 timestamp_ns;
+    Key key;
+    bool down;
+  };
+
+  // Power of two
+  inline constexpr u64 input_queue_capacity = 256;
+
+  // Single producer, single consumer. Whoever reads the platform's
+  // events pushes, the fixed tick loop pops what happened before the end
+  // of the tick it's about to simulate and leaves the rest for later
+  // ticks.
+  struct Input_queue
+  {
+    std::array<Input_sample, input_queue_capacity> samples;
+    alignas (64) std::atomic<u64> write_index;
+    alignas (64) std::atomic<u64> read_index;
+  };
+
+  // Returns false if it's full, the sample is dropped
+  inline bool
+  input_queue_push (Input_queue &queue, Input_sample const &sample)
+  {
+    u64 const index = queue.write_index.load (std::memory_order_relaxed);
+    if (index - queue.read_index.load (std::memory_order_acquire) == input_queue_capacity)
+      return false;
+
+    queue.samples[index & (input_queue_capacity - 1)] = sample;
+    queue.write_index.store (index + 1, std::memory_order_release);
+
+    return true;
+  }
+
+  // Takes the oldest sample if it's from before the given time
+  inline bool
+  input_queue_pop_before (Input_queue &queue, u64 time_ns, Input_sample &sample)
+  {
+    u64 const index = queue.read_index.load (std::memory_order_relaxed);
+    if (index == queue.write_index.load (std::memory_order_acquire))
+      return false;
+
+    Input_sample const &oldest = queue.samples[index & (input_queue_capacity - 1)];
+    if (oldest.timestamp_ns > time_ns)
+      return false;
+
+    sample = oldest;
+    queue.read_index.store (index + 1, std::memory_order_release);
+
+    return true;
+  }
+};
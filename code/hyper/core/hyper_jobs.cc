@@ -0,0 +1,340 @@
+#include "hyper_jobs.hh"
+#include "hyper_math.hh"
+
+#include <immintrin.h>
+#include <cassert>
+#include <new>
+
+namespace hyper
+{
+  // Failed attempts to find work before a worker goes to sleep
+  static constexpr u32 worker_spin_count = 256;
+
+  //
+  // Chase-Lev deque, see "Correct and Efficient Work-Stealing for Weak
+  // Memory Models" (Lê et al. 2013). Only the owner pushes and pops,
+  // anybody can steal.
+  //
+  static bool
+  deque_push (Job_deque &deque, Job *job)
+  {
+    i64 const bottom = deque.bottom.load (std::memory_order_relaxed);
+    i64 const top = deque.top.load (std::memory_order_acquire);
+
+    if (bottom - top >= (i64) job_deque_capacity)
+      return false;
+
+    deque.jobs[(u64) bottom & (job_deque_capacity - 1)].store (job, std::memory_order_relaxed);
+    std::atomic_thread_fence (std::memory_order_release);
+    deque.bottom.store (bottom + 1, std::memory_order_relaxed);
+
+    return true;
+  }
+
+  static Job *
+  deque_pop (Job_deque &deque)
+  {
+    i64 const bottom = deque.bottom.load (std::memory_order_relaxed) - 1;
+    deque.bottom.store (bottom, std::memory_order_relaxed);
+    std::atomic_thread_fence (std::memory_order_seq_cst);
+    i64 top = deque.top.load (std::memory_order_relaxed);
+
+    if (top > bottom)
+      {
+        // empty
+        deque.bottom.store (bottom + 1, std::memory_order_relaxed);
+        return nullptr;
+      }
+
+    Job *job = deque.jobs[(u64) bottom & (job_deque_capacity - 1)].load (std::memory_order_relaxed);
+
+    if (top == bottom)
+      {
+        // last one, race against the thieves for it
+        if (!deque.top.compare_exchange_strong (top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+          job = nullptr;
+
+        deque.bottom.store (bottom + 1, std::memory_order_relaxed);
+      }
+
+    return job;
+  }
+
+  static Job *
+  deque_steal (Job_deque &deque)
+  {
+    i64 top = deque.top.load (std::memory_order_acquire);
+    std::atomic_thread_fence (std::memory_order_seq_cst);
+    i64 const bottom = deque.bottom.load (std::memory_order_acquire);
+
+    if (top >= bottom)
+      return nullptr;
+
+    Job *job = deque.jobs[(u64) top & (job_deque_capacity - 1)].load (std::memory_order_relaxed);
+
+    if (!deque.top.compare_exchange_strong (top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+      return nullptr;
+
+    return job;
+  }
+
+  static u32
+  get_current_worker_index (Job_system &system)
+  {
+    // Don't use thread_local for this, the engine and the game library
+    // would each get their own copy
+    std::thread::id const id = std::this_thread::get_id ();
+
+    for (u32 i = 0; i < system.worker_count; ++i)
+      {
+        if (system.workers[i].id == id)
+          return i;
+      }
+
+    assert (false && "jobs can only be used from worker threads");
+    return 0;
+  }
+
+  static u32
+  get_random_worker_index (Job_worker &worker, u32 worker_count)
+  {
+    // xorshift32
+    u32 x = worker.random_state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    worker.random_state = x;
+
+    return x % worker_count;
+  }
+
+  static Job *
+  get_job (Job_system &system, u32 worker_index)
+  {
+    Job_worker &worker = system.workers[worker_index];
+
+    Job *job = deque_pop (worker.deque);
+
+    if (!job && system.worker_count > 1)
+      {
+        u32 const victim_index = get_random_worker_index (worker, system.worker_count);
+        if (victim_index != worker_index)
+          job = deque_steal (system.workers[victim_index].deque);
+      }
+
+    if (job)
+      system.queued_jobs.fetch_sub (1, std::memory_order_relaxed);
+
+    return job;
+  }
+
+  static void
+  finish_job (Job *job)
+  {
+    while (job)
+      {
+        i32 const unfinished_jobs = job->unfinished_jobs.fetch_sub (1, std::memory_order_acq_rel) - 1;
+        if (unfinished_jobs != 0)
+          return;
+
+        job = job->parent;
+      }
+  }
+
+  static void
+  execute_job (Job_system &system, Job *job)
+  {
+    if (job->function)
+      job->function (system, job->data, job->begin, job->end);
+
+    finish_job (job);
+  }
+
+  static void
+  worker_main (Job_system *system, u32 worker_index)
+  {
+    // Wait until every worker id has been published
+    while (!system->running.load (std::memory_order_acquire))
+      std::this_thread::yield ();
+
+    u32 failed_attempts = 0;
+
+    while (system->running.load (std::memory_order_acquire))
+      {
+        Job *job = get_job (*system, worker_index);
+        if (job)
+          {
+            execute_job (*system, job);
+            failed_attempts = 0;
+            continue;
+          }
+
+        if (++failed_attempts < worker_spin_count)
+          {
+            _mm_pause ();
+            continue;
+          }
+
+        std::unique_lock<std::mutex> lock (system->sleep_mutex);
+        system->sleeping_workers.fetch_add (1);
+        system->wake_up.wait (lock, [system] {
+          return system->queued_jobs.load () > 0 || !system->running.load ();
+        });
+        system->sleeping_workers.fetch_sub (1);
+        failed_attempts = 0;
+      }
+  }
+
+  bool
+  jobs_init (Job_system &system, std::pmr::memory_resource *resource, u32 worker_count)
+  {
+    if (worker_count == 0)
+      worker_count = hyper::max (std::thread::hardware_concurrency (), 1u);
+
+    system.workers = static_cast<Job_worker *> (resource->allocate (sizeof (Job_worker) * worker_count, alignof (Job_worker)));
+    system.worker_count = worker_count;
+    system.running.store (false);
+    system.queued_jobs.store (0);
+    system.sleeping_workers.store (0);
+
+    for (u32 i = 0; i < worker_count; ++i)
+      {
+        new (&system.workers[i]) Job_worker ();
+        system.workers[i].random_state = i + 1;
+      }
+
+    // The calling thread is worker 0
+    system.workers[0].id = std::this_thread::get_id ();
+
+    for (u32 i = 1; i < worker_count; ++i)
+      {
+        system.workers[i].thread = std::thread (worker_main, &system, i);
+        system.workers[i].id = system.workers[i].thread.get_id ();
+      }
+
+    system.running.store (true, std::memory_order_release);
+
+    return true;
+  }
+
+  void
+  jobs_quit (Job_system &system)
+  {
+    if (!system.workers)
+      return;
+
+    {
+      std::lock_guard<std::mutex> lock (system.sleep_mutex);
+      system.running.store (false);
+    }
+    system.wake_up.notify_all ();
+
+    for (u32 i = 1; i < system.worker_count; ++i)
+      {
+        if (system.workers[i].thread.joinable ())
+          system.workers[i].thread.join ();
+      }
+
+    // The memory belongs to the arena, just run the destructors
+    for (u32 i = 0; i < system.worker_count; ++i)
+      system.workers[i].~Job_worker ();
+
+    system.workers = nullptr;
+    system.worker_count = 0;
+  }
+
+  Job *
+  jobs_create (Job_system &system, Job_function function, void *data, u32 begin, u32 end, Job *parent)
+  {
+    Job_worker &worker = system.workers[get_current_worker_index (system)];
+
+    Job *job = &worker.pool[worker.pool_next++ & (job_pool_capacity - 1)];
+    job->function = function;
+    job->data = data;
+    job->parent = parent;
+    job->begin = begin;
+    job->end = end;
+    job->unfinished_jobs.store (1, std::memory_order_relaxed);
+
+    if (parent)
+      parent->unfinished_jobs.fetch_add (1, std::memory_order_relaxed);
+
+    return job;
+  }
+
+  void
+  jobs_run (Job_system &system, Job *job)
+  {
+    Job_worker &worker = system.workers[get_current_worker_index (system)];
+
+    if (!deque_push (worker.deque, job))
+      {
+        // Full, better to do it now than to drop it
+        execute_job (system, job);
+        return;
+      }
+
+    system.queued_jobs.fetch_add (1);
+
+    if (system.sleeping_workers.load () > 0)
+      {
+        // Taking the lock makes sure the worker is really waiting,
+        // otherwise the notification could get lost
+        {
+          std::lock_guard<std::mutex> lock (system.sleep_mutex);
+        }
+        system.wake_up.notify_one ();
+      }
+  }
+
+  void
+  jobs_wait (Job_system &system, Job *job)
+  {
+    u32 const worker_index = get_current_worker_index (system);
+
+    while (job->unfinished_jobs.load (std::memory_order_acquire) > 0)
+      {
+        Job *next = get_job (system, worker_index);
+        if (next)
+          execute_job (system, next);
+        else
+          _mm_pause ();
+      }
+  }
+
+  void
+  jobs_parallel_for (Job_system &system, u32 count, u32 grain_size, Job_function function, void *data)
+  {
+    if (count == 0)
+      return;
+
+    grain_size = hyper::max (grain_size, 1u);
+
+    // Nobody to share with, skip the bookkeeping
+    if (system.worker_count <= 1)
+      {
+        for (u32 begin = 0; begin < count; begin += grain_size)
+          function (system, data, begin, hyper::min (begin + grain_size, count));
+
+        return;
+      }
+
+    // Don't let a single call wrap around the job pool, older jobs
+    // could still be waiting in a deque
+    u32 const max_chunks = job_pool_capacity / 2;
+    if ((count + grain_size - 1) / grain_size > max_chunks)
+      grain_size = (count + max_chunks - 1) / max_chunks;
+
+    Job *root = jobs_create (system, nullptr, nullptr, 0, 0, nullptr);
+
+    for (u32 begin = 0; begin < count; begin += grain_size)
+      {
+        Job *child = jobs_create (system, function, data, begin, hyper::min (begin + grain_size, count), root);
+        jobs_run (system, child);
+      }
+
+    // root has no work of its own
+    finish_job (root);
+    jobs_wait (system, root);
+  }
+};
@@ -0,0 +1,90 @@
+//
+// Work stealing job system. There's one worker per core, the thread
+// that calls jobs_init is worker 0 and the rest are spawned. Each
+// worker owns a Chase-Lev deque: it pushes and pops at the bottom,
+// idle workers steal from the top of somebody else's.
+//
+// All state lives in Job_system, nothing is static, so the copy of
+// this code compiled into the hot reloaded library operates on the
+// same workers as the engine. Jobs must be finished before the game
+// library is swapped, their functions live inside it.
+//
+#pragma once
+
+#include "hyper_common.hh"
+
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <memory_resource>
+#include <mutex>
+#include <thread>
+
+namespace hyper
+{
+  // Both must be powers of two
+  inline constexpr u32 job_deque_capacity = 4096;
+  inline constexpr u32 job_pool_capacity = 4096;
+
+  struct Job_system;
+
+  // Jobs work on [begin, end), single jobs just ignore the range
+  using Job_function = void (*) (Job_system &, void *, u32, u32);
+
+  struct Job
+  {
+    Job_function function;
+    void *data;
+    Job *parent;
+    u32 begin;
+    u32 end;
+    // Itself plus its children, the job is done when it reaches 0
+    std::atomic<i32> unfinished_jobs;
+  };
+
+  struct Job_deque
+  {
+    alignas (64) std::atomic<i64> top;
+    alignas (64) std::atomic<i64> bottom;
+    std::array<std::atomic<Job *>, job_deque_capacity> jobs;
+  };
+
+  struct Job_worker
+  {
+    Job_deque deque;
+    // Ring of jobs, slots are recycled once it wraps around, so there
+    // can't be more than job_pool_capacity jobs in flight per worker
+    std::array<Job, job_pool_capacity> pool;
+    u32 pool_next;
+    u32 random_state;
+    std::thread thread;
+    std::thread::id id;
+  };
+
+  struct Job_system
+  {
+    Job_worker *workers;
+    u32 worker_count;
+    std::atomic<bool> running;
+    // Workers sleep here when they can't find anything to steal
+    std::atomic<i32> queued_jobs;
+    std::atomic<i32> sleeping_workers;
+    std::mutex sleep_mutex;
+    std::condition_variable wake_up;
+  };
+
+  // 0 workers means one per core
+  bool jobs_init (Job_system &, std::pmr::memory_resource *, u32);
+
+  void jobs_quit (Job_system &);
+
+  Job *jobs_create (Job_system &, Job_function, void *, u32, u32, Job *);
+
+  void jobs_run (Job_system &, Job *);
+
+  // Helps executing other jobs until this one is finished
+  void jobs_wait (Job_system &, Job *);
+
+  // Splits [0, count) in chunks of grain_size and waits for all of them
+  void jobs_parallel_for (Job_system &, u32, u32, Job_function, void *);
+};
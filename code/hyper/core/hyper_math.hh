@@ -77,6 +77,13 @@ namespace hyper
     return a < b ? a : b;
   }
 
+  template <typename T>
+  inline constexpr T
+  clamp (T value, T low, T high)
+  {
+    return min (max (value, low), high);
+  }
+
   inline constexpr f32
   sqrt (f32 value)
   {
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <cstddef>
 #include <memory_resource>
 #include <new>
 
@@ -35,4 +36,52 @@ namespace hyper
       return this == &other;
     }
   };
+
+  // Sits in front of an arena and keeps track of how much of it is in
+  // use, arenas don't say. Padding for alignment isn't counted.
+  class Counting_memory_resource : public std::pmr::memory_resource
+  {
+  public:
+    explicit Counting_memory_resource (std::pmr::memory_resource *upstream_resource, size_t size)
+      : upstream {upstream_resource}, capacity {size}
+    {}
+
+    // Call it when the arena underneath gets released
+    void
+    reset () noexcept
+    {
+      used = 0;
+    }
+
+    std::pmr::memory_resource *upstream;
+    size_t capacity;
+    size_t used = 0;
+    // Highest used has ever been
+    size_t peak = 0;
+
+  protected:
+    void *
+    do_allocate (size_t bytes, size_t alignment) override
+    {
+      void *ptr = upstream->allocate (bytes, alignment);
+      used += bytes;
+
+      if (used > peak)
+        peak = used;
+
+      return ptr;
+    }
+
+    void
+    do_deallocate (void *ptr, size_t bytes, size_t alignment) override
+    {
+      upstream->deallocate (ptr, bytes, alignment);
+    }
+
+    bool
+    do_is_equal (std::pmr::memory_resource const& other) const noexcept override
+    {
+      return this == &other;
+    }
+  };
 };
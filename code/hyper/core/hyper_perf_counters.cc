@@ -0,0 +1,250 @@
+#include "hyper_perf_counters.hh"
+
+#include <errno.h>
+#include <linux/perf_event.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <iostream>
+
+namespace hyper
+{
+  static char const *const perf_scope_names[] =
+    {
+      "update", "render", "hud", "upload", "present",
+      "set_background_colour", "draw_triangle_outline", "draw_triangle_filled", "draw_triangle_shaded",
+      "draw_polygon_filled", "draw_circle_outline", "draw_circle_filled", "draw_line", "draw_quad_filled",
+      "draw_text",
+    };
+
+  static_assert (sizeof (perf_scope_names) / sizeof (perf_scope_names[0]) == (size_t) Perf_scope::count);
+
+  static char const *const perf_counter_names[] =
+    {
+      "cycles", "instructions", "L1D misses", "LLC misses", "branch misses", "dTLB misses",
+    };
+
+  static_assert (sizeof (perf_counter_names) / sizeof (perf_counter_names[0]) == (size_t) Perf_counter::count);
+
+  static inline constexpr u64
+  get_cache_config (u64 cache)
+  {
+    return cache | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+  }
+
+  static void
+  set_counter_event (perf_event_attr &attr, Perf_counter counter)
+  {
+    switch (counter)
+      {
+      case Perf_counter::cycles:
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.config = PERF_COUNT_HW_CPU_CYCLES;
+        break;
+      case Perf_counter::instructions:
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.config = PERF_COUNT_HW_INSTRUCTIONS;
+        break;
+      case Perf_counter::l1d_misses:
+        attr.type = PERF_TYPE_HW_CACHE;
+        attr.config = get_cache_config (PERF_COUNT_HW_CACHE_L1D);
+        break;
+      case Perf_counter::llc_misses:
+        attr.type = PERF_TYPE_HW_CACHE;
+        attr.config = get_cache_config (PERF_COUNT_HW_CACHE_LL);
+        break;
+      case Perf_counter::branch_misses:
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.config = PERF_COUNT_HW_BRANCH_MISSES;
+        break;
+      case Perf_counter::dtlb_misses:
+        attr.type = PERF_TYPE_HW_CACHE;
+        attr.config = get_cache_config (PERF_COUNT_HW_CACHE_DTLB);
+        break;
+      default:
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.config = 0;
+        break;
+      }
+  }
+
+  static i32
+  open_counter (Perf_counter counter, i32 group_fd)
+  {
+    perf_event_attr attr;
+    memset (&attr, 0, sizeof (attr));
+    attr.size = sizeof (attr);
+    set_counter_event (attr, counter);
+    attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    // The leader starts the whole group
+    attr.disabled = group_fd == -1;
+    // The kernel's share can't be helped and needs privileges anyway
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+
+    return (i32) syscall (SYS_perf_event_open, &attr, 0, -1, group_fd, PERF_FLAG_FD_CLOEXEC);
+  }
+
+  bool
+  perf_counters_open (Perf_counters &counters)
+  {
+    memset (&counters, 0, sizeof (counters));
+    counters.fds.fill (-1);
+
+    // Without a leader there's no group
+    i32 const leader = open_counter (Perf_counter::cycles, -1);
+    if (leader == -1)
+      {
+        std::cerr << "couldn't open the performance counters: " << strerror (errno)
+                  << " (see /proc/sys/kernel/perf_event_paranoid)\n";
+        return false;
+      }
+
+    counters.fds[(size_t) Perf_counter::cycles] = leader;
+    counters.slots[(size_t) Perf_counter::cycles] = counters.open_count++;
+
+    // Virtual machines and some CPUs don't have all of them, those
+    // just read 0
+    for (size_t counter = 0; counter < counters.fds.size (); ++counter)
+      {
+        if (counter == (size_t) Perf_counter::cycles)
+          continue;
+
+        i32 const fd = open_counter ((Perf_counter) counter, leader);
+        if (fd == -1)
+          continue;
+
+        counters.fds[counter] = fd;
+        counters.slots[counter] = counters.open_count++;
+      }
+
+    if (ioctl (leader, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP) == -1
+        || ioctl (leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP) == -1)
+      {
+        std::cerr << "couldn't start the performance counters: " << strerror (errno) << '\n';
+        perf_counters_close (counters);
+        return false;
+      }
+
+    return true;
+  }
+
+  void
+  perf_counters_close (Perf_counters &counters)
+  {
+    // Members first, then the leader
+    for (size_t counter = counters.fds.size (); counter-- > 0;)
+      if (counters.fds[counter] != -1)
+        {
+          close (counters.fds[counter]);
+          counters.fds[counter] = -1;
+        }
+
+    counters.open_count = 0;
+  }
+
+  void
+  perf_counters_read (Perf_counters const &counters, Perf_counter_reading &reading)
+  {
+    // Count, time enabled, time running, then one value per open
+    // counter in the order they opened
+    u64 buffer[3 + (size_t) Perf_counter::count] = {};
+    reading.values.fill (0);
+    reading.time_enabled = 0;
+    reading.time_running = 0;
+
+    i32 const leader = counters.fds[(size_t) Perf_counter::cycles];
+    if (leader == -1 || read (leader, buffer, sizeof (buffer)) <= 0 || buffer[0] != counters.open_count)
+      return;
+
+    reading.time_enabled = buffer[1];
+    reading.time_running = buffer[2];
+
+    for (size_t counter = 0; counter < reading.values.size (); ++counter)
+      if (counters.fds[counter] != -1)
+        reading.values[counter] = buffer[3 + counters.slots[counter]];
+  }
+
+  void
+  perf_counters_add (Perf_counters &counters, Perf_scope scope, Perf_counter_reading const &start)
+  {
+    Perf_counter_reading end;
+    perf_counters_read (counters, end);
+
+    Perf_scope_counts &frame = counters.frame[(size_t) scope];
+    Perf_scope_counts &total = counters.total[(size_t) scope];
+
+    ++frame.calls;
+    ++total.calls;
+
+    // Scaling by 0 would make up numbers, better to say so
+    u64 const enabled = end.time_enabled - start.time_enabled;
+    u64 const running = end.time_running - start.time_running;
+    if (!running)
+      {
+        ++frame.not_counted;
+        ++total.not_counted;
+        return;
+      }
+
+    f64 const scale = (f64) enabled / (f64) running;
+
+    for (size_t counter = 0; counter < end.values.size (); ++counter)
+      {
+        u64 const delta = end.values[counter] - start.values[counter];
+        u64 const scaled = running < enabled ? (u64) ((f64) delta * scale) : delta;
+        frame.values[counter] += scaled;
+        total.values[counter] += scaled;
+      }
+  }
+
+  void
+  perf_counters_next_frame (Perf_counters &counters)
+  {
+    memset (counters.frame.data (), 0, sizeof (counters.frame));
+    ++counters.frames;
+  }
+
+  void
+  perf_counters_print (Perf_counters const &counters)
+  {
+    fprintf (stderr, "performance counters over %llu frames, per call, scaled when the kernel multiplexed them\n", (unsigned long long) counters.frames);
+    for (size_t counter = 0; counter < counters.fds.size (); ++counter)
+      if (counters.fds[counter] == -1)
+        fprintf (stderr, "no %s on this machine, they read 0\n", perf_counter_names[counter]);
+
+    fprintf (stderr, "%-22s %9s %11s %11s %5s %9s %9s %9s %9s\n",
+             "scope", "calls", "cycles", "instr", "IPC", "L1D miss", "LLC miss", "br miss", "dTLB miss");
+
+    for (size_t scope = 0; scope < counters.total.size (); ++scope)
+      {
+        Perf_scope_counts const &total = counters.total[scope];
+        if (!total.calls)
+          continue;
+
+        if (total.not_counted == total.calls)
+          {
+            fprintf (stderr, "%-22s %9llu not counted\n", perf_scope_names[scope], (unsigned long long) total.calls);
+            continue;
+          }
+
+        auto const per_call = [&] (Perf_counter counter) { return (f64) total.values[(size_t) counter] / (f64) total.calls; };
+        f64 const cycles = per_call (Perf_counter::cycles);
+
+        fprintf (stderr, "%-22s %9llu %11.0f %11.0f %5.2f %9.1f %9.1f %9.1f %9.1f\n",
+                 perf_scope_names[scope], (unsigned long long) total.calls,
+                 cycles, per_call (Perf_counter::instructions),
+                 cycles > 0.0 ? per_call (Perf_counter::instructions) / cycles : 0.0,
+                 per_call (Perf_counter::l1d_misses), per_call (Perf_counter::llc_misses),
+                 per_call (Perf_counter::branch_misses), per_call (Perf_counter::dtlb_misses));
+      }
+  }
+
+  char const *
+  get_perf_scope_name (Perf_scope scope)
+  {
+    return scope < Perf_scope::count ? perf_scope_names[(size_t) scope] : "unknown";
+  }
+};
@@ -0,0 +1,134 @@
+//
+// Hardware performance counters through perf_event_open. Timers say
+// how slow something is, these say why: cycles, instructions and the
+// misses behind them, per frame stage and per draw function.
+//
+// One counter group on the thread that opened it, read with a single
+// syscall at both ends of a scope. That's about a microsecond each
+// time, so it's off unless asked for and a null check when it is.
+// Work handed to job workers isn't counted, only the main thread's.
+//
+#pragma once
+
+#include "hyper_common.hh"
+
+#include <array>
+
+namespace hyper
+{
+  enum class Perf_counter
+    {
+      cycles,
+      instructions,
+      l1d_misses,
+      llc_misses,
+      branch_misses,
+      dtlb_misses,
+
+      count
+    };
+
+  enum class Perf_scope
+    {
+      // Frame stages, measured by the platform
+      update,
+      render,
+      hud,
+      upload,
+      present,
+      // Draw functions, measured by the renderer
+      set_background_colour,
+      draw_triangle_outline,
+      draw_triangle_filled,
+      draw_triangle_shaded,
+      draw_polygon_filled,
+      draw_circle_outline,
+      draw_circle_filled,
+      draw_line,
+      draw_quad_filled,
+      draw_text,
+
+      count
+    };
+
+  using Perf_counter_values = std::array<u64, (size_t) Perf_counter::count>;
+
+  // Raw counts since open. The group only counts while it's on the PMU,
+  // when the kernel multiplexes it running falls behind enabled.
+  struct Perf_counter_reading
+  {
+    Perf_counter_values values;
+    // Nanoseconds
+    u64 time_enabled;
+    u64 time_running;
+  };
+
+  struct Perf_scope_counts
+  {
+    // Scaled up to the time the group was enabled
+    Perf_counter_values values;
+    u64 calls;
+    // Calls the group wasn't on the PMU for at all, they add nothing
+    u64 not_counted;
+  };
+
+  struct Perf_counters
+  {
+    // Group leader first, -1 for counters this CPU or kernel don't have
+    std::array<i32, (size_t) Perf_counter::count> fds;
+    // Where each open counter is in the group read
+    std::array<u32, (size_t) Perf_counter::count> slots;
+    u32 open_count;
+    // Scopes nest, the stages include the draw functions in them
+    std::array<Perf_scope_counts, (size_t) Perf_scope::count> frame;
+    std::array<Perf_scope_counts, (size_t) Perf_scope::count> total;
+    u64 frames;
+  };
+
+  // Counting starts right away. False if perf_event_open isn't allowed
+  // or there are no cycles to count, then nothing else is open.
+  bool perf_counters_open (Perf_counters &);
+
+  void perf_counters_close (Perf_counters &);
+
+  // 0 for counters that aren't there
+  void perf_counters_read (Perf_counters const &, Perf_counter_reading &);
+
+  // Adds what's been counted since the start reading to the scope
+  void perf_counters_add (Perf_counters &, Perf_scope, Perf_counter_reading const &);
+
+  // Call it as a frame starts, the last frame's counts are cleared
+  void perf_counters_next_frame (Perf_counters &);
+
+  // Totals per call for every scope that ran, to stderr
+  void perf_counters_print (Perf_counters const &);
+
+  char const *get_perf_scope_name (Perf_scope);
+
+  // Counts whatever's between its construction and the end of the
+  // block, nothing happens when there are no counters
+  class Perf_counters_scope
+  {
+  public:
+    Perf_counters_scope (Perf_counters *counters_to_add_to, Perf_scope scope_to_count)
+      : counters {counters_to_add_to}, scope {scope_to_count}
+    {
+      if (counters)
+        perf_counters_read (*counters, start);
+    }
+
+    ~Perf_counters_scope ()
+    {
+      if (counters)
+        perf_counters_add (*counters, scope, start);
+    }
+
+    Perf_counters_scope (Perf_counters_scope const &) = delete;
+    Perf_counters_scope &operator= (Perf_counters_scope const &) = delete;
+
+  private:
+    Perf_counters *counters;
+    Perf_scope scope;
+    Perf_counter_reading start;
+  };
+};
@@ -0,0 +1,43 @@
+//
+// Counter based random numbers: the same key and counter always give
+// the same value, no generator state to carry around. Anything can be
+// generated on demand, in any order, and still be deterministic.
+//
+#pragma once
+
+#include "hyper_common.hh"
+
+namespace hyper
+{
+  // splitmix64 finaliser
+  inline constexpr u64
+  hash_u64 (u64 x)
+  {
+    x ^= x >> 30;
+    x *= 0xBF58476D1CE4E5B9ull;
+    x ^= x >> 27;
+    x *= 0x94D049BB133111EBull;
+    x ^= x >> 31;
+
+    return x;
+  }
+
+  inline constexpr u64
+  hash_coordinates (i32 x, i32 y, u64 seed)
+  {
+    return hash_u64 (seed ^ hash_u64 ((u64) (u32) x << 32 | (u32) y));
+  }
+
+  inline constexpr u32
+  random_u32 (u64 key, u32 counter)
+  {
+    return (u32) (hash_u64 (key + 0x9E3779B97F4A7C15ull * (counter + 1ull)) >> 32);
+  }
+
+  // [0, 1)
+  inline constexpr f32
+  random_f32 (u64 key, u32 counter)
+  {
+    return (f32) (random_u32 (key, counter) >> 8) * (1.0f / 16777216.0f);
+  }
+};
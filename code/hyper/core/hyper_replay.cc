@@ -0,0 +1,277 @@
+#include "hyper_replay.hh"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <iostream>
+
+namespace hyper
+{
+  // Flushed to disk in big chunks, never in the middle of a frame
+  static constexpr size_t replay_buffer_size = kilobytes (64);
+  // Worst case for a tick: delta, count and every event maxed out
+  static constexpr size_t replay_max_record_size = 10 + 1 + tick_input_max_events * (1 + 5);
+
+  static size_t
+  write_varint (std::byte *buffer, u64 value)
+  {
+    size_t size = 0;
+
+    while (value >= 0x80)
+      {
+        buffer[size++] = (std::byte) ((value & 0x7F) | 0x80);
+        value >>= 7;
+      }
+
+    buffer[size++] = (std::byte) value;
+
+    return size;
+  }
+
+  static bool
+  read_varint (Replay_player &player, u64 &value)
+  {
+    value = 0;
+
+    for (u32 shift = 0; shift < 64; shift += 7)
+      {
+        if (player.cursor >= player.size)
+          return false;
+
+        u64 const byte = (u64) player.data[player.cursor++];
+        value |= (byte & 0x7F) << shift;
+
+        if (!(byte & 0x80))
+          return true;
+      }
+
+    return false;
+  }
+
+  static bool
+  flush_recorder (Replay_recorder &recorder)
+  {
+    size_t written = 0;
+
+    while (written < recorder.used)
+      {
+        ssize_t const result = write (recorder.fd, recorder.buffer + written, recorder.used - written);
+        if (result == -1)
+          {
+            if (errno == EINTR)
+              continue;
+
+            std::cerr << "couldn't write replay: " << strerror (errno) << '\n';
+            return false;
+          }
+
+        written += (size_t) result;
+      }
+
+    recorder.used = 0;
+
+    return true;
+  }
+
+  bool
+  replay_recorder_open (Replay_recorder &recorder, char const *path, u64 seed, f32 fixed_timestep, std::pmr::memory_resource *resource)
+  {
+    recorder.fd = open (path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (recorder.fd == -1)
+      {
+        std::cerr << "couldn't open replay " << path << ": " << strerror (errno) << '\n';
+        return false;
+      }
+
+    recorder.buffer = static_cast<std::byte *> (resource->allocate (replay_buffer_size, alignof (std::max_align_t)));
+    recorder.capacity = replay_buffer_size;
+    recorder.used = 0;
+    recorder.last_tick = 0;
+
+    Replay_header header {};
+    header.magic = replay_magic;
+    header.version = replay_version;
+    header.seed = seed;
+    header.fixed_timestep = fixed_timestep;
+
+    memcpy (recorder.buffer, &header, sizeof (header));
+    recorder.used = sizeof (header);
+
+    return true;
+  }
+
+  bool
+  replay_recorder_write_tick (Replay_recorder &recorder, u64 tick, Tick_input const &input)
+  {
+    if (!recorder.buffer || input.event_count == 0)
+      return true;
+
+    if (recorder.capacity - recorder.used < replay_max_record_size && !flush_recorder (recorder))
+      return false;
+
+    std::byte *cursor = recorder.buffer + recorder.used;
+
+    cursor += write_varint (cursor, tick - recorder.last_tick);
+    *cursor++ = (std::byte) input.event_count;
+
+    for (u32 i = 0; i < input.event_count; ++i)
+      {
+        Input_event const &event = input.events[i];
+        *cursor++ = (std::byte) ((u8) event.key | (event.down ? 0x80 : 0x00));
+        cursor += write_varint (cursor, event.timestamp_us);
+      }
+
+    recorder.used = (size_t) (cursor - recorder.buffer);
+    recorder.last_tick = tick;
+
+    return true;
+  }
+
+  void
+  replay_recorder_close (Replay_recorder &recorder, u64 tick_count)
+  {
+    if (!recorder.buffer)
+      return;
+
+    if (recorder.capacity - recorder.used < replay_max_record_size)
+      flush_recorder (recorder);
+
+    std::byte *cursor = recorder.buffer + recorder.used;
+    cursor += write_varint (cursor, tick_count - recorder.last_tick);
+    *cursor++ = (std::byte) 0;
+    recorder.used = (size_t) (cursor - recorder.buffer);
+
+    flush_recorder (recorder);
+    close (recorder.fd);
+    recorder.fd = -1;
+    recorder.buffer = nullptr;
+  }
+
+  static bool
+  read_record_header (Replay_player &player)
+  {
+    u64 tick_delta;
+    if (!read_varint (player, tick_delta) || player.cursor >= player.size)
+      return false;
+
+    player.next_tick += tick_delta;
+    player.next_event_count = (u32) player.data[player.cursor++];
+
+    return player.next_event_count <= tick_input_max_events;
+  }
+
+  bool
+  replay_player_open (Replay_player &player, char const *path, std::pmr::memory_resource *resource)
+  {
+    i32 const fd = open (path, O_RDONLY);
+    if (fd == -1)
+      {
+        std::cerr << "couldn't open replay " << path << ": " << strerror (errno) << '\n';
+        return false;
+      }
+
+    struct stat file_stat;
+    if (fstat (fd, &file_stat) == -1 || (size_t) file_stat.st_size < sizeof (Replay_header))
+      {
+        std::cerr << "replay " << path << " is too small\n";
+        close (fd);
+        return false;
+      }
+
+    // Read it all upfront, no I/O while replaying
+    size_t const size = (size_t) file_stat.st_size;
+    auto *data = static_cast<std::byte *> (resource->allocate (size, alignof (std::max_align_t)));
+    size_t bytes_read = 0;
+
+    while (bytes_read < size)
+      {
+        ssize_t const result = read (fd, data + bytes_read, size - bytes_read);
+        if (result == -1 && errno == EINTR)
+          continue;
+
+        if (result <= 0)
+          {
+            std::cerr << "couldn't read replay " << path << ": " << strerror (errno) << '\n';
+            close (fd);
+            return false;
+          }
+
+        bytes_read += (size_t) result;
+      }
+
+    close (fd);
+
+    Replay_header header;
+    memcpy (&header, data, sizeof (header));
+    if (header.magic != replay_magic || header.version != replay_version)
+      {
+        std::cerr << "replay " << path << " has an unknown format\n";
+        return false;
+      }
+
+    player.data = data;
+    player.size = size;
+    player.cursor = sizeof (header);
+    player.seed = header.seed;
+    player.fixed_timestep = header.fixed_timestep;
+    player.next_tick = 0;
+    player.next_event_count = 0;
+    player.finished = false;
+
+    if (!read_record_header (player))
+      {
+        std::cerr << "replay " << path << " is truncated\n";
+        return false;
+      }
+
+    return true;
+  }
+
+  bool
+  replay_player_read_tick (Replay_player &player, u64 tick, Tick_input &input)
+  {
+    input.event_count = 0;
+
+    if (player.finished)
+      return false;
+
+    if (player.next_event_count == 0)
+      {
+        // end marker, next_tick is the number of recorded ticks
+        player.finished = tick >= player.next_tick;
+        return !player.finished;
+      }
+
+    if (tick < player.next_tick)
+      return true;
+
+    for (u32 i = 0; i < player.next_event_count; ++i)
+      {
+        u64 timestamp_us;
+        if (player.cursor >= player.size)
+          break;
+
+        u8 const key_byte = (u8) player.data[player.cursor++];
+        if (!read_varint (player, timestamp_us))
+          break;
+
+        Input_event event;
+        event.key = (Key) (key_byte & 0x7F);
+        event.down = key_byte & 0x80;
+        event.timestamp_us = (u32) timestamp_us;
+
+        if (event.key < Key::count)
+          tick_input_push (input, event);
+      }
+
+    if (!read_record_header (player))
+      {
+        std::cerr << "replay is truncated, stopping\n";
+        player.finished = true;
+      }
+
+    return true;
+  }
+};
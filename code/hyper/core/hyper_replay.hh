@@ -0,0 +1,70 @@
+//
+// Input recording and replay. A recording is the seed the game was
+// started with followed by the input of every fixed tick that had
+// any, so feeding it back reproduces the same simulation.
+//
+// Layout, little endian:
+//   Replay_header
+//   records: varint tick delta, u8 event count, events
+//   events:  u8 key | down << 7, varint timestamp in microseconds
+//   end:     varint tick delta to the last tick, u8 0
+//
+#pragma once
+
+#include "hyper_common.hh"
+#include "hyper_input.hh"
+
+#include <memory_resource>
+
+namespace hyper
+{
+  inline constexpr u32 replay_magic = 0x4C505248; // "HRPL"
+  // 2: key repeats are no longer events
+  inline constexpr u16 replay_version = 2;
+
+  struct Replay_header
+  {
+    u32 magic;
+    u16 version;
+    u16 reserved;
+    u64 seed;
+    f32 fixed_timestep;
+    u32 padding;
+  };
+
+  struct Replay_recorder
+  {
+    std::byte *buffer;
+    size_t capacity;
+    size_t used;
+    u64 last_tick;
+    i32 fd;
+  };
+
+  struct Replay_player
+  {
+    std::byte const *data;
+    size_t size;
+    size_t cursor;
+    u64 seed;
+    f32 fixed_timestep;
+    // Tick of the record at cursor, or the last tick if it's the end
+    u64 next_tick;
+    u32 next_event_count;
+    bool finished;
+  };
+
+  bool replay_recorder_open (Replay_recorder &, char const *, u64, f32, std::pmr::memory_resource *);
+
+  // Ticks without events aren't written
+  bool replay_recorder_write_tick (Replay_recorder &, u64, Tick_input const &);
+
+  // Writes the end marker, tick count is the number of ticks simulated
+  void replay_recorder_close (Replay_recorder &, u64);
+
+  bool replay_player_open (Replay_player &, char const *, std::pmr::memory_resource *);
+
+  // Fills the input recorded for this tick, false once the recording
+  // is over. Ticks must be read in order.
+  bool replay_player_read_tick (Replay_player &, u64, Tick_input &);
+};
@@ -0,0 +1,88 @@
+#include "hyper_snapshot.hh"
+#include "hyper_math.hh"
+
+#include <cstring>
+
+namespace hyper
+{
+  static u32
+  copy_changed_pages (std::byte *destination, std::byte const *source, size_t size)
+  {
+    u32 copied = 0;
+
+    for (size_t offset = 0; offset < size; offset += snapshot_page_size)
+      {
+        size_t const length = hyper::min (snapshot_page_size, size - offset);
+
+        // Reading both is cheaper than writing one, most pages match
+        if (std::memcmp (destination + offset, source + offset, length) != 0)
+          {
+            std::memcpy (destination + offset, source + offset, length);
+            ++copied;
+          }
+      }
+
+    return copied;
+  }
+
+  size_t
+  snapshot_ring_get_size (size_t size, u32 slot_count)
+  {
+    size_t const slot_stride = (size + snapshot_page_size - 1) & ~(snapshot_page_size - 1);
+
+    return slot_stride * slot_count + snapshot_page_size + sizeof (u64) * slot_count + alignof (u64);
+  }
+
+  bool
+  snapshot_ring_init (Snapshot_ring &ring, size_t size, u32 slot_count, std::pmr::memory_resource *resource)
+  {
+    if (slot_count == 0)
+      return false;
+
+    ring.size = size;
+    ring.slot_stride = (size + snapshot_page_size - 1) & ~(snapshot_page_size - 1);
+    ring.slot_count = slot_count;
+    ring.next = 0;
+    ring.count = 0;
+    ring.pages_copied = 0;
+
+    ring.slots = static_cast<std::byte *> (resource->allocate (ring.slot_stride * slot_count, snapshot_page_size));
+    ring.ticks = static_cast<u64 *> (resource->allocate (sizeof (u64) * slot_count, alignof (u64)));
+
+    // Zeroed, so even the first round of saves skips the pages that
+    // are still zero in the state
+    std::memset (ring.slots, 0, ring.slot_stride * slot_count);
+
+    return true;
+  }
+
+  void
+  snapshot_save (Snapshot_ring &ring, void const *state, u64 tick)
+  {
+    std::byte *slot = ring.slots + (size_t) ring.next * ring.slot_stride;
+
+    ring.pages_copied = copy_changed_pages (slot, static_cast<std::byte const *> (state), ring.size);
+    ring.ticks[ring.next] = tick;
+    ring.next = (ring.next + 1) % ring.slot_count;
+    ring.count = hyper::min (ring.count + 1, ring.slot_count);
+  }
+
+  bool
+  snapshot_restore (Snapshot_ring &ring, void *state, u32 age, u64 &tick)
+  {
+    if (age >= ring.count)
+      return false;
+
+    u32 const index = (ring.next + ring.slot_count - 1 - age) % ring.slot_count;
+    std::byte const *slot = ring.slots + (size_t) index * ring.slot_stride;
+
+    ring.pages_copied = copy_changed_pages (static_cast<std::byte *> (state), slot, ring.size);
+    tick = ring.ticks[index];
+
+    // The restored one is the newest now
+    ring.next = (index + 1) % ring.slot_count;
+    ring.count -= age;
+
+    return true;
+  }
+};
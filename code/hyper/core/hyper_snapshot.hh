@@ -0,0 +1,48 @@
+//
+// Snapshots of the simulation state, one per fixed tick in a ring of
+// slots allocated up front. A slot being reused still holds the state
+// from slot_count ticks ago, only the pages that changed since then
+// get copied, same when restoring. For a state that's mostly caches
+// and unused capacity that's a handful of pages per tick.
+//
+#pragma once
+
+#include "hyper_common.hh"
+
+#include <cstddef>
+#include <memory_resource>
+
+namespace hyper
+{
+  inline constexpr size_t snapshot_page_size = 4096;
+
+  struct Snapshot_ring
+  {
+    // slot_count images of size bytes, each starting on a page
+    std::byte *slots;
+    u64 *ticks;
+    size_t size;
+    size_t slot_stride;
+    u32 slot_count;
+    // Where the next save goes and how many slots hold one
+    u32 next;
+    u32 count;
+    // Pages the last save or restore copied
+    u32 pages_copied;
+  };
+
+  // Bytes snapshot_ring_init allocates for slot_count snapshots of size
+  // bytes, padding for alignment included
+  size_t snapshot_ring_get_size (size_t, u32);
+
+  // Returns false if slot_count is 0
+  bool snapshot_ring_init (Snapshot_ring &, size_t, u32, std::pmr::memory_resource *);
+
+  // The oldest one gets replaced once the ring is full
+  void snapshot_save (Snapshot_ring &, void const *, u64);
+
+  // Age 0 is the newest. Everything newer than the restored snapshot
+  // is dropped, saves carry on from it. Returns false if there's no
+  // snapshot that old.
+  bool snapshot_restore (Snapshot_ring &, void *, u32, u64 &);
+};
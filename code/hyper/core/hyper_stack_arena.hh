@@ -17,15 +17,19 @@ namespace hyper
   struct Stack_arena
   {
     explicit Stack_arena (Stack_arena_arguments const &args)
-      : resource {args.backing_buffer, args.size, args.resource}
+      : arena {args.backing_buffer, args.size, args.resource},
+        resource {&arena, args.size}
     {}
 
-    std::pmr::monotonic_buffer_resource resource;
+    std::pmr::monotonic_buffer_resource arena;
+    // Allocate from this one, it counts what's in use
+    Counting_memory_resource resource;
   };
 
   inline void
   stack_arena_release (Stack_arena *arena)
   {
-    arena->resource.release ();
+    arena->arena.release ();
+    arena->resource.reset ();
   }
 };
@@ -0,0 +1,96 @@
+#include "hyper_task_scheduler.hh"
+#include "hyper_clock.hh"
+#include "hyper_math.hh"
+
+namespace hyper
+{
+  void
+  task_scheduler_init (Task_scheduler &scheduler)
+  {
+    scheduler.task_count = 0;
+    scheduler.next = 0;
+    scheduler.run_ns = 0;
+    scheduler.steps = 0;
+    scheduler.finished = 0;
+  }
+
+  bool
+  task_scheduler_add (Task_scheduler &scheduler, Task_step_function step, void *data)
+  {
+    if (scheduler.task_count == scheduler_max_tasks)
+      return false;
+
+    Task &task = scheduler.tasks[scheduler.task_count++];
+    task.step = step;
+    task.data = data;
+    task.step_ns = 0;
+    task.idle = false;
+
+    return true;
+  }
+
+  void
+  task_scheduler_run (Task_scheduler &scheduler, u64 deadline_ns)
+  {
+    u64 const start_ns = get_time_ns ();
+    u64 now_ns = start_ns;
+    u32 steps = 0;
+    u32 finished = 0;
+    // Tasks in a row that didn't get a step, once it's all of them
+    // there's nothing that fits
+    u32 skipped = 0;
+
+    for (u32 i = 0; i < scheduler.task_count; ++i)
+      scheduler.tasks[i].idle = false;
+
+    while (skipped < scheduler.task_count)
+      {
+        if (scheduler.next >= scheduler.task_count)
+          scheduler.next = 0;
+
+        Task &task = scheduler.tasks[scheduler.next];
+        if (task.idle || now_ns + task.step_ns > deadline_ns)
+          {
+            // Waiting decays it too, or one slow step could keep a
+            // task out of every slice after it
+            if (!task.idle)
+              task.step_ns -= task.step_ns >> 4;
+
+            ++skipped;
+            ++scheduler.next;
+            continue;
+          }
+
+        Task_status const status = task.step (task.data);
+        u64 const end_ns = get_time_ns ();
+
+        // One slow step shouldn't keep it waiting forever
+        task.step_ns = hyper::max (end_ns - now_ns, task.step_ns - (task.step_ns >> 4));
+        now_ns = end_ns;
+        ++steps;
+
+        switch (status)
+          {
+          case Task_status::more:
+            skipped = 0;
+            ++scheduler.next;
+            break;
+          case Task_status::idle:
+            task.idle = true;
+            ++skipped;
+            ++scheduler.next;
+            break;
+          case Task_status::done:
+            // The last one takes its place and gets the next turn
+            task = scheduler.tasks[--scheduler.task_count];
+            skipped = 0;
+            ++finished;
+            break;
+          }
+      }
+
+    scheduler.run_ns = now_ns - start_ns;
+    scheduler.steps = steps;
+    scheduler.finished = finished;
+  }
+};
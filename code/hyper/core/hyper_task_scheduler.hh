@@ -0,0 +1,69 @@
+//
+// Time sliced tasks. Work that would stall a frame if it ran in one
+// go is split into steps, each one a small bounded piece of it, and
+// the scheduler runs steps round robin in whatever time the frame has
+// left before a deadline. A task keeps its progress in its data, so
+// it just picks up where it stopped the next time it gets a turn.
+//
+// Steps don't run if their longest recent step wouldn't fit before
+// the deadline, so it's only late by as much as a step got slower.
+// Everything runs on the calling thread.
+//
+// The scheduler belongs to the engine. Step functions from the game
+// library are gone after a hot reload, so the platform starts the
+// scheduler over and has the new library add its tasks again, their
+// progress is in data the platform owns.
+//
+#pragma once
+
+#include "hyper_common.hh"
+
+#include <array>
+
+namespace hyper
+{
+  inline constexpr u32 scheduler_max_tasks = 32;
+
+  enum class Task_status
+    {
+      // There's more, give it another step when there's time
+      more,
+      // Nothing to do right now, ask again next run
+      idle,
+      // Finished, it's removed
+      done,
+    };
+
+  using Task_step_function = Task_status (*) (void *);
+
+  struct Task
+  {
+    Task_step_function step;
+    void *data;
+    // Decaying maximum of its steps
+    u64 step_ns;
+    // Said it was idle this run
+    bool idle;
+  };
+
+  struct Task_scheduler
+  {
+    std::array<Task, scheduler_max_tasks> tasks;
+    u32 task_count;
+    // Where the next run starts, so every task gets its turn
+    u32 next;
+    // The last run
+    u64 run_ns;
+    u32 steps;
+    u32 finished;
+  };
+
+  void task_scheduler_init (Task_scheduler &);
+
+  // False if it's full
+  bool task_scheduler_add (Task_scheduler &, Task_step_function, void *);
+
+  // Runs steps until the deadline, get_time_ns time, or until every
+  // task is idle
+  void task_scheduler_run (Task_scheduler &, u64);
+};
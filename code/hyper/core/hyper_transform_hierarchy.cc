@@ -0,0 +1,107 @@
+#include "hyper_transform_hierarchy.hh"
+
+#include <cstring>
+
+namespace hyper
+{
+  static inline Transform
+  get_transform (Vec2<f32> position, f32 rotation)
+  {
+    return { position, rotation, std::cos (rotation), std::sin (rotation) };
+  }
+
+  static inline Vec2<f32>
+  transform_point (Transform const &transform, Vec2<f32> point)
+  {
+    return { transform.position.x + point.x * transform.cos - point.y * transform.sin,
+             transform.position.y + point.x * transform.sin + point.y * transform.cos };
+  }
+
+  // Where a child ends up once its parent is placed, the angle sum
+  // identities save taking the cosine and sine again
+  static inline Transform
+  combine_transforms (Transform const &parent, Transform const &child)
+  {
+    return { transform_point (parent, child.position),
+             parent.rotation + child.rotation,
+             parent.cos * child.cos - parent.sin * child.sin,
+             parent.sin * child.cos + parent.cos * child.sin };
+  }
+
+  void
+  transform_hierarchy_init (Transform_hierarchy &hierarchy)
+  {
+    hierarchy.node_count = 0;
+    hierarchy.vertex_count = 0;
+    hierarchy.updated_count = 0;
+  }
+
+  u32
+  transform_add_node (Transform_hierarchy &hierarchy, u32 parent, Vec2<f32> position, f32 rotation, Vec2<f32> const *vertices, u32 vertex_count)
+  {
+    if (hierarchy.node_count == transform_max_nodes
+        || transform_max_vertices - hierarchy.vertex_count < vertex_count
+        || (parent != transform_no_parent && parent >= hierarchy.node_count))
+      return transform_max_nodes;
+
+    u32 const node = hierarchy.node_count++;
+
+    hierarchy.parents[node] = parent;
+    hierarchy.local[node] = get_transform (position, rotation);
+    hierarchy.vertex_starts[node] = hierarchy.vertex_count;
+    hierarchy.vertex_counts[node] = vertex_count;
+    hierarchy.dirty[node] = true;
+
+    if (vertex_count)
+      std::memcpy (&hierarchy.local_vertices[hierarchy.vertex_count], vertices, vertex_count * sizeof (Vec2<f32>));
+
+    hierarchy.vertex_count += vertex_count;
+
+    return node;
+  }
+
+  void
+  transform_set_local (Transform_hierarchy &hierarchy, u32 node, Vec2<f32> position, f32 rotation)
+  {
+    Transform const &local = hierarchy.local[node];
+    if (local.position.x == position.x && local.position.y == position.y && local.rotation == rotation)
+      return;
+
+    hierarchy.local[node] = get_transform (position, rotation);
+    hierarchy.dirty[node] = true;
+  }
+
+  void
+  transform_hierarchy_update (Transform_hierarchy &hierarchy)
+  {
+    u32 updated_count = 0;
+
+    // Parents are done before their children get here, a dirty parent
+    // passes it on
+    for (u32 node = 0; node < hierarchy.node_count; ++node)
+      {
+        u32 const parent = hierarchy.parents[node];
+        bool const has_parent = parent != transform_no_parent;
+
+        if (has_parent && hierarchy.dirty[parent])
+          hierarchy.dirty[node] = true;
+
+        if (!hierarchy.dirty[node])
+          continue;
+
+        Transform const world = has_parent ? combine_transforms (hierarchy.world[parent], hierarchy.local[node]) : hierarchy.local[node];
+        hierarchy.world[node] = world;
+
+        u32 const start = hierarchy.vertex_starts[node];
+        u32 const end = start + hierarchy.vertex_counts[node];
+        for (u32 i = start; i < end; ++i)
+          hierarchy.world_vertices[i] = transform_point (world, hierarchy.local_vertices[i]);
+
+        ++updated_count;
+      }
+
+    // Children had to see their parent's flag first
+    std::memset (hierarchy.dirty.data (), 0, hierarchy.node_count * sizeof (bool));
+    hierarchy.updated_count = updated_count;
+  }
+};
@@ -0,0 +1,68 @@
+//
+// Transform hierarchy. Nodes have a transform relative to their parent
+// and optionally some vertices, the world transforms and world space
+// vertices are cached and only recomputed for the nodes that moved and
+// everything under them. Flat arrays with parents always before their
+// children, so the update is one pass in order.
+//
+#pragma once
+
+#include "hyper_common.hh"
+#include "hyper_math.hh"
+
+#include <array>
+
+namespace hyper
+{
+  inline constexpr u32 transform_max_nodes = 8192;
+  inline constexpr u32 transform_max_vertices = 65536;
+  inline constexpr u32 transform_no_parent = ~0u;
+
+  // Rotation first, then the translation. The cosine and sine are kept
+  // so they're only taken when the rotation changes.
+  struct Transform
+  {
+    Vec2<f32> position;
+    f32 rotation;
+    f32 cos;
+    f32 sin;
+  };
+
+  struct Transform_hierarchy
+  {
+    std::array<u32, transform_max_nodes> parents;
+    std::array<Transform, transform_max_nodes> local;
+    std::array<Transform, transform_max_nodes> world;
+    // Each node's range in the vertex arrays
+    std::array<u32, transform_max_nodes> vertex_starts;
+    std::array<u32, transform_max_nodes> vertex_counts;
+    // Moved since the last update
+    std::array<bool, transform_max_nodes> dirty;
+    std::array<Vec2<f32>, transform_max_vertices> local_vertices;
+    std::array<Vec2<f32>, transform_max_vertices> world_vertices;
+    u32 node_count;
+    u32 vertex_count;
+    // Nodes the last update recomputed
+    u32 updated_count;
+  };
+
+  void transform_hierarchy_init (Transform_hierarchy &);
+
+  // The parent has to be added first, that's what keeps them sorted.
+  // Vertices are copied in, relative to the node. Returns the new node,
+  // transform_max_nodes if there's no room.
+  u32 transform_add_node (Transform_hierarchy &, u32, Vec2<f32>, f32, Vec2<f32> const *, u32);
+
+  // Only marks the node dirty if it actually moved
+  void transform_set_local (Transform_hierarchy &, u32, Vec2<f32>, f32);
+
+  // World transforms and vertices of the dirty nodes and their
+  // descendants, everything is clean afterwards
+  void transform_hierarchy_update (Transform_hierarchy &);
+
+  inline Vec2<f32> const *
+  transform_get_world_vertices (Transform_hierarchy const &hierarchy, u32 node)
+  {
+    return &hierarchy.world_vertices[hierarchy.vertex_starts[node]];
+  }
+};
@@ -0,0 +1,119 @@
+#include "hyper_virtual_memory.hh"
+
+#include <sys/mman.h>
+#include <stdint.h>
+
+namespace hyper
+{
+  static constexpr size_t huge_page_size = 2 * 1024 * 1024;
+
+  static inline size_t
+  align_up (size_t size, size_t alignment)
+  {
+    return (size + alignment - 1) & ~(alignment - 1);
+  }
+
+  static bool
+  reserve_huge (Arena_backing &backing, size_t size, i32 populate_flag)
+  {
+    // Only works if the admin set some aside, vm.nr_hugepages
+    void *mapping = mmap (nullptr, size, PROT_READ | PROT_WRITE,
+                          MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | populate_flag, -1, 0);
+    if (mapping == MAP_FAILED)
+      return false;
+
+    backing.data = static_cast<std::byte *> (mapping);
+    backing.mapping = mapping;
+    backing.mapping_size = size;
+    backing.pages = Page_kind::huge;
+
+    return true;
+  }
+
+  static bool
+  reserve_transparent_huge (Arena_backing &backing, size_t size, i32 populate_flag)
+  {
+    // One huge page extra so the start can be aligned to one, THP only
+    // covers aligned 2MB ranges
+    size_t const mapping_size = size + huge_page_size;
+
+    // Populating has to wait until the madvise, or it'd fault in 4K
+    // pages
+    void *mapping = mmap (nullptr, mapping_size, PROT_READ | PROT_WRITE,
+                          MAP_PRIVATE | MAP_ANONYMOUS | (populate_flag ? 0 : MAP_NORESERVE), -1, 0);
+    if (mapping == MAP_FAILED)
+      return false;
+
+    auto const start = align_up ((uintptr_t) mapping, huge_page_size);
+
+    backing.data = reinterpret_cast<std::byte *> (start);
+    backing.mapping = mapping;
+    backing.mapping_size = mapping_size;
+    backing.pages = Page_kind::normal;
+
+    if (madvise (backing.data, size, MADV_HUGEPAGE) == 0)
+      backing.pages = Page_kind::transparent_huge;
+
+    if (populate_flag)
+      {
+        // Touch a byte in every page, the kernel fills in the rest
+        size_t const stride = backing.pages == Page_kind::transparent_huge ? huge_page_size : 4096;
+        for (size_t offset = 0; offset < size; offset += stride)
+          backing.data[offset] = std::byte {0};
+      }
+
+    return true;
+  }
+
+  bool
+  arena_backing_reserve (Arena_backing &backing, size_t size, bool populate)
+  {
+    i32 const populate_flag = populate ? MAP_POPULATE : 0;
+
+    size = arena_backing_get_size (size);
+    backing.size = size;
+
+    if (reserve_huge (backing, size, populate_flag) || reserve_transparent_huge (backing, size, populate_flag))
+      return true;
+
+    backing.data = nullptr;
+    backing.size = 0;
+    backing.mapping = nullptr;
+    backing.mapping_size = 0;
+
+    return false;
+  }
+
+  size_t
+  arena_backing_get_size (size_t size)
+  {
+    return align_up (size, huge_page_size);
+  }
+
+  void
+  arena_backing_release (Arena_backing &backing)
+  {
+    if (backing.mapping)
+      munmap (backing.mapping, backing.mapping_size);
+
+    backing.data = nullptr;
+    backing.size = 0;
+    backing.mapping = nullptr;
+    backing.mapping_size = 0;
+  }
+
+  char const *
+  get_page_kind_name (Page_kind pages)
+  {
+    switch (pages)
+      {
+      case Page_kind::huge:
+        return "huge pages";
+      case Page_kind::transparent_huge:
+        return "transparent huge pages";
+      case Page_kind::normal:
+      default:
+        return "4K pages";
+      }
+  }
+};
@@ -0,0 +1,45 @@
+//
+// Backing memory for the arenas straight from the kernel. Huge pages
+// when the system has them, so a 128MB arena is 64 TLB entries instead
+// of 32768, and optionally faulted in up front so the first frames
+// don't pay for it.
+//
+#pragma once
+
+#include "hyper_common.hh"
+
+#include <cstddef>
+
+namespace hyper
+{
+  enum class Page_kind : u8
+    {
+      // 4K pages
+      normal,
+      // Transparent huge pages, the kernel promotes them when it can
+      transparent_huge,
+      // Reserved huge pages, MAP_HUGETLB
+      huge,
+    };
+
+  struct Arena_backing
+  {
+    std::byte *data;
+    // What the arena can use, the mapping can be bigger
+    size_t size;
+    void *mapping;
+    size_t mapping_size;
+    Page_kind pages;
+  };
+
+  // Without populate pages are committed the first time they're
+  // touched. Returns false if there's no address space left.
+  bool arena_backing_reserve (Arena_backing &, size_t, bool);
+
+  // What arena_backing_reserve rounds a size up to
+  size_t arena_backing_get_size (size_t);
+
+  void arena_backing_release (Arena_backing &);
+
+  char const *get_page_kind_name (Page_kind);
+};
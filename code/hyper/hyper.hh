@@ -3,13 +3,23 @@
 #include "hyper_common.hh"
 #include "hyper_math.hh"
 #include "hyper_stack_arena.hh"
+#include "hyper_jobs.hh"
+#include "hyper_input.hh"
+#include "hyper_colour.hh"
+#include <array>
 #include <vector>
 
 #define HYPER_UPDATE_FUNCTION_NAME "game_update"
 #define HYPER_RENDER_FUNCTION_NAME "game_render"
+#define HYPER_ADD_TASKS_FUNCTION_NAME "game_add_tasks"
 
 namespace hyper
 {
+  struct Font;
+  struct Perf_counters;
+  struct Render_stats;
+  struct Transform_hierarchy;
+
   enum class Shape
     {
       triangle,
@@ -18,19 +28,62 @@ namespace hyper
       circle
     };
 
+  // How pixels are packed in the framebuffer. Tiles keep pixels above
+  // and below each other close, a tall shape touches a new cache line
+  // every 8 rows instead of every row, but the frame has to be detiled
+  // on its way to the texture.
+  enum class Framebuffer_layout : u8
+    {
+      // Row after row
+      linear,
+      // 8x8 tiles row after row, a tile is its 8 rows one after the
+      // other, 256 bytes
+      tiled,
+    };
+
+  inline constexpr i32 framebuffer_tile_size = 8;
+
   struct Framebuffer
   {
     std::pmr::vector<u32> pixels;
+    // Matches the texture the platform uploads to, so the upload is a
+    // plain copy. Set it with framebuffer_set_format.
+    Pixel_format format;
+    std::array<u32, Colour_preset::COUNT> preset_colours;
     size_t simd_chunks;
+    // Size being rendered at, rows are packed at this width inside the
+    // allocation. Set it with framebuffer_set_render_scale.
     i32 width;
     i32 height;
+    // Of the rows the platform uploads, whatever the layout
     i32 pitch;
+    // Set it with framebuffer_set_layout, tiled frames need whole
+    // tiles allocated
+    Framebuffer_layout layout;
+    // Size of the allocation
+    i32 max_width;
+    i32 max_height;
+    // Optional, when set the kernels count everything written here
+    Render_stats *stats;
   };
 
   struct Renderer_context
   {
     Stack_arena *stack_arena;
     Framebuffer *framebuffer;
+    // Optional, when set big fills get split across workers
+    Job_system *jobs;
+    // Optional, needed for draw_text
+    Font const *font;
+    // Optional, when set the draw functions count what they cost
+    Perf_counters *perf_counters;
+    // Calls to the draw functions, the platform resets it every frame
+    u32 draw_calls;
+    // Applies to every draw until it's changed, opaque by default
+    Blend_mode blend_mode;
+    // Smooth edges on everything but shaded triangles and text, off by
+    // default and applies until it's changed like the blend mode
+    bool anti_aliasing;
     f32 camera_x;
     f32 camera_y;
     f32 camera_zoom;
@@ -40,6 +93,17 @@ namespace hyper
   struct Frame_context
   {
     Renderer_context *renderer_context;
+    Job_system *jobs;
+    // Owned by the platform so the cached world vertices last between
+    // frames and through hot reloads
+    Transform_hierarchy *transforms;
+    // Owned by the platform too, whatever the game caches between frames
+    // that isn't simulation state, so snapshots don't roll it back
+    void *game_cache;
+    // Input for the tick being simulated, only valid in game_update
+    Tick_input const *input;
+    u64 tick;
+    // Nanoseconds, see get_time_ns
     u64 last_frame_time;
     f32 fixed_timestep;
     f32 physics_accumulator;
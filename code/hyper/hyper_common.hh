@@ -10,6 +10,7 @@ using i32 = std::int32_t;
 using i64 = std::int64_t;
 using u32 = std::uint32_t;
 using u64 = std::uint64_t;
+using u16 = std::uint16_t;
 using u8  = std::uint8_t;
 
 namespace hyper
@@ -46,4 +47,11 @@ namespace hyper
   {
     return std::floor (a);
   }
+
+  template <typename T>
+  inline constexpr T
+  ceil (T a)
+  {
+    return std::ceil (a);
+  }
 };
@@ -0,0 +1,261 @@
+#include "hyper_collision.hh"
+
+#include <immintrin.h>
+#include <cfloat>
+
+namespace hyper
+{
+  static inline u32
+  get_simd_width ()
+  {
+    return 8;
+  }
+
+  // Writes the byte for candidates i..i+7 and counts them, lanes past
+  // the end are padding
+  static inline u32
+  store_hits (__m256 hit, u32 i, u32 count, u8 *hits)
+  {
+    u32 mask = (u32) _mm256_movemask_ps (hit);
+
+    if (count - i < get_simd_width ())
+      mask &= (1u << (count - i)) - 1;
+
+    hits[i / get_simd_width ()] = (u8) mask;
+
+    return (u32) _mm_popcnt_u32 (mask);
+  }
+
+  // 1 / x, or 0 when x is 0 so degenerate edges turn into points
+  static inline __m256
+  get_safe_reciprocal (__m256 x)
+  {
+    __m256 const non_zero = _mm256_cmp_ps (x, _mm256_setzero_ps (), _CMP_GT_OQ);
+    return _mm256_and_ps (non_zero, _mm256_div_ps (_mm256_set1_ps (1.0f), x));
+  }
+
+  // Squared distance from p to the segment that starts at a and goes
+  // along d
+  static inline __m256
+  get_segment_distance_squared (__m256 px, __m256 py, __m256 ax, __m256 ay, __m256 dx, __m256 dy, __m256 inverse_length_squared)
+  {
+    __m256 const to_point_x = _mm256_sub_ps (px, ax);
+    __m256 const to_point_y = _mm256_sub_ps (py, ay);
+
+    // Closest point's position along the segment, clamped to its ends
+    __m256 t = _mm256_mul_ps (_mm256_fmadd_ps (to_point_x, dx, _mm256_mul_ps (to_point_y, dy)), inverse_length_squared);
+    t = _mm256_min_ps (_mm256_max_ps (t, _mm256_setzero_ps ()), _mm256_set1_ps (1.0f));
+
+    __m256 const offset_x = _mm256_fnmadd_ps (t, dx, to_point_x);
+    __m256 const offset_y = _mm256_fnmadd_ps (t, dy, to_point_y);
+
+    return _mm256_fmadd_ps (offset_x, offset_x, _mm256_mul_ps (offset_y, offset_y));
+  }
+
+  // Which side of the edge a->b the point is on
+  static inline __m256
+  get_edge_side (__m256 ax, __m256 ay, __m256 bx, __m256 by, __m256 px, __m256 py)
+  {
+    return _mm256_fmsub_ps (_mm256_sub_ps (bx, ax), _mm256_sub_ps (py, ay),
+                            _mm256_mul_ps (_mm256_sub_ps (by, ay), _mm256_sub_ps (px, ax)));
+  }
+
+  struct Simd_triangle
+  {
+    __m256 x[3];
+    __m256 y[3];
+  };
+
+  // true where the projections of both triangles on the axis don't
+  // overlap
+  static inline __m256
+  is_separating_axis (Simd_triangle const &a, Simd_triangle const &b, __m256 nx, __m256 ny)
+  {
+    __m256 a_min = _mm256_fmadd_ps (a.x[0], nx, _mm256_mul_ps (a.y[0], ny));
+    __m256 a_max = a_min;
+    __m256 b_min = _mm256_fmadd_ps (b.x[0], nx, _mm256_mul_ps (b.y[0], ny));
+    __m256 b_max = b_min;
+
+    for (u32 i = 1; i < 3; ++i)
+      {
+        __m256 const a_projection = _mm256_fmadd_ps (a.x[i], nx, _mm256_mul_ps (a.y[i], ny));
+        __m256 const b_projection = _mm256_fmadd_ps (b.x[i], nx, _mm256_mul_ps (b.y[i], ny));
+        a_min = _mm256_min_ps (a_min, a_projection);
+        a_max = _mm256_max_ps (a_max, a_projection);
+        b_min = _mm256_min_ps (b_min, b_projection);
+        b_max = _mm256_max_ps (b_max, b_projection);
+      }
+
+    return _mm256_or_ps (_mm256_cmp_ps (a_max, b_min, _CMP_LT_OQ), _mm256_cmp_ps (b_max, a_min, _CMP_LT_OQ));
+  }
+
+  // Tries the normal of every edge of edges as the axis
+  static inline __m256
+  has_separating_edge (Simd_triangle const &edges, Simd_triangle const &other)
+  {
+    __m256 separated = _mm256_setzero_ps ();
+
+    for (u32 i = 0; i < 3; ++i)
+      {
+        u32 const next = (i + 1) % 3;
+        __m256 const nx = _mm256_sub_ps (edges.y[i], edges.y[next]);
+        __m256 const ny = _mm256_sub_ps (edges.x[next], edges.x[i]);
+        separated = _mm256_or_ps (separated, is_separating_axis (edges, other, nx, ny));
+      }
+
+    return separated;
+  }
+
+  u32
+  collide_circle_circles (Circle const &circle, Circle_candidates const &candidates, u8 *hits)
+  {
+    __m256 const center_x = _mm256_set1_ps (circle.center.x);
+    __m256 const center_y = _mm256_set1_ps (circle.center.y);
+    __m256 const radius = _mm256_set1_ps (circle.radius);
+    u32 hit_count = 0;
+
+    for (u32 i = 0; i < candidates.count; i += get_simd_width ())
+      {
+        __m256 const dx = _mm256_sub_ps (_mm256_load_ps (&candidates.center_x[i]), center_x);
+        __m256 const dy = _mm256_sub_ps (_mm256_load_ps (&candidates.center_y[i]), center_y);
+        __m256 const radii = _mm256_add_ps (_mm256_load_ps (&candidates.radius[i]), radius);
+
+        // No square roots, compare squared distances
+        __m256 const distance_squared = _mm256_fmadd_ps (dx, dx, _mm256_mul_ps (dy, dy));
+        __m256 const hit = _mm256_cmp_ps (distance_squared, _mm256_mul_ps (radii, radii), _CMP_LE_OQ);
+
+        hit_count += store_hits (hit, i, candidates.count, hits);
+      }
+
+    return hit_count;
+  }
+
+  u32
+  collide_circle_triangles (Circle const &circle, Triangle_candidates const &candidates, u8 *hits)
+  {
+    __m256 const center_x = _mm256_set1_ps (circle.center.x);
+    __m256 const center_y = _mm256_set1_ps (circle.center.y);
+    __m256 const radius_squared = _mm256_set1_ps (circle.radius * circle.radius);
+    __m256 const zero = _mm256_setzero_ps ();
+    u32 hit_count = 0;
+
+    for (u32 i = 0; i < candidates.count; i += get_simd_width ())
+      {
+        __m256 const x[3] = { _mm256_load_ps (&candidates.x0[i]), _mm256_load_ps (&candidates.x1[i]), _mm256_load_ps (&candidates.x2[i]) };
+        __m256 const y[3] = { _mm256_load_ps (&candidates.y0[i]), _mm256_load_ps (&candidates.y1[i]), _mm256_load_ps (&candidates.y2[i]) };
+
+        // Center inside, all edges have it on the same side
+        __m256 all_positive = _mm256_castsi256_ps (_mm256_set1_epi32 (-1));
+        __m256 all_negative = all_positive;
+        __m256 distance_squared = _mm256_set1_ps (FLT_MAX);
+
+        for (u32 edge = 0; edge < 3; ++edge)
+          {
+            u32 const next = (edge + 1) % 3;
+            __m256 const side = get_edge_side (x[edge], y[edge], x[next], y[next], center_x, center_y);
+            all_positive = _mm256_and_ps (all_positive, _mm256_cmp_ps (side, zero, _CMP_GE_OQ));
+            all_negative = _mm256_and_ps (all_negative, _mm256_cmp_ps (side, zero, _CMP_LE_OQ));
+
+            // Or close enough to an edge
+            __m256 const dx = _mm256_sub_ps (x[next], x[edge]);
+            __m256 const dy = _mm256_sub_ps (y[next], y[edge]);
+            __m256 const inverse_length_squared = get_safe_reciprocal (_mm256_fmadd_ps (dx, dx, _mm256_mul_ps (dy, dy)));
+            distance_squared = _mm256_min_ps (distance_squared,
+                                              get_segment_distance_squared (center_x, center_y, x[edge], y[edge], dx, dy, inverse_length_squared));
+          }
+
+        __m256 const hit = _mm256_or_ps (_mm256_or_ps (all_positive, all_negative),
+                                         _mm256_cmp_ps (distance_squared, radius_squared, _CMP_LE_OQ));
+
+        hit_count += store_hits (hit, i, candidates.count, hits);
+      }
+
+    return hit_count;
+  }
+
+  u32
+  collide_triangle_triangles (Triangle const &triangle, Triangle_candidates const &candidates, u8 *hits)
+  {
+    Simd_triangle query;
+    for (u32 i = 0; i < 3; ++i)
+      {
+        query.x[i] = _mm256_set1_ps (triangle.vertices[i].x);
+        query.y[i] = _mm256_set1_ps (triangle.vertices[i].y);
+      }
+
+    u32 hit_count = 0;
+
+    for (u32 i = 0; i < candidates.count; i += get_simd_width ())
+      {
+        Simd_triangle const candidate = {
+          { _mm256_load_ps (&candidates.x0[i]), _mm256_load_ps (&candidates.x1[i]), _mm256_load_ps (&candidates.x2[i]) },
+          { _mm256_load_ps (&candidates.y0[i]), _mm256_load_ps (&candidates.y1[i]), _mm256_load_ps (&candidates.y2[i]) },
+        };
+
+        // Two triangles only need the normals of their 6 edges
+        __m256 const separated = _mm256_or_ps (has_separating_edge (query, candidate), has_separating_edge (candidate, query));
+        __m256 const hit = _mm256_andnot_ps (separated, _mm256_castsi256_ps (_mm256_set1_epi32 (-1)));
+
+        hit_count += store_hits (hit, i, candidates.count, hits);
+      }
+
+    return hit_count;
+  }
+
+  u32
+  collide_segment_circles (Line const &segment, Circle_candidates const &candidates, u8 *hits)
+  {
+    f32 const dx = segment.end.x - segment.start.x;
+    f32 const dy = segment.end.y - segment.start.y;
+    f32 const length_squared = dx * dx + dy * dy;
+
+    __m256 const start_x = _mm256_set1_ps (segment.start.x);
+    __m256 const start_y = _mm256_set1_ps (segment.start.y);
+    __m256 const direction_x = _mm256_set1_ps (dx);
+    __m256 const direction_y = _mm256_set1_ps (dy);
+    __m256 const inverse_length_squared = _mm256_set1_ps (length_squared > 0.0f ? 1.0f / length_squared : 0.0f);
+    u32 hit_count = 0;
+
+    for (u32 i = 0; i < candidates.count; i += get_simd_width ())
+      {
+        __m256 const radius = _mm256_load_ps (&candidates.radius[i]);
+        __m256 const distance_squared = get_segment_distance_squared (_mm256_load_ps (&candidates.center_x[i]),
+                                                                      _mm256_load_ps (&candidates.center_y[i]),
+                                                                      start_x, start_y, direction_x, direction_y,
+                                                                      inverse_length_squared);
+        __m256 const hit = _mm256_cmp_ps (distance_squared, _mm256_mul_ps (radius, radius), _CMP_LE_OQ);
+
+        hit_count += store_hits (hit, i, candidates.count, hits);
+      }
+
+    return hit_count;
+  }
+
+  u32
+  collide_quad_quads (Quad const &quad, Quad_candidates const &candidates, u8 *hits)
+  {
+    __m256 const left = _mm256_set1_ps (quad.position.x);
+    __m256 const bottom = _mm256_set1_ps (quad.position.y);
+    __m256 const right = _mm256_set1_ps (quad.position.x + quad.width);
+    __m256 const top = _mm256_set1_ps (quad.position.y + quad.height);
+    u32 hit_count = 0;
+
+    for (u32 i = 0; i < candidates.count; i += get_simd_width ())
+      {
+        __m256 const candidate_left = _mm256_load_ps (&candidates.x[i]);
+        __m256 const candidate_bottom = _mm256_load_ps (&candidates.y[i]);
+        __m256 const candidate_right = _mm256_add_ps (candidate_left, _mm256_load_ps (&candidates.width[i]));
+        __m256 const candidate_top = _mm256_add_ps (candidate_bottom, _mm256_load_ps (&candidates.height[i]));
+
+        // Overlap on both axes
+        __m256 const overlap_x = _mm256_and_ps (_mm256_cmp_ps (left, candidate_right, _CMP_LE_OQ),
+                                                _mm256_cmp_ps (candidate_left, right, _CMP_LE_OQ));
+        __m256 const overlap_y = _mm256_and_ps (_mm256_cmp_ps (bottom, candidate_top, _CMP_LE_OQ),
+                                                _mm256_cmp_ps (candidate_bottom, top, _CMP_LE_OQ));
+
+        hit_count += store_hits (_mm256_and_ps (overlap_x, overlap_y), i, candidates.count, hits);
+      }
+
+    return hit_count;
+  }
+};
@@ -0,0 +1,67 @@
+//
+// Narrowphase collision. One shape is tested against a batch of
+// candidates from the broadphase, the candidates are structure of
+// arrays so every test covers 8 of them per AVX2 instruction. Results
+// are a bit per candidate. Touching counts as a hit.
+//
+#pragma once
+
+#include "hyper_common.hh"
+#include "hyper_geometry.hh"
+
+namespace hyper
+{
+  // The arrays are 32 byte aligned with room for count rounded up to a
+  // multiple of 8, the kernels read the padding but ignore what it gives
+  struct Circle_candidates
+  {
+    f32 const *center_x;
+    f32 const *center_y;
+    f32 const *radius;
+    u32 count;
+  };
+
+  struct Triangle_candidates
+  {
+    f32 const *x0;
+    f32 const *y0;
+    f32 const *x1;
+    f32 const *y1;
+    f32 const *x2;
+    f32 const *y2;
+    u32 count;
+  };
+
+  // Same layout as Quad, x and y are the bottom left corner
+  struct Quad_candidates
+  {
+    f32 const *x;
+    f32 const *y;
+    f32 const *width;
+    f32 const *height;
+    u32 count;
+  };
+
+  // Bytes needed for the hits of count candidates
+  inline constexpr u32
+  get_collision_hits_size (u32 count)
+  {
+    return (count + 7) / 8;
+  }
+
+  // Each one writes get_collision_hits_size (count) bytes to hits, bit i
+  // set if candidate i collides, and returns how many did
+
+  u32 collide_circle_circles (Circle const &, Circle_candidates const &, u8 *);
+
+  u32 collide_circle_triangles (Circle const &, Triangle_candidates const &, u8 *);
+
+  // Separating axis test, either winding works
+  u32 collide_triangle_triangles (Triangle const &, Triangle_candidates const &, u8 *);
+
+  // For lasers, a zero length segment is a point
+  u32 collide_segment_circles (Line const &, Circle_candidates const &, u8 *);
+
+  // Axis aligned boxes
+  u32 collide_quad_quads (Quad const &, Quad_candidates const &, u8 *);
+};
@@ -0,0 +1,127 @@
+#include "hyper_physics.hh"
+
+#include <immintrin.h>
+#include <cstring>
+
+namespace hyper
+{
+  static inline u32
+  get_simd_width ()
+  {
+    return 8;
+  }
+
+  static inline u32
+  get_simd_body_count (u32 body_count)
+  {
+    // Unused lanes are zeroed, integrating them is harmless
+    return (body_count + get_simd_width () - 1) & ~(get_simd_width () - 1);
+  }
+
+  void
+  physics_init (Physics_world &world)
+  {
+    std::memset (&world, 0, sizeof (world));
+  }
+
+  u32
+  physics_add_body (Physics_world &world, Vec2<f32> position, f32 rotation)
+  {
+    if (world.body_count == physics_max_bodies)
+      return physics_max_bodies;
+
+    u32 const index = world.body_count++;
+
+    world.current.position_x[index] = position.x;
+    world.current.position_y[index] = position.y;
+    world.current.velocity_x[index] = 0.0f;
+    world.current.velocity_y[index] = 0.0f;
+    world.current.rotation[index] = rotation;
+    world.current.angular_velocity[index] = 0.0f;
+    world.acceleration_x[index] = 0.0f;
+    world.acceleration_y[index] = 0.0f;
+
+    // Nothing to interpolate from yet
+    world.previous.position_x[index] = position.x;
+    world.previous.position_y[index] = position.y;
+    world.previous.velocity_x[index] = 0.0f;
+    world.previous.velocity_y[index] = 0.0f;
+    world.previous.rotation[index] = rotation;
+    world.previous.angular_velocity[index] = 0.0f;
+
+    return index;
+  }
+
+  void
+  physics_set_velocity (Physics_world &world, u32 index, Vec2<f32> velocity, f32 angular_velocity)
+  {
+    world.current.velocity_x[index] = velocity.x;
+    world.current.velocity_y[index] = velocity.y;
+    world.current.angular_velocity[index] = angular_velocity;
+  }
+
+  void
+  physics_integrate (Physics_world &world, f32 dt)
+  {
+    __m256 const dt_simd = _mm256_set1_ps (dt);
+    u32 const count = get_simd_body_count (world.body_count);
+
+    for (u32 i = 0; i < count; i += get_simd_width ())
+      {
+        __m256 position_x = _mm256_load_ps (&world.current.position_x[i]);
+        __m256 position_y = _mm256_load_ps (&world.current.position_y[i]);
+        __m256 velocity_x = _mm256_load_ps (&world.current.velocity_x[i]);
+        __m256 velocity_y = _mm256_load_ps (&world.current.velocity_y[i]);
+        __m256 rotation = _mm256_load_ps (&world.current.rotation[i]);
+        __m256 const angular_velocity = _mm256_load_ps (&world.current.angular_velocity[i]);
+        __m256 const acceleration_x = _mm256_load_ps (&world.acceleration_x[i]);
+        __m256 const acceleration_y = _mm256_load_ps (&world.acceleration_y[i]);
+
+        // current becomes previous
+        _mm256_store_ps (&world.previous.position_x[i], position_x);
+        _mm256_store_ps (&world.previous.position_y[i], position_y);
+        _mm256_store_ps (&world.previous.velocity_x[i], velocity_x);
+        _mm256_store_ps (&world.previous.velocity_y[i], velocity_y);
+        _mm256_store_ps (&world.previous.rotation[i], rotation);
+        _mm256_store_ps (&world.previous.angular_velocity[i], angular_velocity);
+
+        // semi-implicit Euler: update velocity first, then position
+        // with the new velocity, it's stable enough for what I need
+        velocity_x = _mm256_add_ps (velocity_x, _mm256_mul_ps (acceleration_x, dt_simd));
+        velocity_y = _mm256_add_ps (velocity_y, _mm256_mul_ps (acceleration_y, dt_simd));
+        position_x = _mm256_add_ps (position_x, _mm256_mul_ps (velocity_x, dt_simd));
+        position_y = _mm256_add_ps (position_y, _mm256_mul_ps (velocity_y, dt_simd));
+        rotation = _mm256_add_ps (rotation, _mm256_mul_ps (angular_velocity, dt_simd));
+
+        _mm256_store_ps (&world.current.position_x[i], position_x);
+        _mm256_store_ps (&world.current.position_y[i], position_y);
+        _mm256_store_ps (&world.current.velocity_x[i], velocity_x);
+        _mm256_store_ps (&world.current.velocity_y[i], velocity_y);
+        _mm256_store_ps (&world.current.rotation[i], rotation);
+      }
+  }
+
+  void
+  physics_interpolate (Physics_world const &world, f32 alpha, Physics_render_state &render_state)
+  {
+    __m256 const alpha_simd = _mm256_set1_ps (alpha);
+    u32 const count = get_simd_body_count (world.body_count);
+
+    for (u32 i = 0; i < count; i += get_simd_width ())
+      {
+        // previous + (current - previous) * alpha
+        __m256 const previous_x = _mm256_load_ps (&world.previous.position_x[i]);
+        __m256 const previous_y = _mm256_load_ps (&world.previous.position_y[i]);
+        __m256 const previous_rotation = _mm256_load_ps (&world.previous.rotation[i]);
+        __m256 const delta_x = _mm256_sub_ps (_mm256_load_ps (&world.current.position_x[i]), previous_x);
+        __m256 const delta_y = _mm256_sub_ps (_mm256_load_ps (&world.current.position_y[i]), previous_y);
+        __m256 const delta_rotation = _mm256_sub_ps (_mm256_load_ps (&world.current.rotation[i]), previous_rotation);
+
+        _mm256_store_ps (&render_state.position_x[i], _mm256_add_ps (previous_x, _mm256_mul_ps (delta_x, alpha_simd)));
+        _mm256_store_ps (&render_state.position_y[i], _mm256_add_ps (previous_y, _mm256_mul_ps (delta_y, alpha_simd)));
+        _mm256_store_ps (&render_state.rotation[i], _mm256_add_ps (previous_rotation, _mm256_mul_ps (delta_rotation, alpha_simd)));
+      }
+
+    render_state.body_count = world.body_count;
+  }
+};
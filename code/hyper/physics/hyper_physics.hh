@@ -0,0 +1,59 @@
+//
+// Fixed timestep physics. Bodies are stored as structure of arrays so
+// the integrator can process 8 of them per AVX2 instruction. The
+// previous and current states are both kept around so rendering can
+// interpolate between them with the frame's alpha.
+//
+#pragma once
+
+#include "hyper_common.hh"
+#include "hyper_math.hh"
+
+#include <array>
+
+namespace hyper
+{
+  // Multiple of the SIMD width, the kernels don't handle leftovers
+  inline constexpr u32 physics_max_bodies = 1024;
+
+  struct Physics_state
+  {
+    alignas (32) std::array<f32, physics_max_bodies> position_x;
+    alignas (32) std::array<f32, physics_max_bodies> position_y;
+    alignas (32) std::array<f32, physics_max_bodies> velocity_x;
+    alignas (32) std::array<f32, physics_max_bodies> velocity_y;
+    alignas (32) std::array<f32, physics_max_bodies> rotation;
+    alignas (32) std::array<f32, physics_max_bodies> angular_velocity;
+  };
+
+  struct Physics_world
+  {
+    Physics_state previous;
+    Physics_state current;
+    // Set by game logic before each step, they're not cleared
+    alignas (32) std::array<f32, physics_max_bodies> acceleration_x;
+    alignas (32) std::array<f32, physics_max_bodies> acceleration_y;
+    u32 body_count;
+  };
+
+  // What the renderer sees: current state blended with the previous one
+  struct Physics_render_state
+  {
+    alignas (32) std::array<f32, physics_max_bodies> position_x;
+    alignas (32) std::array<f32, physics_max_bodies> position_y;
+    alignas (32) std::array<f32, physics_max_bodies> rotation;
+    u32 body_count;
+  };
+
+  void physics_init (Physics_world &);
+
+  // Returns the index of the new body, physics_max_bodies if full
+  u32 physics_add_body (Physics_world &, Vec2<f32>, f32);
+
+  void physics_set_velocity (Physics_world &, u32, Vec2<f32>, f32);
+
+  // Semi-implicit Euler, current becomes previous
+  void physics_integrate (Physics_world &, f32);
+
+  void physics_interpolate (Physics_world const &, f32, Physics_render_state &);
+};
@@ -0,0 +1,80 @@
+#include "hyper_dynamic_resolution.hh"
+#include "hyper_clock.hh"
+#include "hyper_math.hh"
+
+namespace hyper
+{
+  // Leave room for the game update, the upload and the present
+  static constexpr f32 render_budget_fraction = 0.75f;
+  // Only grow when there's plenty of room, otherwise it'd bounce
+  // between two sizes every few frames
+  static constexpr f32 grow_threshold = 0.6f;
+  static constexpr f32 grow_step = 0.05f;
+  // Shrink a bit past the budget so noise doesn't trigger it again
+  static constexpr f32 shrink_target = 0.9f;
+  static constexpr u32 cooldown_frames = 15;
+
+  void
+  dynamic_resolution_init (Dynamic_resolution &resolution, f32 min_scale)
+  {
+    resolution.budget_ns = 0;
+    resolution.average_ns = 0.0f;
+    resolution.scale = 1.0f;
+    resolution.min_scale = hyper::min (hyper::max (min_scale, 0.25f), 1.0f);
+    resolution.cooldown = 0;
+  }
+
+  void
+  dynamic_resolution_set_target_fps (Dynamic_resolution &resolution, f32 target_fps)
+  {
+    resolution.budget_ns = target_fps > 0.0f ? (u64) ((f64) nanoseconds_per_second * (f64) render_budget_fraction / (f64) target_fps) : 0;
+    resolution.average_ns = 0.0f;
+    resolution.cooldown = 0;
+
+    if (!resolution.budget_ns)
+      resolution.scale = 1.0f;
+  }
+
+  f32
+  dynamic_resolution_update (Dynamic_resolution &resolution, u64 render_ns)
+  {
+    if (!resolution.budget_ns)
+      return resolution.scale;
+
+    // Roughly the last 8 frames
+    if (resolution.average_ns == 0.0f)
+      resolution.average_ns = (f32) render_ns;
+    else
+      resolution.average_ns += ((f32) render_ns - resolution.average_ns) * 0.125f;
+
+    if (resolution.cooldown)
+      {
+        --resolution.cooldown;
+        return resolution.scale;
+      }
+
+    f32 const budget = (f32) resolution.budget_ns;
+    f32 new_scale = resolution.scale;
+
+    // Fill rate goes with the area, so the side goes with the root of
+    // the time. Shrinking jumps straight to the size that fits, growing
+    // creeps up.
+    if (resolution.average_ns > budget)
+      new_scale = resolution.scale * hyper::sqrt (budget * shrink_target / resolution.average_ns);
+    else if (resolution.average_ns < budget * grow_threshold)
+      new_scale = resolution.scale + grow_step;
+
+    new_scale = hyper::min (hyper::max (new_scale, resolution.min_scale), 1.0f);
+
+    if (new_scale != resolution.scale)
+      {
+        // The average was measured at the old size, scale it to the new
+        // one instead of waiting for it to catch up
+        resolution.average_ns *= (new_scale * new_scale) / (resolution.scale * resolution.scale);
+        resolution.scale = new_scale;
+        resolution.cooldown = cooldown_frames;
+      }
+
+    return resolution.scale;
+  }
+};
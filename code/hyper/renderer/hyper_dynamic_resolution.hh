@@ -0,0 +1,32 @@
+//
+// Dynamic resolution. Watches how long rendering takes and shrinks or
+// grows the framebuffer's render size to stay inside the frame budget,
+// the platform stretches whatever got rendered to the window.
+//
+#pragma once
+
+#include "hyper_common.hh"
+
+namespace hyper
+{
+  struct Dynamic_resolution
+  {
+    // 0 disables it, the scale stays at 1
+    u64 budget_ns;
+    // Smoothed render time, one spike shouldn't drop the resolution
+    f32 average_ns;
+    f32 scale;
+    f32 min_scale;
+    // Frames to wait after a change before judging the new size
+    u32 cooldown;
+  };
+
+  void dynamic_resolution_init (Dynamic_resolution &, f32);
+
+  // Budget is a fraction of the frame period, 0 fps turns it off
+  void dynamic_resolution_set_target_fps (Dynamic_resolution &, f32);
+
+  // Feed it the render time of the frame that just finished, returns
+  // the scale for the next one
+  f32 dynamic_resolution_update (Dynamic_resolution &, u64);
+};
@@ -0,0 +1,32 @@
+//
+// Built in 8x8 bitmap font, printable ASCII only. Glyph rows are baked
+// into AVX2 store masks at startup so a row of a glyph is a single
+// masked store.
+//
+#pragma once
+
+#include "hyper.hh"
+#include "hyper_colour.hh"
+
+#include <array>
+
+namespace hyper
+{
+  inline constexpr i32 font_glyph_size = 8;
+  inline constexpr char font_first_glyph = ' ';
+  inline constexpr char font_last_glyph = '~';
+  inline constexpr i32 font_glyph_count = font_last_glyph - font_first_glyph + 1;
+
+  struct Font
+  {
+    // One lane per pixel, all ones where the glyph is set
+    alignas (32) std::array<std::array<std::array<u32, font_glyph_size>, font_glyph_size>, font_glyph_count> masks;
+  };
+
+  void font_init (Font &);
+
+  // Pixel coordinates, not world ones. Characters that don't fit whole
+  // in the framebuffer are skipped. Returns the x after the last
+  // character.
+  i32 draw_text (Renderer_context *, i32, i32, char const *, Colour);
+};
@@ -0,0 +1,383 @@
+#include "hyper_frame_capture.hh"
+#include "hyper_renderer.hh"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <string.h>
+#include <stdio.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+#include <iostream>
+
+namespace hyper
+{
+  // Zero runs shorter than this go in with the literals, so the worst
+  // case stays close to the raw size
+  static constexpr u32 rle_min_zero_run = 2;
+  static constexpr u32 rle_zero_run_bit = 0x80000000;
+  // Frames waiting before a submit wakes the writer, below that it gets
+  // to them when it wakes up on its own
+  static constexpr u64 capture_wake_batch = capture_slot_count / 2;
+  static constexpr u64 capture_poll_ns = 16'000'000;
+
+  // Returns when woken, when the word isn't expected anymore or after
+  // the timeout, whichever comes first
+  static void
+  futex_wait (std::atomic<u32> &word, u32 expected, u64 timeout_ns)
+  {
+    timespec const timeout = { (time_t) (timeout_ns / 1'000'000'000), (long) (timeout_ns % 1'000'000'000) };
+    syscall (SYS_futex, reinterpret_cast<u32 *> (&word), FUTEX_WAIT_PRIVATE, expected, &timeout, nullptr, 0);
+  }
+
+  static void
+  futex_wake (std::atomic<u32> &word)
+  {
+    syscall (SYS_futex, reinterpret_cast<u32 *> (&word), FUTEX_WAKE_PRIVATE, 1, nullptr, nullptr, 0);
+  }
+
+  static bool
+  write_all (i32 fd, u8 const *data, size_t size)
+  {
+    size_t written = 0;
+
+    while (written < size)
+      {
+        ssize_t const result = write (fd, data + written, size - written);
+        if (result == -1)
+          {
+            if (errno == EINTR)
+              continue;
+
+            std::cerr << "couldn't write capture: " << strerror (errno) << '\n';
+            return false;
+          }
+
+        written += (size_t) result;
+      }
+
+    return true;
+  }
+
+  static bool
+  flush_output (Frame_capture &capture, i32 fd)
+  {
+    bool const success = write_all (fd, capture.output, capture.output_used);
+    capture.output_used = 0;
+
+    return success;
+  }
+
+  static void
+  append_output (Frame_capture &capture, void const *data, size_t size)
+  {
+    memcpy (capture.output + capture.output_used, data, size);
+    capture.output_used += size;
+  }
+
+  // Biggest a frame can get in a single file, header included
+  static size_t
+  get_max_frame_size (size_t pixels)
+  {
+    // rle never needs more than a token every two pixels
+    return sizeof (Capture_frame_header) + pixels * sizeof (u32) + (pixels / rle_min_zero_run + 1) * sizeof (u32);
+  }
+
+  static void
+  get_channel_shifts (Pixel_format format, u32 &r, u32 &g, u32 &b)
+  {
+    switch (format)
+      {
+      case Pixel_format::argb8888:
+        r = 16, g = 8, b = 0;
+        break;
+      case Pixel_format::abgr8888:
+        r = 0, g = 8, b = 16;
+        break;
+      case Pixel_format::bgra8888:
+        r = 8, g = 16, b = 24;
+        break;
+      case Pixel_format::rgba8888:
+      default:
+        r = 24, g = 16, b = 8;
+        break;
+      }
+  }
+
+  static void
+  write_ppm (Frame_capture &capture, Capture_slot const &slot)
+  {
+    char path[4096];
+    i32 const length = snprintf (path, sizeof (path), "%s_%06llu.ppm", capture.path, (unsigned long long) slot.frame);
+    if (length < 0 || (size_t) length >= sizeof (path))
+      return;
+
+    i32 const fd = open (path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd == -1)
+      {
+        std::cerr << "couldn't create " << path << ": " << strerror (errno) << '\n';
+        return;
+      }
+
+    u32 r_shift, g_shift, b_shift;
+    get_channel_shifts (capture.pixel_format, r_shift, g_shift, b_shift);
+
+    capture.output_used = (size_t) snprintf ((char *) capture.output, capture.output_size, "P6\n%d %d\n255\n", slot.width, slot.height);
+
+    size_t const pixels = (size_t) slot.width * (size_t) slot.height;
+    u8 *rgb = capture.output + capture.output_used;
+
+    for (size_t i = 0; i < pixels; ++i)
+      {
+        u32 const pixel = slot.pixels[i];
+        *rgb++ = (u8) (pixel >> r_shift);
+        *rgb++ = (u8) (pixel >> g_shift);
+        *rgb++ = (u8) (pixel >> b_shift);
+      }
+
+    capture.output_used += pixels * 3;
+    flush_output (capture, fd);
+    close (fd);
+  }
+
+  static size_t
+  encode_rle (u32 const *pixels, u32 const *previous, size_t count, u32 *out)
+  {
+    size_t size = 0;
+    size_t i = 0;
+
+    while (i < count)
+      {
+        size_t zeros = 0;
+        while (i + zeros < count && pixels[i + zeros] == previous[i + zeros])
+          ++zeros;
+
+        if (zeros >= rle_min_zero_run || i + zeros == count)
+          {
+            out[size++] = rle_zero_run_bit | (u32) zeros;
+            i += zeros;
+            continue;
+          }
+
+        // Literals until the next long enough zero run
+        size_t const token = size++;
+        size_t literals = 0;
+
+        while (i < count)
+          {
+            size_t run = 0;
+            while (i + run < count && run < rle_min_zero_run && pixels[i + run] == previous[i + run])
+              ++run;
+
+            if (run >= rle_min_zero_run)
+              break;
+
+            out[size++] = pixels[i] ^ previous[i];
+            ++literals;
+            ++i;
+          }
+
+        out[token] = (u32) literals;
+      }
+
+    return size * sizeof (u32);
+  }
+
+  static void
+  write_frame (Frame_capture &capture, Capture_slot const &slot)
+  {
+    if (capture.format == Capture_format::ppm)
+      {
+        write_ppm (capture, slot);
+        return;
+      }
+
+    size_t const pixels = (size_t) slot.width * (size_t) slot.height;
+
+    if (capture.output_size - capture.output_used < get_max_frame_size (pixels))
+      flush_output (capture, capture.fd);
+
+    Capture_frame_header header;
+    header.frame = slot.frame;
+    header.width = slot.width;
+    header.height = slot.height;
+
+    size_t const header_offset = capture.output_used;
+    capture.output_used += sizeof (header);
+
+    if (capture.format == Capture_format::raw)
+      {
+        header.size = (u32) (pixels * sizeof (u32));
+        append_output (capture, slot.pixels, header.size);
+      }
+    else
+      {
+        // A new size means nothing to diff against
+        if (slot.width != capture.previous_width || slot.height != capture.previous_height)
+          {
+            memset (capture.previous, 0, pixels * sizeof (u32));
+            capture.previous_width = slot.width;
+            capture.previous_height = slot.height;
+          }
+
+        header.size = (u32) encode_rle (slot.pixels, capture.previous, pixels, (u32 *) (capture.output + capture.output_used));
+        capture.output_used += header.size;
+        memcpy (capture.previous, slot.pixels, pixels * sizeof (u32));
+      }
+
+    memcpy (capture.output + header_offset, &header, sizeof (header));
+  }
+
+  static void
+  drain_slots (Frame_capture &capture)
+  {
+    u64 next = capture.read_index.load (std::memory_order_relaxed);
+    u64 const end = capture.write_index.load (std::memory_order_acquire);
+
+    for (; next < end; ++next)
+      {
+        write_frame (capture, capture.slots[next % capture_slot_count]);
+        ++capture.written;
+
+        // Slot is free again
+        capture.read_index.store (next + 1, std::memory_order_release);
+      }
+  }
+
+  static void
+  writer_main (Frame_capture *capture)
+  {
+    for (;;)
+      {
+        // Read before draining, a wake up that comes in after it makes
+        // the wait return right away
+        u32 const sequence = capture->wake_sequence.load (std::memory_order_acquire);
+
+        drain_slots (*capture);
+
+        if (!capture->running.load (std::memory_order_acquire))
+          {
+            // Anything submitted before running went down
+            drain_slots (*capture);
+            break;
+          }
+
+        // Says it's going to sleep before looking at the ring one last
+        // time, so either it sees the new frame or the submit sees it
+        // waiting
+        capture->writer_waiting.store (true);
+        if (capture->write_index.load () == capture->read_index.load (std::memory_order_relaxed)
+            && capture->running.load ())
+          futex_wait (capture->wake_sequence, sequence, capture_poll_ns);
+
+        capture->writer_waiting.store (false, std::memory_order_relaxed);
+      }
+
+    if (capture->format != Capture_format::ppm)
+      flush_output (*capture, capture->fd);
+  }
+
+  bool
+  frame_capture_open (Frame_capture &capture, char const *path, Capture_format format, Framebuffer const &framebuffer, std::pmr::memory_resource *resource)
+  {
+    capture.path = path;
+    capture.format = format;
+    capture.pixel_format = framebuffer.format;
+    capture.max_pixels = (size_t) framebuffer.max_width * (size_t) framebuffer.max_height;
+    capture.write_index.store (0);
+    capture.read_index.store (0);
+    capture.dropped.store (0);
+    capture.written = 0;
+    capture.previous_width = 0;
+    capture.previous_height = 0;
+    capture.fd = -1;
+
+    if (format != Capture_format::ppm)
+      {
+        capture.fd = open (path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (capture.fd == -1)
+          {
+            std::cerr << "couldn't create " << path << ": " << strerror (errno) << '\n';
+            return false;
+          }
+      }
+
+    capture.wake_sequence.store (0);
+    capture.writer_waiting.store (false);
+
+    for (Capture_slot &slot : capture.slots)
+      slot.pixels = static_cast<u32 *> (resource->allocate (capture.max_pixels * sizeof (u32), 32));
+
+    capture.previous = format == Capture_format::rle ? static_cast<u32 *> (resource->allocate (capture.max_pixels * sizeof (u32), 32)) : nullptr;
+
+    // Room for two of the biggest frames, so writes are a few MB each
+    capture.output_size = 2 * get_max_frame_size (capture.max_pixels);
+    capture.output = static_cast<u8 *> (resource->allocate (capture.output_size, 32));
+    capture.output_used = 0;
+
+    if (format != Capture_format::ppm)
+      {
+        Capture_header header;
+        header.magic = capture_magic;
+        header.version = capture_version;
+        header.format = (u8) format;
+        header.pixel_format = (u8) capture.pixel_format;
+        header.reserved = 0;
+        append_output (capture, &header, sizeof (header));
+      }
+
+    capture.running.store (true, std::memory_order_release);
+    capture.thread = std::thread (writer_main, &capture);
+
+    return true;
+  }
+
+  bool
+  frame_capture_submit (Frame_capture &capture, Framebuffer const &framebuffer, u64 frame)
+  {
+    if (!capture.running.load (std::memory_order_relaxed))
+      return false;
+
+    u64 const index = capture.write_index.load (std::memory_order_relaxed);
+    u64 const read_index = capture.read_index.load (std::memory_order_acquire);
+    if (index - read_index >= capture_slot_count)
+      {
+        capture.dropped.fetch_add (1, std::memory_order_relaxed);
+        return false;
+      }
+
+    Capture_slot &slot = capture.slots[index % capture_slot_count];
+    slot.frame = frame;
+    slot.width = framebuffer.width;
+    slot.height = framebuffer.height;
+    framebuffer_copy_linear (framebuffer, slot.pixels, framebuffer.width * (i32) sizeof (u32), nullptr);
+
+    capture.write_index.store (index + 1);
+
+    if (index + 1 - read_index >= capture_wake_batch && capture.writer_waiting.load ())
+      {
+        capture.wake_sequence.fetch_add (1, std::memory_order_release);
+        futex_wake (capture.wake_sequence);
+      }
+
+    return true;
+  }
+
+  void
+  frame_capture_close (Frame_capture &capture)
+  {
+    if (!capture.thread.joinable ())
+      return;
+
+    capture.running.store (false);
+    capture.wake_sequence.fetch_add (1, std::memory_order_release);
+    futex_wake (capture.wake_sequence);
+    capture.thread.join ();
+
+    std::cerr << "capture: " << capture.written << " frames written, " << capture.dropped.load () << " dropped\n";
+
+    if (capture.fd != -1)
+      close (capture.fd);
+  }
+};
@@ -0,0 +1,98 @@
+//
+// Frame capture to disk. The main thread copies each finished frame
+// into a free slot of a ring and goes on, a writer thread encodes the
+// slots and writes them out in big sequential chunks. When the writer
+// falls behind frames get dropped and counted, the game never waits.
+//
+#pragma once
+
+#include "hyper.hh"
+
+#include <atomic>
+#include <memory_resource>
+#include <thread>
+
+namespace hyper
+{
+  enum class Capture_format : u8
+    {
+      // Numbered RGB image per frame, PATH_000000.ppm...
+      ppm,
+      // One file, every frame as is
+      raw,
+      // One file, every frame XORed with the one before and run length
+      // encoded, a mostly still frame is a few bytes
+      rle,
+    };
+
+  inline constexpr u32 capture_slot_count = 8;
+  inline constexpr u32 capture_magic = 0x50414348; // "HCAP"
+  inline constexpr u32 capture_version = 1;
+
+  // Start of raw and rle files
+  struct Capture_header
+  {
+    u32 magic;
+    u32 version;
+    u8 format;
+    u8 pixel_format;
+    u16 reserved;
+  };
+
+  // Before every frame in raw and rle files, size is in bytes
+  struct Capture_frame_header
+  {
+    u64 frame;
+    i32 width;
+    i32 height;
+    u32 size;
+  };
+
+  struct Capture_slot
+  {
+    u32 *pixels;
+    u64 frame;
+    i32 width;
+    i32 height;
+  };
+
+  struct Frame_capture
+  {
+    Capture_slot slots[capture_slot_count];
+    // Single producer, single consumer, both only ever grow
+    alignas (64) std::atomic<u64> write_index;
+    alignas (64) std::atomic<u64> read_index;
+    std::atomic<u64> dropped;
+    std::atomic<bool> running;
+    // The writer sleeps on it as a futex, a frame only bumps it and
+    // wakes the writer when it's asleep and frames are piling up
+    std::atomic<u32> wake_sequence;
+    std::atomic<bool> writer_waiting;
+    // Everything from here on belongs to the writer thread
+    std::thread thread;
+    i32 fd;
+    char const *path;
+    Capture_format format;
+    Pixel_format pixel_format;
+    u8 *output;
+    size_t output_size;
+    size_t output_used;
+    // Last frame written, rle encodes against it
+    u32 *previous;
+    i32 previous_width;
+    i32 previous_height;
+    u64 written;
+    size_t max_pixels;
+  };
+
+  // Slots are sized for the framebuffer's full size and come from the
+  // resource. Returns false if the output can't be created.
+  bool frame_capture_open (Frame_capture &, char const *, Capture_format, Framebuffer const &, std::pmr::memory_resource *);
+
+  // One copy and never blocks, no syscall unless the writer has to be
+  // woken up. Returns false if the frame got dropped.
+  bool frame_capture_submit (Frame_capture &, Framebuffer const &, u64);
+
+  // Waits for the writer to finish what's queued
+  void frame_capture_close (Frame_capture &);
+};
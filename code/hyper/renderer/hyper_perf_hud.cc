@@ -0,0 +1,127 @@
+#include "hyper_perf_hud.hh"
+#include "hyper_font.hh"
+#include "hyper_colour.hh"
+#include "hyper_perf_counters.hh"
+#include "hyper_render_stats.hh"
+#include "hyper_math.hh"
+
+#include <stdio.h>
+
+namespace hyper
+{
+  static inline void
+  smooth (f32 &average, u64 sample)
+  {
+    average += ((f32) sample - average) * (1.0f / 16.0f);
+  }
+
+  void
+  perf_stats_record (Perf_stats &stats, u64 frame_ns, u64 update_ns, u64 render_ns, u64 hud_ns)
+  {
+    smooth (stats.frame_ns, frame_ns);
+    smooth (stats.update_ns, update_ns);
+    smooth (stats.render_ns, render_ns);
+    smooth (stats.hud_ns, hud_ns);
+  }
+
+  i32
+  draw_perf_hud (Renderer_context *context, Framebuffer *hud, Perf_stats const &stats)
+  {
+    if (!context->font)
+      return 0;
+
+    f64 const kilobyte = 1024.0;
+    f64 const megabyte = 1024.0 * 1024.0;
+    char text[2048];
+
+    i32 const length = snprintf (text, sizeof (text),
+                     "frame  %6.2f ms %7.1f fps\n"
+                     "update %6.2f ms (%u ticks)\n"
+                     "render %6.2f ms\n"
+                     "hud    %6.1f us\n"
+                     "draws  %6u %dx%d\n"
+                     "snap   %6u pages\n"
+                     "xform  %6u nodes\n"
+                     "tasks  %6.1f us (%u steps)\n"
+                     "stack  %6.1f KB peak %.1f / %.0f KB\n"
+                     "linear %6.1f MB of %.0f MB\n"
+                     "pages  %s",
+                     (f64) stats.frame_ns / 1e6, stats.frame_ns > 0.0f ? 1e9 / (f64) stats.frame_ns : 0.0,
+                     (f64) stats.update_ns / 1e6, stats.ticks,
+                     (f64) stats.render_ns / 1e6,
+                     (f64) stats.hud_ns / 1e3,
+                     stats.draw_calls, context->framebuffer->width, context->framebuffer->height,
+                     stats.snapshot_pages,
+                     stats.transforms_updated,
+                     (f64) stats.task_ns / 1e3, stats.task_steps,
+                     (f64) stats.stack_arena_used / kilobyte, (f64) stats.stack_arena_peak / kilobyte, (f64) stats.stack_arena_capacity / kilobyte,
+                     (f64) stats.linear_arena_used / megabyte, (f64) stats.linear_arena_capacity / megabyte,
+                     stats.arena_pages ? stats.arena_pages : "unknown");
+
+    // Nothing more fits when it's already cut short
+    size_t used = length > 0 ? (size_t) length : sizeof (text);
+
+    // This frame's stages so far, misses in thousands
+    if (context->perf_counters && used < sizeof (text))
+      {
+        used += (size_t) snprintf (text + used, sizeof (text) - used, "\n\n        IPC    L1D    LLC     br   dTLB");
+
+        for (Perf_scope scope : { Perf_scope::update, Perf_scope::render })
+          {
+            Perf_scope_counts const &counts = context->perf_counters->frame[(size_t) scope];
+            Perf_counter_values const &values = counts.values;
+            f64 const cycles = (f64) values[(size_t) Perf_counter::cycles];
+
+            if (used >= sizeof (text))
+              continue;
+
+            if (counts.calls && counts.not_counted == counts.calls)
+              used += (size_t) snprintf (text + used, sizeof (text) - used, "\n%-6s not counted", get_perf_scope_name (scope));
+            else
+              used += (size_t) snprintf (text + used, sizeof (text) - used, "\n%-6s %4.2f %6.1f %6.1f %6.1f %6.1f",
+                                         get_perf_scope_name (scope),
+                                         cycles > 0.0 ? (f64) values[(size_t) Perf_counter::instructions] / cycles : 0.0,
+                                         (f64) values[(size_t) Perf_counter::l1d_misses] / 1e3,
+                                         (f64) values[(size_t) Perf_counter::llc_misses] / 1e3,
+                                         (f64) values[(size_t) Perf_counter::branch_misses] / 1e3,
+                                         (f64) values[(size_t) Perf_counter::dtlb_misses] / 1e3);
+          }
+      }
+
+    // This frame's primitives so far, pixels in thousands, and how many
+    // times over the frame got written
+    Render_stats const *render_stats = context->framebuffer->stats;
+    if (render_stats && used < sizeof (text))
+      {
+        u64 pixels = 0;
+        for (Render_primitive_stats const &primitive : render_stats->frame)
+          pixels += primitive.pixels;
+
+        f64 const area = (f64) context->framebuffer->width * (f64) context->framebuffer->height;
+        used += (size_t) snprintf (text + used, sizeof (text) - used, "\n\noverdraw %.2fx\n                 calls culled  spans   pixels  clipped",
+                                   (f64) pixels / area);
+
+        for (size_t primitive = 0; primitive < render_stats->frame.size (); ++primitive)
+          {
+            Render_primitive_stats const &frame = render_stats->frame[primitive];
+            if (!frame.calls || used >= sizeof (text))
+              continue;
+
+            used += (size_t) snprintf (text + used, sizeof (text) - used, "\n%-16s %5llu %6llu %6llu %8.1f %8.1f",
+                                       get_render_primitive_name ((Render_primitive) primitive),
+                                       (unsigned long long) frame.calls, (unsigned long long) frame.culled,
+                                       (unsigned long long) frame.spans, (f64) frame.pixels / 1e3, (f64) frame.clipped / 1e3);
+          }
+      }
+
+    i32 lines = 1;
+    for (char const *c = text; *c; ++c)
+      lines += *c == '\n';
+
+    Renderer_context hud_context = *context;
+    hud_context.framebuffer = hud;
+    draw_text (&hud_context, 8, 8, text, get_colour_from_preset (WHITE));
+
+    return min (8 + lines * font_glyph_size, hud->height);
+  }
+};
@@ -0,0 +1,45 @@
+//
+// Performance overlay, drawn with the built in font on top of the
+// frame. Timings are smoothed so they can be read.
+//
+#pragma once
+
+#include "hyper.hh"
+
+namespace hyper
+{
+  struct Perf_stats
+  {
+    // Nanoseconds, smoothed over roughly the last 16 frames
+    f32 frame_ns;
+    f32 update_ns;
+    f32 render_ns;
+    f32 hud_ns;
+    // Fixed ticks simulated in the last frame
+    u32 ticks;
+    u32 draw_calls;
+    // Game state pages the last snapshot copied
+    u32 snapshot_pages;
+    // Nodes the transform hierarchy recomputed this frame
+    u32 transforms_updated;
+    // The tasks after the last frame
+    u64 task_ns;
+    u32 task_steps;
+    size_t stack_arena_used;
+    size_t stack_arena_peak;
+    size_t stack_arena_capacity;
+    size_t linear_arena_used;
+    size_t linear_arena_capacity;
+    // What the arenas got from the kernel, see get_page_kind_name
+    char const *arena_pages;
+  };
+
+  // Call it once per frame with the frame, update, render and HUD
+  // times, the HUD one can be from the frame before
+  void perf_stats_record (Perf_stats &, u64, u64, u64, u64);
+
+  // The frame's size and stats come from the context's framebuffer, the
+  // text goes to the one passed, which the platform keeps at the
+  // window's resolution. Returns how many rows from the top it took.
+  i32 draw_perf_hud (Renderer_context *, Framebuffer *, Perf_stats const &);
+};
@@ -0,0 +1,714 @@
+//
+// Innermost loops of the renderer. Every combination of pixel format,
+// blend mode, clipping and framebuffer layout is its own instantiation,
+// the draw functions pick one from the table once per draw so the loops
+// themselves never branch on any of it. Internal to the renderer.
+//
+#pragma once
+
+#include "hyper.hh"
+#include "hyper_colour.hh"
+#include "hyper_render_stats.hh"
+#include "hyper_renderer.hh"
+
+#include <immintrin.h>
+#include <array>
+
+namespace hyper
+{
+  // Both ends included, colour already packed for the framebuffer
+  using Span_function = void (*) (Framebuffer *, i32, i32, i32, u32);
+  using Pixel_function = void (*) (Framebuffer *, i32, i32, u32);
+  using Pack_colour_function = u32 (*) (Colour);
+
+  // Everything about a shaded triangle's 16.16 fixed point r, g, b and
+  // a that stays the same from one scanline to the next
+  struct Shaded_steps
+  {
+    // From one pixel to the next
+    __m128i step;
+    // 0 to 7 steps, per channel, so spans don't multiply
+    __m256i lanes[4];
+  };
+
+  // Both ends included and inside the framebuffer, then the channels of
+  // the first pixel. Those are in a register, it's a call per scanline
+  // and reloading what the caller just stored doesn't forward.
+  using Shaded_span_function = void (*) (Framebuffer *, i32, i32, i32, __m128i, Shaded_steps const &);
+
+  // Anti-aliased edges, the colour is weighed by how much of each pixel
+  // it covers, 0 to 255. Spans have to be inside the framebuffer and
+  // read up to 7 coverage bytes past their end, pixels are clipped.
+  using Coverage_span_function = void (*) (Framebuffer *, i32, i32, i32, u32, u8 const *);
+  using Coverage_pixel_function = void (*) (Framebuffer *, i32, i32, u32, u32);
+
+  struct Raster_kernels
+  {
+    // Span has to be inside the framebuffer
+    Span_function span;
+    // Clips the span first
+    Span_function span_clipped;
+    // Always clipped, outlines don't know where they end up
+    Pixel_function pixel;
+    Shaded_span_function shaded_span;
+    Coverage_span_function coverage_span;
+    Coverage_pixel_function coverage_pixel;
+    // The colour as a pixel of the format, the draw functions pack it
+    // once per draw
+    Pack_colour_function pack_colour;
+  };
+
+  template <Pixel_format format>
+  inline constexpr u32
+  get_alpha_shift ()
+  {
+    if constexpr (format == Pixel_format::rgba8888 || format == Pixel_format::bgra8888)
+      return 0;
+    else
+      return 24;
+  }
+
+  template <Pixel_format format>
+  inline constexpr u32
+  get_alpha_mask ()
+  {
+    return 0xFFu << get_alpha_shift<format> ();
+  }
+
+  // Where r, g, b and a go in a pixel
+  template <Pixel_format format>
+  inline constexpr std::array<u32, 4>
+  get_channel_shifts ()
+  {
+    if constexpr (format == Pixel_format::rgba8888)
+      return { 24, 16, 8, 0 };
+    else if constexpr (format == Pixel_format::argb8888)
+      return { 16, 8, 0, 24 };
+    else if constexpr (format == Pixel_format::abgr8888)
+      return { 0, 8, 16, 24 };
+    else
+      return { 8, 16, 24, 0 };
+  }
+
+  // Source colour for a blended span, worked out once per span
+  struct Blend_source
+  {
+    // Every channel times alpha
+    u32 scaled;
+    u32 alpha;
+  };
+
+  template <Pixel_format format>
+  inline Blend_source
+  get_blend_source (u32 colour)
+  {
+    Blend_source source;
+    source.alpha = (colour >> get_alpha_shift<format> ()) & 0xFF;
+    source.scaled = 0;
+
+    for (u32 shift = 0; shift < 32; shift += 8)
+      source.scaled |= ((((colour >> shift) & 0xFF) * source.alpha + 127) / 255) << shift;
+
+    return source;
+  }
+
+  // Partly covered pixels are blended whatever the mode, opaque colours
+  // count as fully opaque and additive stays additive
+  template <Blend_mode blend>
+  inline constexpr Blend_mode
+  get_coverage_blend_mode ()
+  {
+    return blend == Blend_mode::additive ? Blend_mode::additive : Blend_mode::alpha;
+  }
+
+  template <Pixel_format format, Blend_mode blend>
+  inline u32
+  get_coverage_alpha (u32 colour)
+  {
+    if constexpr (blend == Blend_mode::opaque)
+      {
+        (void) colour;
+        return 255;
+      }
+    else
+      return (colour >> get_alpha_shift<format> ()) & 0xFF;
+  }
+
+  template <Pixel_format format, Blend_mode blend>
+  inline u32
+  blend_pixel (u32 destination, u32 colour, Blend_source const &source)
+  {
+    if constexpr (blend == Blend_mode::opaque)
+      {
+        (void) destination;
+        (void) source;
+        return colour;
+      }
+    else if constexpr (blend == Blend_mode::alpha)
+      {
+        (void) colour;
+        u32 result = 0;
+
+        for (u32 shift = 0; shift < 32; shift += 8)
+          {
+            u32 const channel = ((destination >> shift) & 0xFF) * (255 - source.alpha);
+            result |= hyper::min (((source.scaled >> shift) & 0xFF) + (channel + 127) / 255, 255u) << shift;
+          }
+
+        // The framebuffer stays opaque
+        return result | get_alpha_mask<format> ();
+      }
+    else
+      {
+        (void) colour;
+        u32 result = 0;
+
+        for (u32 shift = 0; shift < 32; shift += 8)
+          result |= hyper::min (((destination >> shift) & 0xFF) + ((source.scaled >> shift) & 0xFF), 255u) << shift;
+
+        return result | get_alpha_mask<format> ();
+      }
+  }
+
+  // The inverse alphas are 255 - alpha in 16 bit lanes, low for the
+  // pixels unpacklo_epi8 picks, high for unpackhi_epi8. Flat spans pass
+  // the same one twice.
+  template <Pixel_format format, Blend_mode blend>
+  inline __m256i
+  blend_pixels (__m256i destination, __m256i colour, __m256i scaled, __m256i inverse_alpha_low, __m256i inverse_alpha_high)
+  {
+    if constexpr (blend == Blend_mode::opaque)
+      {
+        (void) destination;
+        (void) scaled;
+        (void) inverse_alpha_low;
+        (void) inverse_alpha_high;
+        return colour;
+      }
+    else if constexpr (blend == Blend_mode::alpha)
+      {
+        // destination * (255 - alpha) / 255 in 16 bit lanes, x / 255
+        // is (x + 1 + (x >> 8)) >> 8 for the range I need
+        __m256i const zero = _mm256_setzero_si256 ();
+        __m256i const one = _mm256_set1_epi16 (1);
+        __m256i low = _mm256_mullo_epi16 (_mm256_unpacklo_epi8 (destination, zero), inverse_alpha_low);
+        __m256i high = _mm256_mullo_epi16 (_mm256_unpackhi_epi8 (destination, zero), inverse_alpha_high);
+        low = _mm256_srli_epi16 (_mm256_add_epi16 (_mm256_add_epi16 (low, one), _mm256_srli_epi16 (low, 8)), 8);
+        high = _mm256_srli_epi16 (_mm256_add_epi16 (_mm256_add_epi16 (high, one), _mm256_srli_epi16 (high, 8)), 8);
+
+        __m256i const result = _mm256_adds_epu8 (_mm256_packus_epi16 (low, high), scaled);
+        return _mm256_or_si256 (result, _mm256_set1_epi32 ((i32) get_alpha_mask<format> ()));
+      }
+    else
+      {
+        (void) inverse_alpha_low;
+        (void) inverse_alpha_high;
+        __m256i const result = _mm256_adds_epu8 (destination, scaled);
+        return _mm256_or_si256 (result, _mm256_set1_epi32 ((i32) get_alpha_mask<format> ()));
+      }
+  }
+
+  // Calls write (row, offset, count) for every piece of a span that's
+  // in one place in memory, offset from x_start. That's all of it in a
+  // linear frame, up to a tile's width at a time in a tiled one.
+  template <Framebuffer_layout layout, typename Write>
+  inline void
+  for_each_span_run (Framebuffer *framebuffer, i32 y, i32 x_start, i32 x_end, Write &&write)
+  {
+    u32 *row = &framebuffer->pixels[get_pixel_index<layout> (*framebuffer, x_start, y)];
+    i32 const count = x_end - x_start + 1;
+
+    if constexpr (layout == Framebuffer_layout::linear)
+      write (row, 0, count);
+    else
+      {
+        // Up to the first tile's edge, then the same row of every tile
+        // after it
+        constexpr i32 tile_pixels = framebuffer_tile_size * framebuffer_tile_size;
+        i32 const start = x_start & (framebuffer_tile_size - 1);
+        i32 offset = hyper::min (framebuffer_tile_size - start, count);
+
+        write (row, 0, offset);
+        row += tile_pixels - start;
+
+        for (; offset < count; offset += framebuffer_tile_size, row += tile_pixels)
+          write (row, offset, hyper::min (framebuffer_tile_size, count - offset));
+      }
+  }
+
+  // A span 8 pixels at a time from its start, for kernels where a
+  // pixel depends on how far along the span it is. x is from the start
+  // of the span and a multiple of 8, the mask picks the pixels that are
+  // in it.
+  template <Framebuffer_layout layout>
+  struct Span_chunks;
+
+  template <>
+  struct Span_chunks<Framebuffer_layout::linear>
+  {
+    u32 *row;
+
+    Span_chunks (Framebuffer *framebuffer, i32 y, i32 x_start)
+      : row {&framebuffer->pixels[get_pixel_index<Framebuffer_layout::linear> (*framebuffer, x_start, y)]}
+    {
+    }
+
+    __m256i
+    load (i32 x, bool full, __m256i mask) const
+    {
+      return full ? _mm256_loadu_si256 ((__m256i const *) (row + x)) : _mm256_maskload_epi32 ((int const *) (row + x), mask);
+    }
+
+    void
+    store (i32 x, bool full, __m256i mask, __m256i pixels) const
+    {
+      if (full)
+        _mm256_storeu_si256 ((__m256i *) (row + x), pixels);
+      else
+        _mm256_maskstore_epi32 ((int *) (row + x), mask, pixels);
+    }
+  };
+
+  // Unless the span starts on a tile's edge every chunk is split in
+  // two, the pixels past the edge are on the same row of the next tile
+  template <>
+  struct Span_chunks<Framebuffer_layout::tiled>
+  {
+    // The next tile's row is this much further than the span's chunk
+    static constexpr i32 next_tile = framebuffer_tile_size * (framebuffer_tile_size - 1);
+
+    // Where the first chunk starts, every chunk is a tile further
+    u32 *row;
+    // Lanes that are still in the chunk's first tile
+    __m256i first_tile;
+    bool split;
+
+    Span_chunks (Framebuffer *framebuffer, i32 y, i32 x_start)
+      : row {&framebuffer->pixels[get_pixel_index<Framebuffer_layout::tiled> (*framebuffer, x_start, y)]},
+        first_tile {_mm256_cmpgt_epi32 (_mm256_set1_epi32 (framebuffer_tile_size - (x_start & (framebuffer_tile_size - 1))),
+                                        _mm256_setr_epi32 (0, 1, 2, 3, 4, 5, 6, 7))},
+        split {(x_start & (framebuffer_tile_size - 1)) != 0}
+    {
+    }
+
+    __m256i
+    load (i32 x, bool full, __m256i mask) const
+    {
+      u32 const *chunk = row + x * framebuffer_tile_size;
+
+      if (!split)
+        return full ? _mm256_loadu_si256 ((__m256i const *) chunk) : _mm256_maskload_epi32 ((int const *) chunk, mask);
+
+      // Masked lanes aren't touched, the next tile's pointer is only
+      // good for the lanes past the edge
+      return _mm256_or_si256 (_mm256_maskload_epi32 ((int const *) chunk, _mm256_and_si256 (mask, first_tile)),
+                              _mm256_maskload_epi32 ((int const *) (chunk + next_tile), _mm256_andnot_si256 (first_tile, mask)));
+    }
+
+    void
+    store (i32 x, bool full, __m256i mask, __m256i pixels) const
+    {
+      u32 *chunk = row + x * framebuffer_tile_size;
+
+      if (!split)
+        {
+          if (full)
+            _mm256_storeu_si256 ((__m256i *) chunk, pixels);
+          else
+            _mm256_maskstore_epi32 ((int *) chunk, mask, pixels);
+
+          return;
+        }
+
+      _mm256_maskstore_epi32 ((int *) chunk, _mm256_and_si256 (mask, first_tile), pixels);
+      _mm256_maskstore_epi32 ((int *) (chunk + next_tile), _mm256_andnot_si256 (first_tile, mask), pixels);
+    }
+  };
+
+  template <Pixel_format format, Blend_mode blend, bool clip, Framebuffer_layout layout>
+  void
+  fill_span_kernel (Framebuffer *framebuffer, i32 y, i32 x_start, i32 x_end, u32 colour)
+  {
+    if constexpr (clip)
+      {
+        if (y < 0 || y >= framebuffer->height)
+          return;
+
+        x_start = hyper::max (x_start, 0);
+        x_end = hyper::min (x_end, framebuffer->width - 1);
+      }
+
+    if (x_start > x_end)
+      return;
+
+    Blend_source source {};
+
+    if constexpr (blend != Blend_mode::opaque)
+      source = get_blend_source<format> (colour);
+
+    __m256i const colour_i = _mm256_set1_epi32 ((i32) colour);
+    __m256i const scaled_i = _mm256_set1_epi32 ((i32) source.scaled);
+    __m256i const inverse_alpha_i = _mm256_set1_epi16 ((short) (255 - source.alpha));
+    // Whole chunks of 8 from the start of the span are blended 8 at a
+    // time and the leftovers one by one. Those round differently, so
+    // tiled runs stick to the same split and a frame comes out the same
+    // in either layout.
+    i32 const simd_end = (x_end - x_start + 1) & ~7;
+
+    for_each_span_run<layout> (framebuffer, y, x_start, x_end, [&] (u32 *row, i32 offset, i32 count)
+    {
+      i32 const simd_count = hyper::min (hyper::max (simd_end - offset, 0), count);
+      i32 x = 0;
+
+      for (; x + 8 <= simd_count; x += 8)
+        {
+          __m256i destination = _mm256_setzero_si256 ();
+
+          // Opaque never reads the framebuffer
+          if constexpr (blend != Blend_mode::opaque)
+            destination = _mm256_loadu_si256 ((__m256i const *) (row + x));
+
+          _mm256_storeu_si256 ((__m256i *) (row + x), blend_pixels<format, blend> (destination, colour_i, scaled_i, inverse_alpha_i, inverse_alpha_i));
+        }
+
+      // Only tiled runs that don't start on a tile's edge get here
+      if (x < simd_count)
+        {
+          __m256i const mask = _mm256_cmpgt_epi32 (_mm256_set1_epi32 (simd_count - x), _mm256_setr_epi32 (0, 1, 2, 3, 4, 5, 6, 7));
+          __m256i destination = _mm256_setzero_si256 ();
+
+          if constexpr (blend != Blend_mode::opaque)
+            destination = _mm256_maskload_epi32 ((int const *) (row + x), mask);
+
+          _mm256_maskstore_epi32 ((int *) (row + x), mask, blend_pixels<format, blend> (destination, colour_i, scaled_i, inverse_alpha_i, inverse_alpha_i));
+          x = simd_count;
+        }
+
+      // leftovers
+      for (; x < count; ++x)
+        row[x] = blend_pixel<format, blend> (row[x], colour, source);
+    });
+  }
+
+  template <Pixel_format format, Blend_mode blend, Framebuffer_layout layout>
+  void
+  plot_pixel_kernel (Framebuffer *framebuffer, i32 x, i32 y, u32 colour)
+  {
+    if ((u32) x >= (u32) framebuffer->width || (u32) y >= (u32) framebuffer->height)
+      return;
+
+    u32 &pixel = framebuffer->pixels[get_pixel_index<layout> (*framebuffer, x, y)];
+    Blend_source source {};
+
+    if constexpr (blend != Blend_mode::opaque)
+      source = get_blend_source<format> (colour);
+
+    pixel = blend_pixel<format, blend> (pixel, colour, source);
+  }
+
+  template <Pixel_format format, Blend_mode blend, Framebuffer_layout layout>
+  void
+  plot_coverage_kernel (Framebuffer *framebuffer, i32 x, i32 y, u32 colour, u32 coverage)
+  {
+    if ((u32) x >= (u32) framebuffer->width || (u32) y >= (u32) framebuffer->height || !coverage)
+      return;
+
+    // One pixel in 16 bit lanes, lines plot two of these per step so
+    // it's worth skipping the scalar channel loops
+    u32 &pixel = framebuffer->pixels[get_pixel_index<layout> (*framebuffer, x, y)];
+    __m128i const zero = _mm_setzero_si128 ();
+    __m128i const alpha = _mm_set1_epi16 ((short) ((get_coverage_alpha<format, blend> (colour) * coverage + 127) / 255));
+    __m128i const destination = _mm_unpacklo_epi8 (_mm_cvtsi32_si128 ((i32) pixel), zero);
+
+    // Rounded x / 255, same as the spans
+    auto const scale = [zero] (__m128i channels, __m128i by)
+    {
+      __m128i const product = _mm_add_epi16 (_mm_mullo_epi16 (channels, by), _mm_set1_epi16 (128));
+      return _mm_srli_epi16 (_mm_add_epi16 (product, _mm_srli_epi16 (product, 8)), 8);
+    };
+
+    __m128i result = scale (_mm_unpacklo_epi8 (_mm_cvtsi32_si128 ((i32) colour), zero), alpha);
+
+    if constexpr (get_coverage_blend_mode<blend> () == Blend_mode::alpha)
+      result = _mm_add_epi16 (result, scale (destination, _mm_sub_epi16 (_mm_set1_epi16 (255), alpha)));
+    else
+      result = _mm_add_epi16 (result, destination);
+
+    pixel = (u32) _mm_cvtsi128_si32 (_mm_packus_epi16 (result, zero)) | get_alpha_mask<format> ();
+  }
+
+  template <Pixel_format format, Blend_mode blend, Framebuffer_layout layout>
+  void
+  coverage_span_kernel (Framebuffer *framebuffer, i32 y, i32 x_start, i32 x_end, u32 colour, u8 const *coverage)
+  {
+    if (x_start > x_end)
+      return;
+
+    __m256i const zero = _mm256_setzero_si256 ();
+    __m256i const lanes = _mm256_setr_epi32 (0, 1, 2, 3, 4, 5, 6, 7);
+    __m256i const channel_max = _mm256_set1_epi16 (255);
+    __m256i const half = _mm256_set1_epi16 (128);
+    // Same colour in both halves' 16 bit lanes, whichever unpack
+    __m256i const colour_words = _mm256_unpacklo_epi8 (_mm256_set1_epi32 ((i32) colour), zero);
+    __m256i const alpha = _mm256_set1_epi32 ((i32) get_coverage_alpha<format, blend> (colour));
+
+    // Pixels don't depend on each other, each run of the span is its own
+    for_each_span_run<layout> (framebuffer, y, x_start, x_end, [&] (u32 *row, i32 offset, i32 count)
+    {
+      u8 const *run_coverage = coverage + offset;
+
+      for (i32 x = 0; x < count; x += 8)
+        {
+          // Colour alpha times coverage per pixel, rounded x / 255, then
+          // copied to the pixel's 4 lanes in the unpacklo_epi8 and
+          // unpackhi_epi8 layout
+          __m256i pixel_alpha = _mm256_mullo_epi32 (_mm256_cvtepu8_epi32 (_mm_loadl_epi64 ((__m128i const *) (run_coverage + x))), alpha);
+          pixel_alpha = _mm256_add_epi32 (pixel_alpha, _mm256_set1_epi32 (128));
+          pixel_alpha = _mm256_srli_epi32 (_mm256_add_epi32 (pixel_alpha, _mm256_srli_epi32 (pixel_alpha, 8)), 8);
+          pixel_alpha = _mm256_or_si256 (pixel_alpha, _mm256_slli_epi32 (pixel_alpha, 16));
+
+          __m256i const alpha_low = _mm256_unpacklo_epi32 (pixel_alpha, pixel_alpha);
+          __m256i const alpha_high = _mm256_unpackhi_epi32 (pixel_alpha, pixel_alpha);
+          __m256i scaled_low = _mm256_add_epi16 (_mm256_mullo_epi16 (colour_words, alpha_low), half);
+          __m256i scaled_high = _mm256_add_epi16 (_mm256_mullo_epi16 (colour_words, alpha_high), half);
+          scaled_low = _mm256_srli_epi16 (_mm256_add_epi16 (scaled_low, _mm256_srli_epi16 (scaled_low, 8)), 8);
+          scaled_high = _mm256_srli_epi16 (_mm256_add_epi16 (scaled_high, _mm256_srli_epi16 (scaled_high, 8)), 8);
+
+          bool const full = count - x >= 8;
+          __m256i const mask = _mm256_cmpgt_epi32 (_mm256_set1_epi32 (count - x), lanes);
+          __m256i const destination = full ? _mm256_loadu_si256 ((__m256i const *) (row + x))
+                                           : _mm256_maskload_epi32 ((int const *) (row + x), mask);
+
+          __m256i const result = blend_pixels<format, get_coverage_blend_mode<blend> ()> (destination, destination,
+                                                                                        _mm256_packus_epi16 (scaled_low, scaled_high),
+                                                                                        _mm256_sub_epi16 (channel_max, alpha_low),
+                                                                                        _mm256_sub_epi16 (channel_max, alpha_high));
+
+          if (full)
+            _mm256_storeu_si256 ((__m256i *) (row + x), result);
+          else
+            _mm256_maskstore_epi32 ((int *) (row + x), mask, result);
+        }
+    });
+  }
+
+  // 8.8 fixed point channels in 16 bit lanes, laid out the way
+  // unpacklo_epi8 and unpackhi_epi8 would spread 8 pixels: low has
+  // pixels 0, 1, 4 and 5, high has 2, 3, 6 and 7, each pixel's channels
+  // in the framebuffer's byte order
+  struct Shaded_pixels
+  {
+    __m256i low;
+    __m256i high;
+  };
+
+  // r, g, b and a lanes moved to the framebuffer's byte order
+  template <Pixel_format format>
+  inline __m128i
+  get_byte_order (__m128i channels)
+  {
+    constexpr std::array<u32, 4> shifts = get_channel_shifts<format> ();
+    constexpr i32 order = 0 << (shifts[0] / 4) | 1 << (shifts[1] / 4) | 2 << (shifts[2] / 4) | 3 << (shifts[3] / 4);
+
+    return _mm_shuffle_epi32 (channels, order);
+  }
+
+  template <Pixel_format format>
+  inline Shaded_pixels
+  get_shaded_pixels (__m128i start, Shaded_steps const &steps)
+  {
+    constexpr std::array<u32, 4> shifts = get_channel_shifts<format> ();
+
+    // Channel of every byte, from the lowest
+    __m256i bytes[4];
+    for (u32 c = 0; c < 4; ++c)
+      {
+        __m256i const channel_start = _mm256_permutevar8x32_epi32 (_mm256_castsi128_si256 (start), _mm256_set1_epi32 ((i32) c));
+        bytes[shifts[c] / 8] = _mm256_srai_epi32 (_mm256_add_epi32 (channel_start, steps.lanes[c]), 8);
+      }
+
+    // Saturating to 16 bits is the clamp, then interleaved to pixels
+    __m256i const even = _mm256_packus_epi32 (bytes[0], bytes[2]);
+    __m256i const odd = _mm256_packus_epi32 (bytes[1], bytes[3]);
+    __m256i const low = _mm256_unpacklo_epi16 (even, odd);
+    __m256i const high = _mm256_unpackhi_epi16 (even, odd);
+
+    return { _mm256_unpacklo_epi32 (low, high), _mm256_unpackhi_epi32 (low, high) };
+  }
+
+  // Each pixel's alpha copied to its 4 lanes
+  template <Pixel_format format>
+  inline __m256i
+  get_alpha_word_shuffle ()
+  {
+    alignas (16) std::array<u8, 16> shuffle {};
+
+    for (u32 i = 0; i < 16; ++i)
+      shuffle[i] = (u8) (((i / 8) * 4 + get_alpha_shift<format> () / 8) * 2 + i % 2);
+
+    return _mm256_broadcastsi128_si256 (_mm_load_si128 ((__m128i const *) shuffle.data ()));
+  }
+
+  template <Pixel_format format, Blend_mode blend, Framebuffer_layout layout>
+  void
+  shade_span_kernel (Framebuffer *framebuffer, i32 y, i32 x_start, i32 x_end, __m128i start, Shaded_steps const &steps)
+  {
+    i32 const count = x_end - x_start + 1;
+    if (count <= 0)
+      return;
+
+    Span_chunks<layout> const row {framebuffer, y, x_start};
+    __m256i const lanes = _mm256_setr_epi32 (0, 1, 2, 3, 4, 5, 6, 7);
+    Shaded_pixels pixels = get_shaded_pixels<format> (start, steps);
+
+    // 8 pixels further along in 8.8, split in what goes up and what goes
+    // down so saturating adds keep every channel in 0..255. The packs
+    // saturate too, negative halves end up 0.
+    __m128i const step_8 = _mm_srai_epi32 (_mm_add_epi32 (get_byte_order<format> (steps.step), _mm_set1_epi32 (16)), 5);
+    __m128i const step_8_down = _mm_sub_epi32 (_mm_setzero_si128 (), step_8);
+    __m256i const up = _mm256_broadcastq_epi64 (_mm_packus_epi32 (step_8, step_8));
+    __m256i const down = _mm256_broadcastq_epi64 (_mm_packus_epi32 (step_8_down, step_8_down));
+
+    // Only the blended ones need these
+    [[maybe_unused]] __m256i const alpha_shuffle = get_alpha_word_shuffle<format> ();
+    [[maybe_unused]] __m256i const channel_max = _mm256_set1_epi16 (255);
+    [[maybe_unused]] __m256i const half = _mm256_set1_epi16 (128);
+
+    for (i32 x = 0; x < count; x += 8)
+      {
+        __m256i const low = _mm256_srli_epi16 (pixels.low, 8);
+        __m256i const high = _mm256_srli_epi16 (pixels.high, 8);
+        __m256i result = _mm256_packus_epi16 (low, high);
+
+        pixels.low = _mm256_subs_epu16 (_mm256_adds_epu16 (pixels.low, up), down);
+        pixels.high = _mm256_subs_epu16 (_mm256_adds_epu16 (pixels.high, up), down);
+
+        bool const full = count - x >= 8;
+        __m256i const mask = _mm256_cmpgt_epi32 (_mm256_set1_epi32 (count - x), lanes);
+
+        if constexpr (blend != Blend_mode::opaque)
+          {
+            // Alpha changes from pixel to pixel, so the scaled colour
+            // and the inverse alpha do too. x / 255 as in blend_pixels.
+            __m256i const alpha_low = _mm256_shuffle_epi8 (low, alpha_shuffle);
+            __m256i const alpha_high = _mm256_shuffle_epi8 (high, alpha_shuffle);
+            __m256i scaled_low = _mm256_add_epi16 (_mm256_mullo_epi16 (low, alpha_low), half);
+            __m256i scaled_high = _mm256_add_epi16 (_mm256_mullo_epi16 (high, alpha_high), half);
+            scaled_low = _mm256_srli_epi16 (_mm256_add_epi16 (scaled_low, _mm256_srli_epi16 (scaled_low, 8)), 8);
+            scaled_high = _mm256_srli_epi16 (_mm256_add_epi16 (scaled_high, _mm256_srli_epi16 (scaled_high, 8)), 8);
+
+            __m256i const destination = row.load (x, full, mask);
+
+            result = blend_pixels<format, blend> (destination, result, _mm256_packus_epi16 (scaled_low, scaled_high),
+                                                  _mm256_sub_epi16 (channel_max, alpha_low),
+                                                  _mm256_sub_epi16 (channel_max, alpha_high));
+          }
+
+        row.store (x, full, mask, result);
+      }
+  }
+
+  // The same kernels counting what they're asked to write first, for
+  // framebuffers with stats
+  template <Pixel_format format, Blend_mode blend, bool clip, Framebuffer_layout layout>
+  void
+  fill_span_counting_kernel (Framebuffer *framebuffer, i32 y, i32 x_start, i32 x_end, u32 colour)
+  {
+    render_stats_add_span (*framebuffer->stats, *framebuffer, y, x_start, x_end);
+    fill_span_kernel<format, blend, clip, layout> (framebuffer, y, x_start, x_end, colour);
+  }
+
+  template <Pixel_format format, Blend_mode blend, Framebuffer_layout layout>
+  void
+  plot_pixel_counting_kernel (Framebuffer *framebuffer, i32 x, i32 y, u32 colour)
+  {
+    render_stats_add_span (*framebuffer->stats, *framebuffer, y, x, x);
+    plot_pixel_kernel<format, blend, layout> (framebuffer, x, y, colour);
+  }
+
+  template <Pixel_format format, Blend_mode blend, Framebuffer_layout layout>
+  void
+  shade_span_counting_kernel (Framebuffer *framebuffer, i32 y, i32 x_start, i32 x_end, __m128i start, Shaded_steps const &steps)
+  {
+    render_stats_add_span (*framebuffer->stats, *framebuffer, y, x_start, x_end);
+    shade_span_kernel<format, blend, layout> (framebuffer, y, x_start, x_end, start, steps);
+  }
+
+  template <Pixel_format format, Blend_mode blend, Framebuffer_layout layout>
+  void
+  coverage_span_counting_kernel (Framebuffer *framebuffer, i32 y, i32 x_start, i32 x_end, u32 colour, u8 const *coverage)
+  {
+    render_stats_add_span (*framebuffer->stats, *framebuffer, y, x_start, x_end);
+    coverage_span_kernel<format, blend, layout> (framebuffer, y, x_start, x_end, colour, coverage);
+  }
+
+  template <Pixel_format format, Blend_mode blend, Framebuffer_layout layout>
+  void
+  plot_coverage_counting_kernel (Framebuffer *framebuffer, i32 x, i32 y, u32 colour, u32 coverage)
+  {
+    // Nothing covered isn't written
+    if (coverage)
+      render_stats_add_span (*framebuffer->stats, *framebuffer, y, x, x);
+
+    plot_coverage_kernel<format, blend, layout> (framebuffer, x, y, colour, coverage);
+  }
+
+  template <Pixel_format format, Blend_mode blend, bool counting, Framebuffer_layout layout>
+  inline constexpr Raster_kernels
+  make_raster_kernels ()
+  {
+    if constexpr (counting)
+      return { fill_span_counting_kernel<format, blend, false, layout>,
+               fill_span_counting_kernel<format, blend, true, layout>,
+               plot_pixel_counting_kernel<format, blend, layout>,
+               shade_span_counting_kernel<format, blend, layout>,
+               coverage_span_counting_kernel<format, blend, layout>,
+               plot_coverage_counting_kernel<format, blend, layout>,
+               get_colour_uint<format> };
+    else
+      return { fill_span_kernel<format, blend, false, layout>,
+               fill_span_kernel<format, blend, true, layout>,
+               plot_pixel_kernel<format, blend, layout>,
+               shade_span_kernel<format, blend, layout>,
+               coverage_span_kernel<format, blend, layout>,
+               plot_coverage_kernel<format, blend, layout>,
+               get_colour_uint<format> };
+  }
+
+  template <Pixel_format format, bool counting, Framebuffer_layout layout>
+  inline constexpr std::array<Raster_kernels, (size_t) Blend_mode::count>
+  make_raster_kernels_for_format ()
+  {
+    return { make_raster_kernels<format, Blend_mode::opaque, counting, layout> (),
+             make_raster_kernels<format, Blend_mode::alpha, counting, layout> (),
+             make_raster_kernels<format, Blend_mode::additive, counting, layout> () };
+  }
+
+  using Raster_kernel_table = std::array<std::array<Raster_kernels, (size_t) Blend_mode::count>, 4>;
+
+  // Same order as Pixel_format and Blend_mode
+  template <bool counting, Framebuffer_layout layout>
+  inline constexpr Raster_kernel_table
+  make_raster_kernel_table ()
+  {
+    return { make_raster_kernels_for_format<Pixel_format::rgba8888, counting, layout> (),
+             make_raster_kernels_for_format<Pixel_format::argb8888, counting, layout> (),
+             make_raster_kernels_for_format<Pixel_format::abgr8888, counting, layout> (),
+             make_raster_kernels_for_format<Pixel_format::bgra8888, counting, layout> () };
+  }
+
+  // By layout, then without and with counting
+  inline constexpr std::array<std::array<Raster_kernel_table, 2>, 2> raster_kernels =
+    {{
+      { make_raster_kernel_table<false, Framebuffer_layout::linear> (), make_raster_kernel_table<true, Framebuffer_layout::linear> () },
+      { make_raster_kernel_table<false, Framebuffer_layout::tiled> (), make_raster_kernel_table<true, Framebuffer_layout::tiled> () },
+    }};
+
+  inline Raster_kernels const &
+  get_raster_kernels (Renderer_context const *context)
+  {
+    Framebuffer const *framebuffer = context->framebuffer;
+    Raster_kernel_table const &table = raster_kernels[(size_t) framebuffer->layout][framebuffer->stats != nullptr];
+    return table[(size_t) framebuffer->format][(size_t) context->blend_mode];
+  }
+};
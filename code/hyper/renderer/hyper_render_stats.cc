@@ -0,0 +1,158 @@
+#include "hyper_render_stats.hh"
+#include "hyper_colour.hh"
+#include "hyper_math.hh"
+#include "hyper_renderer.hh"
+
+#include <stdio.h>
+#include <cstring>
+
+namespace hyper
+{
+  static char const *const render_primitive_names[] =
+    {
+      "background", "triangle_outline", "triangle_filled", "triangle_shaded", "polygon_filled",
+      "circle_outline", "circle_filled", "line", "quad_filled", "text",
+    };
+
+  static_assert (sizeof (render_primitive_names) / sizeof (render_primitive_names[0]) == (size_t) Render_primitive::count);
+
+  // By write count, the last one for everything past it
+  static constexpr Colour heatmap_colours[] =
+    {
+      { 0, 0, 0, 255 },
+      { 0, 0, 192, 255 },
+      { 0, 160, 0, 255 },
+      { 224, 224, 0, 255 },
+      { 255, 128, 0, 255 },
+      { 224, 0, 0, 255 },
+      { 255, 255, 255, 255 },
+    };
+
+  static constexpr size_t heatmap_colour_count = sizeof (heatmap_colours) / sizeof (heatmap_colours[0]);
+
+  void
+  render_stats_init (Render_stats &stats, Framebuffer const &framebuffer, std::pmr::memory_resource *resource)
+  {
+    std::memset (stats.frame.data (), 0, sizeof (stats.frame));
+    std::memset (stats.total.data (), 0, sizeof (stats.total));
+    stats.frames = 0;
+    stats.primitive = Render_primitive::background;
+    stats.overdraw = std::pmr::vector<u8> (resource);
+    stats.overdraw.resize ((size_t) framebuffer.max_width * (size_t) framebuffer.max_height);
+    stats.heatmap = false;
+  }
+
+  void
+  render_stats_next_frame (Render_stats &stats, Framebuffer const &framebuffer)
+  {
+    std::memset (stats.frame.data (), 0, sizeof (stats.frame));
+    ++stats.frames;
+
+    if (stats.heatmap)
+      std::memset (stats.overdraw.data (), 0, (size_t) framebuffer.width * (size_t) framebuffer.height);
+  }
+
+  void
+  render_stats_add_span (Render_stats &stats, Framebuffer const &framebuffer, i32 y, i32 x_start, i32 x_end)
+  {
+    if (x_start > x_end)
+      return;
+
+    // Far away shapes can ask for more than fits in an i32
+    u64 const requested = (u64) ((i64) x_end - (i64) x_start + 1);
+    u64 written = 0;
+
+    if (y >= 0 && y < framebuffer.height)
+      {
+        x_start = hyper::max (x_start, 0);
+        x_end = hyper::min (x_end, framebuffer.width - 1);
+
+        if (x_start <= x_end)
+          written = (u64) (x_end - x_start + 1);
+      }
+
+    for (Render_primitive_stats *primitive : { &stats.frame[(size_t) stats.primitive], &stats.total[(size_t) stats.primitive] })
+      {
+        primitive->spans += written > 0;
+        primitive->pixels += written;
+        primitive->clipped += requested - written;
+      }
+
+    if (!stats.heatmap || !written)
+      return;
+
+    u8 *counts = &stats.overdraw[(size_t) y * (size_t) framebuffer.width + (size_t) x_start];
+    for (u64 i = 0; i < written; ++i)
+      counts[i] = (u8) (counts[i] + (counts[i] < 255));
+  }
+
+  void
+  render_stats_print (Render_stats const &stats)
+  {
+    f64 const frames = (f64) hyper::max (stats.frames, (u64) 1);
+
+    fprintf (stderr, "render stats over %llu frames, per frame\n", (unsigned long long) stats.frames);
+    fprintf (stderr, "%-18s %9s %9s %9s %11s %11s\n", "primitive", "calls", "culled", "spans", "pixels", "clipped");
+
+    for (size_t primitive = 0; primitive < stats.total.size (); ++primitive)
+      {
+        Render_primitive_stats const &total = stats.total[primitive];
+        if (!total.calls)
+          continue;
+
+        fprintf (stderr, "%-18s %9.1f %9.1f %9.1f %11.0f %11.0f\n", render_primitive_names[primitive],
+                 (f64) total.calls / frames, (f64) total.culled / frames, (f64) total.spans / frames,
+                 (f64) total.pixels / frames, (f64) total.clipped / frames);
+      }
+  }
+
+  struct Heatmap_job_data
+  {
+    Framebuffer *framebuffer;
+    u8 const *counts;
+    std::array<u32, heatmap_colour_count> colours;
+  };
+
+  static void
+  draw_heatmap_rows (Heatmap_job_data const *job_data, u32 row_start, u32 row_end)
+  {
+    Framebuffer *framebuffer = job_data->framebuffer;
+
+    // The counts are linear whatever the framebuffer's layout
+    u8 const *counts = job_data->counts + (size_t) row_start * (size_t) framebuffer->width;
+    for (i32 y = (i32) row_start; y < (i32) row_end; ++y)
+      for (i32 x = 0; x < framebuffer->width; ++x)
+        framebuffer->pixels[get_pixel_index (*framebuffer, x, y)] = job_data->colours[hyper::min ((size_t) *counts++, heatmap_colour_count - 1)];
+  }
+
+  static void
+  draw_heatmap_rows_job (Job_system &, void *data, u32 row_start, u32 row_end)
+  {
+    draw_heatmap_rows (static_cast<Heatmap_job_data const *> (data), row_start, row_end);
+  }
+
+  void
+  draw_overdraw_heatmap (Renderer_context *context, Render_stats const &stats)
+  {
+    Heatmap_job_data job_data;
+    job_data.framebuffer = context->framebuffer;
+    job_data.counts = stats.overdraw.data ();
+
+    for (size_t i = 0; i < heatmap_colour_count; ++i)
+      job_data.colours[i] = get_colour_uint (context->framebuffer->format, heatmap_colours[i]);
+
+    u32 const rows = (u32) context->framebuffer->height;
+
+    // Same split as the clear
+    if (context->jobs && context->jobs->worker_count > 1)
+      jobs_parallel_for (*context->jobs, rows, 64, draw_heatmap_rows_job, &job_data);
+    else
+      draw_heatmap_rows (&job_data, 0, rows);
+  }
+
+  char const *
+  get_render_primitive_name (Render_primitive primitive)
+  {
+    return primitive < Render_primitive::count ? render_primitive_names[(size_t) primitive] : "unknown";
+  }
+};
@@ -0,0 +1,121 @@
+//
+// Where the fill rate goes. With stats on the framebuffer, the raster
+// kernels count the spans and pixels they're asked to write, per kind
+// of primitive, and what clipping threw away. A draw call that writes
+// nothing at all was culled.
+//
+// The overdraw heatmap also counts the writes to every pixel in a side
+// buffer and shows them instead of the frame, so stars under the ship
+// or a clear that all gets drawn over stand out.
+//
+// Counting goes through its own copy of the kernels, with stats off
+// it's a null check per draw. Spans the draw functions clip before
+// they get to the kernels don't show up as clipped.
+//
+#pragma once
+
+#include "hyper.hh"
+
+#include <array>
+#include <memory_resource>
+#include <vector>
+
+namespace hyper
+{
+  enum class Render_primitive
+    {
+      background,
+      triangle_outline,
+      triangle_filled,
+      triangle_shaded,
+      polygon_filled,
+      circle_outline,
+      circle_filled,
+      line,
+      quad_filled,
+      text,
+
+      count
+    };
+
+  struct Render_primitive_stats
+  {
+    u64 calls;
+    // Calls that didn't write a single pixel
+    u64 culled;
+    // That wrote something, a plotted pixel is a span of one
+    u64 spans;
+    u64 pixels;
+    // Asked for but outside the framebuffer
+    u64 clipped;
+  };
+
+  struct Render_stats
+  {
+    std::array<Render_primitive_stats, (size_t) Render_primitive::count> frame;
+    std::array<Render_primitive_stats, (size_t) Render_primitive::count> total;
+    u64 frames;
+    // What the kernels are drawing for, the draw functions set it
+    Render_primitive primitive;
+    // Writes to every pixel this frame, saturated, rows packed like the
+    // framebuffer's. Only counted with the heatmap on.
+    std::pmr::vector<u8> overdraw;
+    bool heatmap;
+  };
+
+  // The overdraw buffer fits the framebuffer at full size
+  void render_stats_init (Render_stats &, Framebuffer const &, std::pmr::memory_resource *);
+
+  // Call it before the frame is drawn, the last frame's counts are
+  // cleared
+  void render_stats_next_frame (Render_stats &, Framebuffer const &);
+
+  // Both ends included, clipped here
+  void render_stats_add_span (Render_stats &, Framebuffer const &, i32, i32, i32);
+
+  // Totals per frame for every primitive drawn, to stderr
+  void render_stats_print (Render_stats const &);
+
+  // Replaces the frame with the overdraw counts, black is nothing
+  // written, then blue, green, yellow, orange and red for 5 writes, white
+  // past that
+  void draw_overdraw_heatmap (Renderer_context *, Render_stats const &);
+
+  char const *get_render_primitive_name (Render_primitive);
+
+  // Counts the draw call and points the kernels at its primitive,
+  // nothing happens when there are no stats
+  class Render_stats_scope
+  {
+  public:
+    Render_stats_scope (Render_stats *stats_to_add_to, Render_primitive primitive_to_count)
+      : stats {stats_to_add_to}, primitive {primitive_to_count}, pixels {0}
+    {
+      if (!stats)
+        return;
+
+      Render_primitive_stats &frame = stats->frame[(size_t) primitive];
+      ++frame.calls;
+      ++stats->total[(size_t) primitive].calls;
+      pixels = frame.pixels;
+      stats->primitive = primitive;
+    }
+
+    ~Render_stats_scope ()
+    {
+      if (!stats || stats->frame[(size_t) primitive].pixels != pixels)
+        return;
+
+      ++stats->frame[(size_t) primitive].culled;
+      ++stats->total[(size_t) primitive].culled;
+    }
+
+    Render_stats_scope (Render_stats_scope const &) = delete;
+    Render_stats_scope &operator= (Render_stats_scope const &) = delete;
+
+  private:
+    Render_stats *stats;
+    Render_primitive primitive;
+    u64 pixels;
+  };
+};
@@ -4,10 +4,14 @@
 // world and screen coordinates.
 //
 #include "hyper_renderer.hh"
+#include "hyper_raster_kernels.hh"
 #include "hyper_stack_arena.hh"
+#include "hyper_perf_counters.hh"
+#include "hyper_render_stats.hh"
 
 #include <immintrin.h>
 #include <cassert>
+#include <cstring>
 
 namespace hyper
 {
@@ -17,12 +21,6 @@ namespace hyper
     return 8;
   }
 
-  static inline void
-  set_pixel_colour (Framebuffer *framebuffer, i32 x, i32 y, u32 colour)
-  {
-    framebuffer->pixels[y * framebuffer->width + x] = colour;
-  }
-
   static inline void
   set_pixels_colour_unaligned_simd (u32 *row, u32 colour, size_t chunks)
   {
@@ -36,7 +34,7 @@ namespace hyper
   }
 
   static void
-  draw_horizontal_line_bresenham (Framebuffer *framebuffer, Vec2<i32> p0, Vec2<i32> p1, u32 colour, i32 dx, i32 dy, i32 dy_abs)
+  draw_horizontal_line_bresenham (Framebuffer *framebuffer, Pixel_function plot, Vec2<i32> p0, Vec2<i32> p1, u32 colour, i32 dx, i32 dy, i32 dy_abs)
   {
     if (p1.x < p0.x)
       {
@@ -54,7 +52,7 @@ namespace hyper
     // TODO: simd
     for (i32 x = p0.x; x <= p1.x; ++x)
       {
-        set_pixel_colour (framebuffer, x, y, colour);
+        plot (framebuffer, x, y, colour);
 
         if (D > 0)
           {
@@ -68,7 +66,7 @@ namespace hyper
   }
 
   static void
-  draw_vertical_line_bresenham (Framebuffer *framebuffer, Vec2<i32> p0, Vec2<i32> p1, u32 colour, i32 dx, i32 dy, i32 dy_abs)
+  draw_vertical_line_bresenham (Framebuffer *framebuffer, Pixel_function plot, Vec2<i32> p0, Vec2<i32> p1, u32 colour, i32 dx, i32 dy, i32 dy_abs)
   {
     hyper::swap (p0.x, p0.y);
     hyper::swap (p1.x, p1.y);
@@ -90,7 +88,7 @@ namespace hyper
     // TODO: SIMD
     for (i32 x = p0.x; x <= p1.x; ++x)
       {
-        set_pixel_colour (framebuffer, y, x, colour);
+        plot (framebuffer, y, x, colour);
 
         if (D > 0)
           {
@@ -104,7 +102,7 @@ namespace hyper
   }
 
   static void
-  draw_line_bresenham (Framebuffer *framebuffer, Vec2<i32> p0, Vec2<i32> p1, u32 colour)
+  draw_line_bresenham (Framebuffer *framebuffer, Pixel_function plot, Vec2<i32> p0, Vec2<i32> p1, u32 colour)
   {
     i32 const dx = p1.x - p0.x;
     i32 const dy = p1.y - p0.y;
@@ -113,23 +111,23 @@ namespace hyper
     bool const steep = dy_abs > dx_abs;
 
     if (steep)
-      draw_vertical_line_bresenham (framebuffer, p0, p1, colour, dx, dy, dy_abs);
+      draw_vertical_line_bresenham (framebuffer, plot, p0, p1, colour, dx, dy, dy_abs);
     else
-      draw_horizontal_line_bresenham (framebuffer, p0, p1, colour, dx, dy, dy_abs);
+      draw_horizontal_line_bresenham (framebuffer, plot, p0, p1, colour, dx, dy, dy_abs);
   }
 
   static void
-  draw_line_pixels (Framebuffer *framebuffer, Vec2<i32> p0, Vec2<i32> p1, u32 colour)
+  draw_line_pixels (Framebuffer *framebuffer, Pixel_function plot, Vec2<i32> p0, Vec2<i32> p1, u32 colour)
   {
-    draw_line_bresenham (framebuffer, p0, p1, colour);
+    draw_line_bresenham (framebuffer, plot, p0, p1, colour);
   }
 
   static void
-  draw_triangle_outline_pixels (Framebuffer *framebuffer, std::array<Vec2<i32>, 3> const& triangle, u32 colour)
+  draw_triangle_outline_pixels (Framebuffer *framebuffer, Pixel_function plot, std::array<Vec2<i32>, 3> const& triangle, u32 colour)
   {
-    draw_line_pixels (framebuffer, triangle[0], triangle[1], colour);
-    draw_line_pixels (framebuffer, triangle[1], triangle[2], colour);
-    draw_line_pixels (framebuffer, triangle[2], triangle[0], colour);
+    draw_line_pixels (framebuffer, plot, triangle[0], triangle[1], colour);
+    draw_line_pixels (framebuffer, plot, triangle[1], triangle[2], colour);
+    draw_line_pixels (framebuffer, plot, triangle[2], triangle[0], colour);
   }
 
   static std::pmr::vector<i32>
@@ -178,39 +176,669 @@ namespace hyper
     return array0;
   }
 
-  void
-  set_background_colour (Renderer_context *context, Colour colour)
+  struct Fill_rows_job_data
   {
+    Framebuffer *framebuffer;
+    u32 colour;
+  };
+
+  static void
+  fill_rows_job (Job_system &, void *data, u32 row_start, u32 row_end)
+  {
+    auto const *job_data = static_cast<Fill_rows_job_data const *> (data);
+    size_t const width = (size_t) job_data->framebuffer->width;
+    size_t const pixels = (row_end - row_start) * width;
+    size_t const chunks = pixels / (size_t) get_simd_width ();
+    u32 *row = &job_data->framebuffer->pixels[row_start * width];
+
+    set_pixels_colour_unaligned_simd (row, job_data->colour, chunks);
+
+    // leftovers
+    for (size_t i = chunks * (size_t) get_simd_width (); i < pixels; ++i)
+      row[i] = job_data->colour;
+  }
+
+  static void
+  set_background_colour_uint (Renderer_context *context, u32 colour_uint)
+  {
+    Perf_counters_scope counters_scope { context->perf_counters, Perf_scope::set_background_colour };
+    Render_stats_scope stats_scope { context->framebuffer->stats, Render_primitive::background };
+
+    // Doesn't go through the kernels
+    if (context->framebuffer->stats)
+      for (i32 y = 0; y < context->framebuffer->height; ++y)
+        render_stats_add_span (*context->framebuffer->stats, *context->framebuffer, y, 0, context->framebuffer->width - 1);
+
+    if (context->jobs && context->jobs->worker_count > 1)
+      {
+        // 64 rows of 1024 pixels is 256K per job, enough to pay for it.
+        // It's one colour, so tiles are just as many rows' worth.
+        Fill_rows_job_data job_data { context->framebuffer, colour_uint };
+        jobs_parallel_for (*context->jobs, (u32) framebuffer_get_rows (*context->framebuffer), 64, fill_rows_job, &job_data);
+        return;
+      }
+
     set_pixels_colour_unaligned_simd (context->framebuffer->pixels.data (),
-                                      get_colour_uint (colour),
+                                      colour_uint,
                                       context->framebuffer->simd_chunks);
   }
 
+  void
+  framebuffer_set_format (Framebuffer *framebuffer, Pixel_format format)
+  {
+    framebuffer->format = format;
+
+    for (i32 preset = 0; preset < Colour_preset::COUNT; ++preset)
+      framebuffer->preset_colours[preset] = get_colour_uint (format, get_colour_from_preset ((Colour_preset) preset));
+  }
+
+  f32
+  framebuffer_set_render_scale (Framebuffer *framebuffer, f32 scale)
+  {
+    i32 const simd_width = get_simd_width ();
+    i32 width = (i32) ((f32) framebuffer->max_width * hyper::min (hyper::max (scale, 0.0f), 1.0f));
+    width = hyper::max (width - width % simd_width, simd_width);
+    width = hyper::min (width, framebuffer->max_width);
+
+    // Same aspect ratio, otherwise the stretch at present would show
+    framebuffer->width = width;
+    framebuffer->height = hyper::max ((framebuffer->max_height * width) / framebuffer->max_width, 1);
+    framebuffer->pitch = width * (i32) sizeof (u32);
+    framebuffer->simd_chunks = ((size_t) width * (size_t) framebuffer_get_rows (*framebuffer)) / (size_t) simd_width;
+
+    return (f32) width / (f32) framebuffer->max_width;
+  }
+
+  void
+  framebuffer_set_layout (Framebuffer *framebuffer, Framebuffer_layout layout)
+  {
+    framebuffer->layout = layout;
+    framebuffer->simd_chunks = ((size_t) framebuffer->width * (size_t) framebuffer_get_rows (*framebuffer)) / (size_t) get_simd_width ();
+  }
+
+  i32
+  framebuffer_get_rows (Framebuffer const &framebuffer)
+  {
+    if (framebuffer.layout == Framebuffer_layout::linear)
+      return framebuffer.height;
+
+    return (framebuffer.height + framebuffer_tile_size - 1) & ~(framebuffer_tile_size - 1);
+  }
+
+  // Rows y_start to y_end, y_start on a tile's edge
+  static void
+  copy_linear_rows (Framebuffer const &framebuffer, u32 *destination, i32 pitch, i32 y_start, i32 y_end)
+  {
+    u32 const *source = framebuffer.pixels.data ();
+    size_t const row_size = (size_t) framebuffer.width * sizeof (u32);
+
+    if (framebuffer.layout == Framebuffer_layout::linear)
+      {
+        for (i32 y = y_start; y < y_end; ++y)
+          memcpy ((u8 *) destination + (size_t) y * (size_t) pitch, source + (size_t) y * (size_t) framebuffer.width, row_size);
+
+        return;
+      }
+
+    // A row of tiles at a time, read in order, a tile's row is one
+    // register and goes to 8 destination rows. The last row of tiles
+    // can hang off the bottom.
+    static_assert (framebuffer_tile_size == 8, "a tile's row is one AVX register");
+
+    for (i32 tile_y = y_start; tile_y < y_end; tile_y += framebuffer_tile_size)
+      {
+        i32 const rows = hyper::min (framebuffer_tile_size, y_end - tile_y);
+        u32 const *tile = source + (size_t) tile_y * (size_t) framebuffer.width;
+        u8 *row = (u8 *) destination + (size_t) tile_y * (size_t) pitch;
+
+        for (i32 x = 0; x < framebuffer.width; x += framebuffer_tile_size)
+          {
+            for (i32 i = 0; i < rows; ++i)
+              _mm256_storeu_si256 ((__m256i *) (row + (size_t) i * (size_t) pitch + (size_t) x * sizeof (u32)),
+                                   _mm256_loadu_si256 ((__m256i const *) (tile + i * framebuffer_tile_size)));
+
+            tile += framebuffer_tile_size * framebuffer_tile_size;
+          }
+      }
+  }
+
+  struct Copy_linear_job_data
+  {
+    Framebuffer const *framebuffer;
+    u32 *destination;
+    i32 pitch;
+  };
+
+  // The range is in bands of a tile's height, so tiles are never split
+  static void
+  copy_linear_job (Job_system &, void *data, u32 band_start, u32 band_end)
+  {
+    auto const *job_data = static_cast<Copy_linear_job_data const *> (data);
+    i32 const y_end = hyper::min ((i32) band_end * framebuffer_tile_size, job_data->framebuffer->height);
+
+    copy_linear_rows (*job_data->framebuffer, job_data->destination, job_data->pitch, (i32) band_start * framebuffer_tile_size, y_end);
+  }
+
+  void
+  framebuffer_copy_linear (Framebuffer const &framebuffer, u32 *destination, i32 pitch, Job_system *jobs)
+  {
+    if (jobs && jobs->worker_count > 1)
+      {
+        // 8 bands of 8 rows, as many rows per job as the clear
+        Copy_linear_job_data job_data { &framebuffer, destination, pitch };
+        u32 const bands = (u32) ((framebuffer.height + framebuffer_tile_size - 1) / framebuffer_tile_size);
+        jobs_parallel_for (*jobs, bands, 8, copy_linear_job, &job_data);
+        return;
+      }
+
+    copy_linear_rows (framebuffer, destination, pitch, 0, framebuffer.height);
+  }
+
+  void
+  set_background_colour (Renderer_context *context, Colour colour)
+  {
+    set_background_colour_uint (context, get_raster_kernels (context).pack_colour (colour));
+  }
+
+  void
+  set_background_colour (Renderer_context *context, Colour_preset preset)
+  {
+    set_background_colour_uint (context, context->framebuffer->preset_colours[preset]);
+  }
+
   static inline void
-  plot_points (Framebuffer *framebuffer, i32 circle_center_x, i32 circle_center_y, i32 px, i32 py, u32 colour)
+  plot_points (Framebuffer *framebuffer, Pixel_function plot, i32 circle_center_x, i32 circle_center_y, i32 px, i32 py, u32 colour)
   {
     // each point I compute gives me 8 points on the circle (symmetry)
     // octant 1
-    set_pixel_colour(framebuffer, (circle_center_x + px), (circle_center_y + py), colour);
+    plot (framebuffer, (circle_center_x + px), (circle_center_y + py), colour);
     // octant 2
-    set_pixel_colour(framebuffer, (circle_center_x + py), (circle_center_y + px), colour);
+    plot (framebuffer, (circle_center_x + py), (circle_center_y + px), colour);
     // octant 3
-    set_pixel_colour(framebuffer, (circle_center_x - py), (circle_center_y + px), colour);
+    plot (framebuffer, (circle_center_x - py), (circle_center_y + px), colour);
     // octant 4
-    set_pixel_colour(framebuffer, (circle_center_x - px), (circle_center_y + py), colour);
+    plot (framebuffer, (circle_center_x - px), (circle_center_y + py), colour);
     // octant 5
-    set_pixel_colour(framebuffer, (circle_center_x - px), (circle_center_y - py), colour);
+    plot (framebuffer, (circle_center_x - px), (circle_center_y - py), colour);
     // octant 6
-    set_pixel_colour(framebuffer, (circle_center_x - py), (circle_center_y - px), colour);
+    plot (framebuffer, (circle_center_x - py), (circle_center_y - px), colour);
     // octant 7
-    set_pixel_colour(framebuffer, (circle_center_x + py), (circle_center_y - px), colour);
+    plot (framebuffer, (circle_center_x + py), (circle_center_y - px), colour);
     // octant 8
-    set_pixel_colour(framebuffer, (circle_center_x + px), (circle_center_y - py), colour);
+    plot (framebuffer, (circle_center_x + px), (circle_center_y - py), colour);
+  }
+
+  // Anti-aliasing. Scanlines are sampled on a few rows and the coverage
+  // along each row is exact, so only the pixels an edge goes through get
+  // blended by coverage, everything between them is a normal span.
+  inline constexpr i32 coverage_samples = 4;
+  // Coverage is worked out this many pixels at a time, on the stack
+  inline constexpr i32 coverage_chunk = 256;
+  // Interiors narrower than this are blended along with their edges,
+  // one kernel call is cheaper than three for thin shapes
+  inline constexpr i32 coverage_min_span = 16;
+
+  // Where a shape crosses each sample row of a scanline, sorted, it's
+  // inside between each pair
+  struct Coverage_scanline
+  {
+    std::array<f32 const *, coverage_samples> crossings;
+    std::array<u32, coverage_samples> counts;
+  };
+
+  static inline f32
+  get_sample_y (i32 y, i32 sample)
+  {
+    return (f32) y + ((f32) sample + 0.5f) / (f32) coverage_samples;
+  }
+
+  // Blends the pixels from x_start to x_end, which have to be inside the
+  // framebuffer, by how much the pairs from pair_start up to pair_end
+  // cover them on every sample row
+  static void
+  blend_coverage (Framebuffer *framebuffer, Coverage_span_function blend, Coverage_scanline const &scanline,
+                  u32 pair_start, u32 pair_end, i32 y, i32 x_start, i32 x_end, u32 colour)
+  {
+    // Each crossing is a step, all the pixels right of it are in (or out)
+    // and the one it's in partly. Steps go in as differences and a
+    // running sum adds them up, so it's one pass whatever the crossings.
+    f32 steps[coverage_chunk + 2];
+    // The kernel reads whole groups of 8, what's past the end is masked
+    u8 coverage[coverage_chunk + 8];
+
+    for (i32 chunk_start = x_start; chunk_start <= x_end; chunk_start += coverage_chunk)
+      {
+        i32 const chunk_end = hyper::min (chunk_start + coverage_chunk - 1, x_end);
+        i32 const count = chunk_end - chunk_start + 1;
+        // Relative to the chunk, whatever's outside it doesn't count
+        auto const add_step = [&] (f32 x, f32 sign)
+        {
+          x = hyper::clamp (x - (f32) chunk_start, 0.0f, (f32) count);
+          i32 const pixel = static_cast<i32> (x);
+          f32 const fraction = x - (f32) pixel;
+
+          steps[pixel] += sign - sign * fraction;
+          steps[pixel + 1] += sign * fraction;
+        };
+
+        for (i32 i = 0; i < count + 2; ++i)
+          steps[i] = 0.0f;
+
+        for (i32 sample = 0; sample < coverage_samples; ++sample)
+          {
+            f32 const *crossings = scanline.crossings[(size_t) sample];
+            u32 const end = hyper::min (pair_end, scanline.counts[(size_t) sample] >> 1);
+
+            for (u32 pair = pair_start; pair < end; ++pair)
+              {
+                add_step (crossings[pair * 2], 1.0f);
+                add_step (crossings[pair * 2 + 1], -1.0f);
+              }
+          }
+
+        f32 sum = 0.0f;
+        for (i32 i = 0; i < count; ++i)
+          {
+            sum += steps[i];
+            coverage[i] = static_cast<u8> (hyper::clamp (sum, 0.0f, (f32) coverage_samples) * (255.0f / (f32) coverage_samples) + 0.5f);
+          }
+
+        blend (framebuffer, y, chunk_start, chunk_end, colour, coverage);
+      }
+  }
+
+  // Same for a single pair, the common case. Each sample row's crossings
+  // are spread over 8 pixels at a time, so there's no per pixel loop.
+  static void
+  blend_pair_coverage (Framebuffer *framebuffer, Coverage_span_function blend, __m128 lefts, __m128 rights,
+                       i32 y, i32 x_start, i32 x_end, u32 colour)
+  {
+    static_assert (coverage_samples == 4, "one lane per sample row");
+
+    // 8 more so the last group can be stored whole
+    alignas (8) u8 coverage[coverage_chunk + 8];
+    __m256 sample_lefts[coverage_samples];
+    __m256 sample_rights[coverage_samples];
+    __m256 const zero = _mm256_setzero_ps ();
+    __m256 const one = _mm256_set1_ps (1.0f);
+    __m256 const scale = _mm256_set1_ps (255.0f / (f32) coverage_samples);
+    __m256 const lanes = _mm256_setr_ps (0.0f, 1.0f, 2.0f, 3.0f, 4.0f, 5.0f, 6.0f, 7.0f);
+
+    alignas (16) f32 left_lanes[coverage_samples];
+    alignas (16) f32 right_lanes[coverage_samples];
+    _mm_store_ps (left_lanes, lefts);
+    _mm_store_ps (right_lanes, rights);
+
+    for (size_t sample = 0; sample < coverage_samples; ++sample)
+      {
+        sample_lefts[sample] = _mm256_set1_ps (left_lanes[sample]);
+        sample_rights[sample] = _mm256_set1_ps (right_lanes[sample]);
+      }
+
+    for (i32 chunk_start = x_start; chunk_start <= x_end; chunk_start += coverage_chunk)
+      {
+        i32 const chunk_end = hyper::min (chunk_start + coverage_chunk - 1, x_end);
+
+        for (i32 x = chunk_start; x <= chunk_end; x += 8)
+          {
+            __m256 const pixels = _mm256_add_ps (_mm256_set1_ps ((f32) x), lanes);
+            __m256 const pixels_end = _mm256_add_ps (pixels, one);
+            __m256 covered = zero;
+
+            for (size_t sample = 0; sample < coverage_samples; ++sample)
+              {
+                __m256 const inside = _mm256_sub_ps (_mm256_min_ps (sample_rights[sample], pixels_end), _mm256_max_ps (sample_lefts[sample], pixels));
+                covered = _mm256_add_ps (covered, _mm256_max_ps (inside, zero));
+              }
+
+            // Rounded to 0 - 255, then 32 bit lanes down to bytes
+            __m256i const words = _mm256_cvtps_epi32 (_mm256_mul_ps (covered, scale));
+            __m128i const packed = _mm_packus_epi32 (_mm256_castsi256_si128 (words), _mm256_extracti128_si256 (words, 1));
+            _mm_storel_epi64 ((__m128i *) &coverage[x - chunk_start], _mm_packus_epi16 (packed, packed));
+          }
+
+        blend (framebuffer, y, chunk_start, chunk_end, colour, coverage);
+      }
+  }
+
+  static inline f32
+  get_min_lane (__m128 lanes)
+  {
+    lanes = _mm_min_ps (lanes, _mm_movehl_ps (lanes, lanes));
+    return _mm_cvtss_f32 (_mm_min_ss (lanes, _mm_shuffle_ps (lanes, lanes, 1)));
+  }
+
+  static inline f32
+  get_max_lane (__m128 lanes)
+  {
+    lanes = _mm_max_ps (lanes, _mm_movehl_ps (lanes, lanes));
+    return _mm_cvtss_f32 (_mm_max_ss (lanes, _mm_shuffle_ps (lanes, lanes, 1)));
+  }
+
+  // Inside from the left to the right crossing on each sample row, a
+  // lane each. Rows that miss the shape can have both at the same place.
+  static void
+  fill_coverage_pair (Framebuffer *framebuffer, Raster_kernels const &kernels, __m128 lefts, __m128 rights, i32 y, u32 colour)
+  {
+    // Far away crossings turn into pixels safely, and still land
+    // outside the framebuffer
+    __m128 const x_min = _mm_set1_ps (-1.0f);
+    __m128 const x_max = _mm_set1_ps ((f32) framebuffer->width + 1.0f);
+    lefts = _mm_min_ps (_mm_max_ps (lefts, x_min), x_max);
+    rights = _mm_min_ps (_mm_max_ps (rights, x_min), x_max);
+
+    i32 const outer_start = hyper::max (static_cast<i32> (hyper::floor (get_min_lane (lefts))), 0);
+    i32 const outer_end = hyper::min (static_cast<i32> (hyper::ceil (get_max_lane (rights))) - 1, framebuffer->width - 1);
+    // Fully covered on every sample row between these
+    i32 const inner_start = static_cast<i32> (hyper::ceil (get_max_lane (lefts)));
+    i32 const inner_end = static_cast<i32> (hyper::floor (get_min_lane (rights))) - 1;
+
+    if (outer_start > outer_end)
+      return;
+
+    if (inner_end - inner_start + 1 < coverage_min_span)
+      {
+        blend_pair_coverage (framebuffer, kernels.coverage_span, lefts, rights, y, outer_start, outer_end, colour);
+        return;
+      }
+
+    blend_pair_coverage (framebuffer, kernels.coverage_span, lefts, rights, y, outer_start, inner_start - 1, colour);
+    kernels.span (framebuffer, y, hyper::max (inner_start, 0), hyper::min (inner_end, framebuffer->width - 1), colour);
+    blend_pair_coverage (framebuffer, kernels.coverage_span, lefts, rights, y, inner_end + 1, outer_end, colour);
+  }
+
+  static void
+  fill_coverage_scanline (Framebuffer *framebuffer, Raster_kernels const &kernels, Coverage_scanline const &scanline, i32 y, u32 colour)
+  {
+    u32 const count = scanline.counts[0];
+    bool same_counts = count % 2 == 0;
+    for (u32 sample_count : scanline.counts)
+      same_counts = same_counts && sample_count == count;
+
+    if (!same_counts)
+      {
+        // A vertex is on this scanline, the pairs don't line up so
+        // everything it touches gets blended
+        f32 left = (f32) framebuffer->width;
+        f32 right = 0.0f;
+
+        for (size_t sample = 0; sample < coverage_samples; ++sample)
+          {
+            u32 const sample_count = scanline.counts[sample];
+            if (sample_count < 2)
+              continue;
+
+            left = hyper::min (left, scanline.crossings[sample][0]);
+            right = hyper::max (right, scanline.crossings[sample][sample_count - 1]);
+          }
+
+        // Clamped first so far away crossings convert safely
+        i32 const x_start = static_cast<i32> (hyper::floor (hyper::max (left, 0.0f)));
+        i32 const x_end = static_cast<i32> (hyper::ceil (hyper::min (right, (f32) framebuffer->width))) - 1;
+
+        if (x_start <= x_end)
+          blend_coverage (framebuffer, kernels.coverage_span, scanline, 0, ~0u, y, x_start, x_end, colour);
+
+        return;
+      }
+
+    for (u32 pair = 0; pair < count >> 1; ++pair)
+      fill_coverage_pair (framebuffer, kernels,
+                          _mm_setr_ps (scanline.crossings[0][pair * 2], scanline.crossings[1][pair * 2],
+                                       scanline.crossings[2][pair * 2], scanline.crossings[3][pair * 2]),
+                          _mm_setr_ps (scanline.crossings[0][pair * 2 + 1], scanline.crossings[1][pair * 2 + 1],
+                                       scanline.crossings[2][pair * 2 + 1], scanline.crossings[3][pair * 2 + 1]),
+                          y, colour);
+  }
+
+  struct Coverage_edge
+  {
+    // Top to bottom
+    f32 x0;
+    f32 y0;
+    f32 y1;
+    f32 x_step;
+  };
+
+  // Any polygon, in screen coordinates. Scanlines without a vertex on
+  // them, nearly all of them, pair up their edges straight away.
+  static void
+  fill_polygon_coverage (Renderer_context *context, Vec2<f32> const *vertices, u32 vertex_count, u32 colour)
+  {
+    Framebuffer *framebuffer = context->framebuffer;
+    auto *edges = static_cast<Coverage_edge *> (context->stack_arena->resource.allocate (vertex_count * sizeof (Coverage_edge), alignof (Coverage_edge)));
+    auto *active = static_cast<Coverage_edge **> (context->stack_arena->resource.allocate (vertex_count * sizeof (Coverage_edge *), alignof (Coverage_edge *)));
+    auto *active_crossings = static_cast<__m128 *> (context->stack_arena->resource.allocate (vertex_count * sizeof (__m128), alignof (__m128)));
+    auto *crossings = static_cast<f32 *> (context->stack_arena->resource.allocate (coverage_samples * vertex_count * sizeof (f32), alignof (f32)));
+    u32 edge_count = 0;
+    f32 y_max = 0.0f;
+
+    for (u32 i = 0; i < vertex_count; ++i)
+      {
+        Vec2<f32> a = vertices[i];
+        Vec2<f32> b = vertices[(i + 1) % vertex_count];
+
+        if (b.y < a.y)
+          hyper::swap (a, b);
+
+        // Horizontal edges don't cross any sample row
+        if (!(a.y < b.y))
+          continue;
+
+        edges[edge_count++] = { a.x, a.y, b.y, (b.x - a.x) / (b.y - a.y) };
+        y_max = hyper::max (y_max, b.y);
+      }
+
+    if (edge_count < 2)
+      return;
+
+    // Sorted by top, there's only a handful of them
+    for (u32 i = 1; i < edge_count; ++i)
+      {
+        Coverage_edge const edge = edges[i];
+        u32 j = i;
+
+        for (; j > 0 && edges[j - 1].y0 > edge.y0; --j)
+          edges[j] = edges[j - 1];
+
+        edges[j] = edge;
+      }
+
+    Raster_kernels const &kernels = get_raster_kernels (context);
+    Coverage_scanline scanline;
+    for (size_t sample = 0; sample < coverage_samples; ++sample)
+      scanline.crossings[sample] = crossings + sample * vertex_count;
+
+    __m128 const offsets = _mm_setr_ps (get_sample_y (0, 0), get_sample_y (0, 1), get_sample_y (0, 2), get_sample_y (0, 3));
+    i32 const y_start = static_cast<i32> (hyper::floor (hyper::clamp (edges[0].y0, 0.0f, (f32) framebuffer->height)));
+    i32 const y_end = static_cast<i32> (hyper::ceil (hyper::min (y_max, (f32) framebuffer->height))) - 1;
+    u32 next_edge = 0;
+    u32 active_count = 0;
+
+    for (i32 y = y_start; y <= y_end; ++y)
+      {
+        f32 const first_sample_y = get_sample_y (y, 0);
+        f32 const last_sample_y = get_sample_y (y, coverage_samples - 1);
+
+        while (next_edge < edge_count && edges[next_edge].y0 <= last_sample_y)
+          active[active_count++] = &edges[next_edge++];
+
+        u32 kept = 0;
+        bool vertex_here = false;
+        for (u32 i = 0; i < active_count; ++i)
+          {
+            if (active[i]->y1 <= first_sample_y)
+              continue;
+
+            active[kept++] = active[i];
+            vertex_here = vertex_here || active[i]->y0 > first_sample_y || active[i]->y1 <= last_sample_y;
+          }
+        active_count = kept;
+
+        if (vertex_here)
+          {
+            for (i32 sample = 0; sample < coverage_samples; ++sample)
+              {
+                f32 const sample_y = get_sample_y (y, sample);
+                f32 *sample_crossings = crossings + (u32) sample * vertex_count;
+                u32 count = 0;
+
+                for (u32 i = 0; i < active_count; ++i)
+                  {
+                    Coverage_edge const &edge = *active[i];
+                    if (sample_y < edge.y0 || sample_y >= edge.y1)
+                      continue;
+
+                    // Sorted as they come in
+                    f32 const x = edge.x0 + (sample_y - edge.y0) * edge.x_step;
+                    u32 j = count++;
+
+                    for (; j > 0 && sample_crossings[j - 1] > x; --j)
+                      sample_crossings[j] = sample_crossings[j - 1];
+
+                    sample_crossings[j] = x;
+                  }
+
+                scanline.counts[(size_t) sample] = count;
+              }
+
+            fill_coverage_scanline (framebuffer, kernels, scanline, y, colour);
+            continue;
+          }
+
+        // Every edge crosses every sample row and they can't cross each
+        // other in between, so sorted by the first row they're sorted
+        // on all of them
+        __m128 const sample_ys = _mm_add_ps (_mm_set1_ps ((f32) y), offsets);
+        for (u32 i = 0; i < active_count; ++i)
+          {
+            Coverage_edge const &edge = *active[i];
+            __m128 const x = _mm_add_ps (_mm_set1_ps (edge.x0), _mm_mul_ps (_mm_sub_ps (sample_ys, _mm_set1_ps (edge.y0)), _mm_set1_ps (edge.x_step)));
+            f32 const first_x = _mm_cvtss_f32 (x);
+            u32 j = i;
+
+            for (; j > 0 && _mm_cvtss_f32 (active_crossings[j - 1]) > first_x; --j)
+              active_crossings[j] = active_crossings[j - 1];
+
+            active_crossings[j] = x;
+          }
+
+        for (u32 i = 0; i + 1 < active_count; i += 2)
+          fill_coverage_pair (framebuffer, kernels, active_crossings[i], active_crossings[i + 1], y, colour);
+      }
+  }
+
+  static void
+  fill_circle_coverage (Renderer_context *context, f32 center_x, f32 center_y, f32 radius, u32 colour)
+  {
+    Framebuffer *framebuffer = context->framebuffer;
+    Raster_kernels const &kernels = get_raster_kernels (context);
+
+    // Sample rows off the circle get no width, so the pair is always
+    // there and the scanline doesn't have to sort anything out
+    __m128 const offsets = _mm_setr_ps (get_sample_y (0, 0), get_sample_y (0, 1), get_sample_y (0, 2), get_sample_y (0, 3));
+    __m128 const radius_squared = _mm_set1_ps (radius * radius);
+    __m128 const centers = _mm_set1_ps (center_x);
+    i32 const y_start = static_cast<i32> (hyper::floor (hyper::clamp (center_y - radius, 0.0f, (f32) framebuffer->height)));
+    i32 const y_end = static_cast<i32> (hyper::ceil (hyper::min (center_y + radius, (f32) framebuffer->height))) - 1;
+
+    for (i32 y = y_start; y <= y_end; ++y)
+      {
+        __m128 const dy = _mm_sub_ps (_mm_add_ps (_mm_set1_ps ((f32) y), offsets), _mm_set1_ps (center_y));
+        __m128 const widths = _mm_sqrt_ps (_mm_max_ps (_mm_sub_ps (radius_squared, _mm_mul_ps (dy, dy)), _mm_setzero_ps ()));
+
+        fill_coverage_pair (framebuffer, kernels, _mm_sub_ps (centers, widths), _mm_add_ps (centers, widths), y, colour);
+      }
+  }
+
+  // Xiaolin Wu's, each step along the line splits the colour between
+  // the two pixels the line passes between
+  static void
+  draw_line_coverage (Framebuffer *framebuffer, Coverage_pixel_function plot, Vec2<f32> p0, Vec2<f32> p1, u32 colour)
+  {
+    // Pixel centers are on whole numbers from here
+    p0 = { p0.x - 0.5f, p0.y - 0.5f };
+    p1 = { p1.x - 0.5f, p1.y - 0.5f };
+
+    bool const steep = hyper::abs (p1.y - p0.y) > hyper::abs (p1.x - p0.x);
+    if (steep)
+      {
+        p0 = { p0.y, p0.x };
+        p1 = { p1.y, p1.x };
+      }
+
+    if (p1.x < p0.x)
+      hyper::swap (p0, p1);
+
+    f32 const dx = p1.x - p0.x;
+    f32 const gradient = dx > 0.0f ? (p1.y - p0.y) / dx : 0.0f;
+    // Steps outside the framebuffer would all be clipped
+    f32 const x_limit = (f32) (steep ? framebuffer->height : framebuffer->width);
+    f32 const y_limit = (f32) (steep ? framebuffer->width : framebuffer->height);
+    i32 const x_start = static_cast<i32> (hyper::floor (hyper::clamp (p0.x, 0.0f, x_limit) + 0.5f));
+    i32 const x_end = static_cast<i32> (hyper::floor (hyper::clamp (p1.x, -1.0f, x_limit - 1.0f) + 0.5f));
+
+    for (i32 x = x_start; x <= x_end; ++x)
+      {
+        f32 const y = p0.y + gradient * ((f32) x - p0.x);
+        f32 const y_floor = hyper::floor (y);
+        f32 const fraction = y - y_floor;
+        i32 const y_pixel = static_cast<i32> (hyper::clamp (y_floor, -2.0f, y_limit));
+        u32 const lower = static_cast<u32> (fraction * 255.0f + 0.5f);
+
+        if (steep)
+          {
+            plot (framebuffer, y_pixel, x, colour, 255 - lower);
+            plot (framebuffer, y_pixel + 1, x, colour, lower);
+          }
+        else
+          {
+            plot (framebuffer, x, y_pixel, colour, 255 - lower);
+            plot (framebuffer, x, y_pixel + 1, colour, lower);
+          }
+      }
+  }
+
+  static inline void
+  plot_coverage_points (Framebuffer *framebuffer, Coverage_pixel_function plot, i32 circle_center_x, i32 circle_center_y, i32 px, i32 py, u32 colour, u32 coverage)
+  {
+    // Same octants as plot_points
+    plot (framebuffer, (circle_center_x + px), (circle_center_y + py), colour, coverage);
+    plot (framebuffer, (circle_center_x + py), (circle_center_y + px), colour, coverage);
+    plot (framebuffer, (circle_center_x - py), (circle_center_y + px), colour, coverage);
+    plot (framebuffer, (circle_center_x - px), (circle_center_y + py), colour, coverage);
+    plot (framebuffer, (circle_center_x - px), (circle_center_y - py), colour, coverage);
+    plot (framebuffer, (circle_center_x - py), (circle_center_y - px), colour, coverage);
+    plot (framebuffer, (circle_center_x + py), (circle_center_y - px), colour, coverage);
+    plot (framebuffer, (circle_center_x + px), (circle_center_y - py), colour, coverage);
+  }
+
+  // Wu's circle, one octant split between the two pixels the edge passes
+  // between and mirrored
+  static void
+  draw_circle_coverage (Framebuffer *framebuffer, Coverage_pixel_function plot, i32 center_x, i32 center_y, f32 radius, u32 colour)
+  {
+    f32 const radius_squared = radius * radius;
+
+    for (i32 x = 0; (f32) x <= radius * 0.70710678f; ++x)
+      {
+        f32 const y = hyper::sqrt (radius_squared - (f32) x * (f32) x);
+        f32 const y_floor = hyper::floor (y);
+        u32 const outer = static_cast<u32> ((y - y_floor) * 255.0f + 0.5f);
+        i32 const y_pixel = static_cast<i32> (y_floor);
+
+        plot_coverage_points (framebuffer, plot, center_x, center_y, x, y_pixel, colour, 255 - outer);
+        plot_coverage_points (framebuffer, plot, center_x, center_y, x, y_pixel + 1, colour, outer);
+      }
   }
 
   void
   draw_triangle_outline (Renderer_context *context, std::array<Vec2<f32>, 3> const &triangle, Colour colour)
   {
+    ++context->draw_calls;
+    Perf_counters_scope counters_scope { context->perf_counters, Perf_scope::draw_triangle_outline };
+    Render_stats_scope stats_scope { context->framebuffer->stats, Render_primitive::triangle_outline };
+
     // World to screen transformation
     std::array<Vec2<f32>, 3> triangle_screen_coordinates;
     for (size_t i = 0; i < triangle.size (); ++i)
@@ -219,6 +847,17 @@ namespace hyper
         triangle_screen_coordinates[i].y = (triangle[i].y - context->camera_y) * context->camera_zoom + (static_cast<f32> (context->framebuffer->height >> 1));
       }
 
+    if (context->anti_aliasing)
+      {
+        Coverage_pixel_function const plot = get_raster_kernels (context).coverage_pixel;
+        u32 const colour_uint = get_raster_kernels (context).pack_colour (colour);
+
+        for (size_t i = 0; i < triangle_screen_coordinates.size (); ++i)
+          draw_line_coverage (context->framebuffer, plot, triangle_screen_coordinates[i], triangle_screen_coordinates[(i + 1) % 3], colour_uint);
+
+        return;
+      }
+
     // Screen to pixels
     std::array<Vec2<i32>, 3> triangle_pixel_coordinates;
     for (size_t i = 0; i < triangle_pixel_coordinates.size (); ++i)
@@ -227,12 +866,16 @@ namespace hyper
         triangle_pixel_coordinates[i].y = static_cast<i32> (hyper::floor (triangle_screen_coordinates[i].y));
       }
 
-    draw_triangle_outline_pixels (context->framebuffer, triangle_pixel_coordinates, get_colour_uint (colour));
+    draw_triangle_outline_pixels (context->framebuffer, get_raster_kernels (context).pixel, triangle_pixel_coordinates, get_raster_kernels (context).pack_colour (colour));
   }
 
   void
   draw_triangle_filled (Renderer_context *context, std::array<Vec2<f32>, 3> const &triangle, Colour colour)
   {
+    ++context->draw_calls;
+    Perf_counters_scope counters_scope { context->perf_counters, Perf_scope::draw_triangle_filled };
+    Render_stats_scope stats_scope { context->framebuffer->stats, Render_primitive::triangle_filled };
+
     // World to screen transformation
     std::array<Vec2<f32>, 3> triangle_screen_coordinates;
     for (size_t i = 0; i < triangle.size (); ++i)
@@ -241,6 +884,14 @@ namespace hyper
         triangle_screen_coordinates[i].y = (triangle[i].y - context->camera_y) * context->camera_zoom + (static_cast<f32> (context->framebuffer->height >> 1));
       }
 
+    u32 const colour_uint = get_raster_kernels (context).pack_colour (colour);
+
+    if (context->anti_aliasing)
+      {
+        fill_polygon_coverage (context, triangle_screen_coordinates.data (), 3, colour_uint);
+        return;
+      }
+
     // Screen to pixels
     std::array<Vec2<i32>, 3> triangle_pixel_coordinates;
     for (size_t i = 0; i < triangle_pixel_coordinates.size (); ++i)
@@ -249,8 +900,6 @@ namespace hyper
         triangle_pixel_coordinates[i].y = static_cast<i32> (hyper::floor (triangle_screen_coordinates[i].y));
       }
 
-    u32 const colour_uint = get_colour_uint (colour);
-
     // sort vertices so that the first vertex is always at the top
     if (triangle_pixel_coordinates[1].y < triangle_pixel_coordinates[0].y)
       hyper::swap (triangle_pixel_coordinates[0], triangle_pixel_coordinates[1]);
@@ -281,36 +930,297 @@ namespace hyper
         x_right = x012.begin ();
       }
 
+    // Only triangles crossing the border pay for clipping
+    bool inside = true;
+    for (Vec2<i32> const &vertex : triangle_pixel_coordinates)
+      inside = inside && vertex.x >= 0 && vertex.x < context->framebuffer->width && vertex.y >= 0 && vertex.y < context->framebuffer->height;
+
+    Raster_kernels const &kernels = get_raster_kernels (context);
+    Span_function const fill_span = inside ? kernels.span : kernels.span_clipped;
+
     for (i32 y = triangle_pixel_coordinates[0].y; y <= triangle_pixel_coordinates[2].y; ++y)
       {
         i32 const x_start = x_left[y - triangle_pixel_coordinates[0].y];
         i32 const x_end = x_right[y - triangle_pixel_coordinates[0].y];
-        i32 const span  = x_end - x_start + 1;
-        i32 const chunks = span / get_simd_width ();
 
-        if (chunks > 0)
+        fill_span (context->framebuffer, y, x_start, x_end, colour_uint);
+      }
+  }
+
+  void
+  draw_triangle_shaded (Renderer_context *context, std::array<Vec2<f32>, 3> const &triangle, std::array<Colour, 3> const &colours)
+  {
+    ++context->draw_calls;
+    Perf_counters_scope counters_scope { context->perf_counters, Perf_scope::draw_triangle_shaded };
+    Render_stats_scope stats_scope { context->framebuffer->stats, Render_primitive::triangle_shaded };
+
+    Framebuffer *framebuffer = context->framebuffer;
+    f32 const half_width = static_cast<f32> (framebuffer->width >> 1);
+    f32 const half_height = static_cast<f32> (framebuffer->height >> 1);
+
+    // World to screen, vertex colours as floats
+    std::array<Vec2<f32>, 3> screen;
+    std::array<std::array<f32, 4>, 3> channels;
+    for (size_t i = 0; i < triangle.size (); ++i)
+      {
+        screen[i].x = (triangle[i].x - context->camera_x) * context->camera_zoom + half_width;
+        screen[i].y = (triangle[i].y - context->camera_y) * context->camera_zoom + half_height;
+        channels[i] = { (f32) colours[i].r, (f32) colours[i].g, (f32) colours[i].b, (f32) colours[i].a };
+      }
+
+    f32 const x10 = screen[1].x - screen[0].x;
+    f32 const y10 = screen[1].y - screen[0].y;
+    f32 const x20 = screen[2].x - screen[0].x;
+    f32 const y20 = screen[2].y - screen[0].y;
+    f32 const area = x10 * y20 - x20 * y10;
+
+    // Nothing covers a pixel center
+    if (area == 0.0f)
+      return;
+
+    // Every channel is a plane over the screen, c0 + dx * (x - x0) +
+    // dy * (y - y0). Slivers can have huge gradients but they're a tiny
+    // fraction of a pixel across, capping them keeps the fixed point in
+    // range.
+    f32 const gradient_max = 32767.0f;
+    std::array<f32, 4> gradient_x;
+    std::array<f32, 4> gradient_y;
+
+    for (u32 c = 0; c < 4; ++c)
+      {
+        f32 const c10 = channels[1][c] - channels[0][c];
+        f32 const c20 = channels[2][c] - channels[0][c];
+        gradient_x[c] = hyper::clamp ((c10 * y20 - c20 * y10) / area, -gradient_max, gradient_max);
+        gradient_y[c] = hyper::clamp ((c20 * x10 - c10 * x20) / area, -gradient_max, gradient_max);
+      }
+
+    // All 4 channels at once from here on, half added so the kernel's
+    // shifts round
+    __m128 const fixed_one = _mm_set1_ps (65536.0f);
+    __m128 const fixed_min = _mm_set1_ps (-2147483648.0f);
+    __m128 const fixed_max = _mm_set1_ps (2147483520.0f);
+    __m128 const plane_origin = _mm_add_ps (_mm_loadu_ps (channels[0].data ()), _mm_set1_ps (0.5f));
+    __m128 const plane_x = _mm_loadu_ps (gradient_x.data ());
+    __m128 const plane_y = _mm_loadu_ps (gradient_y.data ());
+    Shaded_steps steps;
+    steps.step = _mm_cvttps_epi32 (_mm_mul_ps (plane_x, fixed_one));
+
+    for (u32 c = 0; c < 4; ++c)
+      steps.lanes[c] = _mm256_mullo_epi32 (_mm256_setr_epi32 (0, 1, 2, 3, 4, 5, 6, 7), _mm256_set1_epi32 (static_cast<i32> (gradient_x[c] * 65536.0f)));
+
+    // Top to bottom
+    std::array<Vec2<f32>, 3> sorted = screen;
+    if (sorted[1].y < sorted[0].y)
+      hyper::swap (sorted[0], sorted[1]);
+
+    if (sorted[2].y < sorted[0].y)
+      hyper::swap (sorted[2], sorted[0]);
+
+    if (sorted[2].y < sorted[1].y)
+      hyper::swap (sorted[2], sorted[1]);
+
+    // Scanlines whose center is in [top, bottom)
+    i32 const y_start = hyper::max (static_cast<i32> (hyper::ceil (sorted[0].y - 0.5f)), 0);
+    i32 const y_end = hyper::min (static_cast<i32> (hyper::ceil (sorted[2].y - 0.5f)), framebuffer->height);
+    i32 const y_middle = static_cast<i32> (hyper::ceil (sorted[1].y - 0.5f));
+    if (y_start >= y_end)
+      return;
+
+    // Edge positions at the first scanline's center, then stepped one
+    // scanline at a time. The short edge switches at the middle vertex.
+    auto const get_edge_step = [] (Vec2<f32> const &a, Vec2<f32> const &b) { return (b.x - a.x) / (b.y - a.y); };
+    auto const get_edge_x = [] (Vec2<f32> const &a, f32 step, f32 y) { return a.x + (y - a.y) * step; };
+
+    f32 const long_step = get_edge_step (sorted[0], sorted[2]);
+    f32 long_x = get_edge_x (sorted[0], long_step, (f32) y_start + 0.5f);
+    bool upper = y_start < y_middle;
+    f32 short_step = upper ? get_edge_step (sorted[0], sorted[1]) : get_edge_step (sorted[1], sorted[2]);
+    f32 short_x = get_edge_x (upper ? sorted[0] : sorted[1], short_step, (f32) y_start + 0.5f);
+
+    Shaded_span_function const shade_span = get_raster_kernels (context).shaded_span;
+
+    for (i32 y = y_start; y < y_end; ++y)
+      {
+        if (upper && y >= y_middle)
           {
-            u32 *row = &context->framebuffer->pixels[y * context->framebuffer->width + x_start];
+            upper = false;
+            short_step = get_edge_step (sorted[1], sorted[2]);
+            short_x = get_edge_x (sorted[1], short_step, (f32) y + 0.5f);
+          }
 
-            set_pixels_colour_unaligned_simd (row, colour_uint, chunks);
+        f32 const left = hyper::min (long_x, short_x);
+        f32 const right = hyper::max (long_x, short_x);
+        long_x += long_step;
+        short_x += short_step;
 
-            // leftovers
-            for (i32 x = x_start + (chunks * get_simd_width ()); x <= x_end; ++x)
-              set_pixel_colour (context->framebuffer, x, y, colour_uint);
+        i32 const x_start = hyper::max (static_cast<i32> (hyper::ceil (left - 0.5f)), 0);
+        i32 const x_end = hyper::min (static_cast<i32> (hyper::ceil (right - 0.5f)) - 1, framebuffer->width - 1);
+        if (x_start > x_end)
+          continue;
 
-            continue;
+        // Only the first pixel of the span is worked out from the plane
+        __m128 const dx = _mm_set1_ps ((f32) x_start + 0.5f - screen[0].x);
+        __m128 const dy = _mm_set1_ps ((f32) y + 0.5f - screen[0].y);
+        __m128 const start = _mm_add_ps (plane_origin, _mm_add_ps (_mm_mul_ps (plane_x, dx), _mm_mul_ps (plane_y, dy)));
+        __m128i const start_fixed = _mm_cvttps_epi32 (_mm_min_ps (_mm_max_ps (_mm_mul_ps (start, fixed_one), fixed_min), fixed_max));
+
+        shade_span (framebuffer, y, x_start, x_end, start_fixed, steps);
+      }
+  }
+
+  struct Polygon_edge
+  {
+    // First scanline and one past the last
+    i32 y_start;
+    i32 y_end;
+    // Where it crosses the current scanline's pixel centers
+    f32 x;
+    f32 x_step;
+  };
+
+  void
+  draw_polygon_filled (Renderer_context *context, Vec2<f32> const *vertices, u32 vertex_count, Colour colour)
+  {
+    ++context->draw_calls;
+    Perf_counters_scope counters_scope { context->perf_counters, Perf_scope::draw_polygon_filled };
+    Render_stats_scope stats_scope { context->framebuffer->stats, Render_primitive::polygon_filled };
+
+    if (vertex_count < 3)
+      return;
+
+    Framebuffer *framebuffer = context->framebuffer;
+    u32 const colour_uint = get_raster_kernels (context).pack_colour (colour);
+    f32 const half_width = static_cast<f32> (framebuffer->width >> 1);
+    f32 const half_height = static_cast<f32> (framebuffer->height >> 1);
+
+    if (context->anti_aliasing)
+      {
+        auto *screen_vertices = static_cast<Vec2<f32> *> (context->stack_arena->resource.allocate (vertex_count * sizeof (Vec2<f32>), alignof (Vec2<f32>)));
+
+        for (u32 i = 0; i < vertex_count; ++i)
+          screen_vertices[i] = { (vertices[i].x - context->camera_x) * context->camera_zoom + half_width,
+                                 (vertices[i].y - context->camera_y) * context->camera_zoom + half_height };
+
+        fill_polygon_coverage (context, screen_vertices, vertex_count, colour_uint);
+        return;
+      }
+
+    auto *edges = static_cast<Polygon_edge *> (context->stack_arena->resource.allocate (vertex_count * sizeof (Polygon_edge), alignof (Polygon_edge)));
+    auto *active = static_cast<Polygon_edge **> (context->stack_arena->resource.allocate (vertex_count * sizeof (Polygon_edge *), alignof (Polygon_edge *)));
+    u32 edge_count = 0;
+
+    // Edge table, world to screen on the way
+    for (u32 i = 0; i < vertex_count; ++i)
+      {
+        Vec2<f32> const &a = vertices[i];
+        Vec2<f32> const &b = vertices[(i + 1) % vertex_count];
+
+        f32 x0 = (a.x - context->camera_x) * context->camera_zoom + half_width;
+        f32 y0 = (a.y - context->camera_y) * context->camera_zoom + half_height;
+        f32 x1 = (b.x - context->camera_x) * context->camera_zoom + half_width;
+        f32 y1 = (b.y - context->camera_y) * context->camera_zoom + half_height;
+
+        if (y1 < y0)
+          {
+            hyper::swap (x0, x1);
+            hyper::swap (y0, y1);
+          }
+
+        // Scanlines whose center is in [y0, y1), horizontal edges
+        // don't cross any
+        i32 const y_start = static_cast<i32> (hyper::ceil (y0 - 0.5f));
+        i32 const y_end = static_cast<i32> (hyper::ceil (y1 - 0.5f));
+        if (y_start >= y_end)
+          continue;
+
+        Polygon_edge &edge = edges[edge_count++];
+        edge.y_start = y_start;
+        edge.y_end = y_end;
+        edge.x_step = (x1 - x0) / (y1 - y0);
+        edge.x = x0 + ((f32) y_start + 0.5f - y0) * edge.x_step;
+      }
+
+    if (edge_count < 2)
+      return;
+
+    // Sorted by first scanline, there's only a handful of them
+    for (u32 i = 1; i < edge_count; ++i)
+      {
+        Polygon_edge const edge = edges[i];
+        u32 j = i;
+
+        for (; j > 0 && edges[j - 1].y_start > edge.y_start; --j)
+          edges[j] = edges[j - 1];
+
+        edges[j] = edge;
+      }
+
+    i32 y_end = 0;
+    for (u32 i = 0; i < edge_count; ++i)
+      y_end = hyper::max (y_end, edges[i].y_end);
+
+    y_end = hyper::min (y_end, framebuffer->height);
+
+    u32 next_edge = 0;
+    u32 active_count = 0;
+    // Spans get clipped here, the kernel doesn't have to
+    Span_function const fill_span = get_raster_kernels (context).span;
+
+    for (i32 y = hyper::max (edges[0].y_start, 0); y < y_end; ++y)
+      {
+        // Edges starting here, the ones that started above the screen
+        // catch up first
+        while (next_edge < edge_count && edges[next_edge].y_start <= y)
+          {
+            Polygon_edge *edge = &edges[next_edge++];
+            edge->x += (f32) (y - edge->y_start) * edge->x_step;
+            active[active_count++] = edge;
+          }
+
+        // Drop the ones that are done
+        u32 kept = 0;
+        for (u32 i = 0; i < active_count; ++i)
+          {
+            if (active[i]->y_end > y)
+              active[kept++] = active[i];
+          }
+        active_count = kept;
+
+        // Almost sorted from the last scanline, insertion sort is cheap
+        for (u32 i = 1; i < active_count; ++i)
+          {
+            Polygon_edge *edge = active[i];
+            u32 j = i;
+
+            for (; j > 0 && active[j - 1]->x > edge->x; --j)
+              active[j] = active[j - 1];
+
+            active[j] = edge;
+          }
+
+        for (u32 i = 0; i + 1 < active_count; i += 2)
+          {
+            // Same rule as the scanlines, the pixel center decides
+            i32 const x_start = hyper::max (static_cast<i32> (hyper::ceil (active[i]->x - 0.5f)), 0);
+            i32 const x_end = hyper::min (static_cast<i32> (hyper::ceil (active[i + 1]->x - 0.5f)) - 1, framebuffer->width - 1);
+
+            if (x_start <= x_end)
+              fill_span (framebuffer, y, x_start, x_end, colour_uint);
           }
 
-        // get here if I can't use SIMD
-        for (i32 x = x_start; x <= x_end; ++x)
-          set_pixel_colour (context->framebuffer, x, y, colour_uint);
+        for (u32 i = 0; i < active_count; ++i)
+          active[i]->x += active[i]->x_step;
       }
   }
 
   void
   draw_circle_outline (Renderer_context *context, f32 x, f32 y, f32 radius, Colour colour)
   {
-    u32 const colour_uint = get_colour_uint (colour);
+    ++context->draw_calls;
+    Perf_counters_scope counters_scope { context->perf_counters, Perf_scope::draw_circle_outline };
+    Render_stats_scope stats_scope { context->framebuffer->stats, Render_primitive::circle_outline };
+
+    u32 const colour_uint = get_raster_kernels (context).pack_colour (colour);
 
     // World to screen transformation
     f32 const circle_screen_coordinates_x = (x - context->camera_x) * context->camera_zoom + (static_cast<f32> (context->framebuffer->width >> 1));
@@ -319,13 +1229,23 @@ namespace hyper
     // Screen to pixels
     i32 const circle_pixel_coordinates_x = static_cast<i32> (hyper::floor (circle_screen_coordinates_x));
     i32 const circle_pixel_coordinates_y = static_cast<i32> (hyper::floor (circle_screen_coordinates_y));
+
+    if (context->anti_aliasing)
+      {
+        draw_circle_coverage (context->framebuffer, get_raster_kernels (context).coverage_pixel, circle_pixel_coordinates_x, circle_pixel_coordinates_y,
+                              radius * context->meters_per_pixel * context->camera_zoom, colour_uint);
+        return;
+      }
+
     i32 const radius_pixels = static_cast<i32> (radius * context->meters_per_pixel * context->camera_zoom);
 
+    Pixel_function const plot = get_raster_kernels (context).pixel;
+
     // Start at the top!
     Vec2<i32> current = { 0, radius_pixels };
     i32 D = 3 - (2 * radius_pixels);
 
-    plot_points (context->framebuffer, circle_pixel_coordinates_x, circle_pixel_coordinates_y, current.x, current.y, colour_uint);
+    plot_points (context->framebuffer, plot, circle_pixel_coordinates_x, circle_pixel_coordinates_y, current.x, current.y, colour_uint);
 
     while (current.y > current.x)
       {
@@ -339,26 +1259,41 @@ namespace hyper
           D = D + 4 * current.x + 6;
 
         ++current.x;
-        plot_points (context->framebuffer, circle_pixel_coordinates_x, circle_pixel_coordinates_y, current.x, current.y, colour_uint);
+        plot_points (context->framebuffer, plot, circle_pixel_coordinates_x, circle_pixel_coordinates_y, current.x, current.y, colour_uint);
       }
   }
 
   void
   draw_circle_filled (Renderer_context *context, f32 circle_center_x, f32 circle_center_y, f32 radius, Colour colour)
   {
+    ++context->draw_calls;
+    Perf_counters_scope counters_scope { context->perf_counters, Perf_scope::draw_circle_filled };
+    Render_stats_scope stats_scope { context->framebuffer->stats, Render_primitive::circle_filled };
+
     // World to screen transformation
     f32 const circle_screen_coordinates_x = (circle_center_x - context->camera_x) * context->camera_zoom + (static_cast<f32> (context->framebuffer->width >> 1));
     f32 const circle_screen_coordinates_y = (circle_center_y - context->camera_y) * context->camera_zoom + (static_cast<f32> (context->framebuffer->height >> 1));
 
+    if (context->anti_aliasing)
+      {
+        // The aliased circles take in the pixel their edge is in, half a
+        // pixel more keeps the sizes the same and the smallest stars lit
+        fill_circle_coverage (context, circle_screen_coordinates_x, circle_screen_coordinates_y,
+                              radius * context->meters_per_pixel * context->camera_zoom + 0.5f,
+                              get_raster_kernels (context).pack_colour (colour));
+        return;
+      }
+
     // Screen to pixels
     i32 const circle_pixel_coordinates_x = static_cast<i32> (hyper::floor (circle_screen_coordinates_x));
     i32 const circle_pixel_coordinates_y = static_cast<i32> (hyper::floor (circle_screen_coordinates_y));
     i32 const radius_pixels = static_cast<i32> (radius * context->meters_per_pixel * context->camera_zoom);
 
-    u32 const colour_uint = get_colour_uint (colour);
+    u32 const colour_uint = get_raster_kernels (context).pack_colour (colour);
     i32 const radius_squared = radius_pixels * radius_pixels;
     i32 const y_start = hyper::max (circle_pixel_coordinates_y - radius_pixels, 0);
     i32 const y_end = hyper::min (circle_pixel_coordinates_y + radius_pixels, context->framebuffer->height - 1);
+    Span_function const fill_span = get_raster_kernels (context).span;
 
     for (i32 y = y_start; y <= y_end; ++y)
       {
@@ -372,15 +1307,18 @@ namespace hyper
         i32 const x_start = hyper::max (circle_pixel_coordinates_x - width, 0);
         i32 const x_end = hyper::min (circle_pixel_coordinates_x + width, context->framebuffer->width - 1);
 
-        for (i32 x = x_start; x <= x_end; ++x)
-          set_pixel_colour (context->framebuffer, x, y, colour_uint);
+        fill_span (context->framebuffer, y, x_start, x_end, colour_uint);
       }
   }
 
   void
   draw_line (Renderer_context *context, Vec2<f32> const &start, Vec2<f32> const&end, Colour colour)
   {
-    u32 const colour_uint = get_colour_uint (colour);
+    ++context->draw_calls;
+    Perf_counters_scope counters_scope { context->perf_counters, Perf_scope::draw_line };
+    Render_stats_scope stats_scope { context->framebuffer->stats, Render_primitive::line };
+
+    u32 const colour_uint = get_raster_kernels (context).pack_colour (colour);
 
     // World to screen transformation
     Vec2<f32> line_start_screen_coordinates;
@@ -392,6 +1330,12 @@ namespace hyper
     line_end_screen_coordinates.x = (end.x - context->camera_x) * context->camera_zoom + (static_cast<f32> (context->framebuffer->width >> 1));
     line_end_screen_coordinates.y = (end.y - context->camera_y) * context->camera_zoom + (static_cast<f32> (context->framebuffer->height >> 1));
 
+    if (context->anti_aliasing)
+      {
+        draw_line_coverage (context->framebuffer, get_raster_kernels (context).coverage_pixel, line_start_screen_coordinates, line_end_screen_coordinates, colour_uint);
+        return;
+      }
+
     Vec2<i32> line_start_pixel_coordinates;
     line_start_pixel_coordinates.x = static_cast<i32> (hyper::floor (line_start_screen_coordinates.x));
     line_start_pixel_coordinates.y = static_cast<i32> (hyper::floor (line_start_screen_coordinates.y));
@@ -400,17 +1344,34 @@ namespace hyper
     line_end_pixel_coordinates.x = static_cast<i32> (hyper::floor (line_end_screen_coordinates.x));
     line_end_pixel_coordinates.y = static_cast<i32> (hyper::floor (line_end_screen_coordinates.y));
 
-    draw_line_pixels (context->framebuffer, line_start_pixel_coordinates, line_end_pixel_coordinates, colour_uint);
+    draw_line_pixels (context->framebuffer, get_raster_kernels (context).pixel, line_start_pixel_coordinates, line_end_pixel_coordinates, colour_uint);
   }
 
   void draw_quad_filled (Renderer_context *context, Vec2<f32> const &point, f32 width, f32 height, Colour colour)
   {
-    u32 const colour_uint = get_colour_uint (colour);
+    ++context->draw_calls;
+    Perf_counters_scope counters_scope { context->perf_counters, Perf_scope::draw_quad_filled };
+    Render_stats_scope stats_scope { context->framebuffer->stats, Render_primitive::quad_filled };
+
+    u32 const colour_uint = get_raster_kernels (context).pack_colour (colour);
 
     // World to screen transformation
     f32 const quad_screen_coordinates_x = (point.x - context->camera_x) * context->camera_zoom + (static_cast<f32> (context->framebuffer->width >> 1));
     f32 const quad_screen_coordinates_y = (point.y - context->camera_y) * context->camera_zoom + (static_cast<f32> (context->framebuffer->height >> 1));
 
+    if (context->anti_aliasing)
+      {
+        f32 const quad_x_end = quad_screen_coordinates_x + width * context->meters_per_pixel * context->camera_zoom;
+        f32 const quad_y_end = quad_screen_coordinates_y + height * context->meters_per_pixel * context->camera_zoom;
+        std::array<Vec2<f32>, 4> const corners = {{ { quad_screen_coordinates_x, quad_screen_coordinates_y },
+                                                    { quad_x_end, quad_screen_coordinates_y },
+                                                    { quad_x_end, quad_y_end },
+                                                    { quad_screen_coordinates_x, quad_y_end } }};
+
+        fill_polygon_coverage (context, corners.data (), (u32) corners.size (), colour_uint);
+        return;
+      }
+
     // Screen to pixels
     i32 const quad_pixel_coordinates_x = static_cast<i32> (hyper::floor (quad_screen_coordinates_x));
     i32 const quad_pixel_coordinates_y = static_cast<i32> (hyper::floor (quad_screen_coordinates_y));
@@ -421,11 +1382,9 @@ namespace hyper
     i32 const y_start = hyper::max (quad_pixel_coordinates_y, 0);
     i32 const y_max = hyper::min (quad_pixel_coordinates_y + height_pixels, context->framebuffer->height - 1);
     i32 const x_max = hyper::min (quad_pixel_coordinates_x + width_pixels, context->framebuffer->width - 1);
+    Span_function const fill_span = get_raster_kernels (context).span;
 
     for (i32 y = y_start; y <= y_max; ++y)
-      {
-        for (i32 x = x_start; x <= x_max; ++x)
-          set_pixel_colour (context->framebuffer, x, y, colour_uint);
-      }
+      fill_span (context->framebuffer, y, x_start, x_max, colour_uint);
   }
 };
@@ -8,12 +8,64 @@
 
 namespace hyper
 {
+  // Packs the presets for the new format too
+  void framebuffer_set_format (Framebuffer *, Pixel_format);
+
+  // Renders at a fraction of the full size, returns the scale it
+  // actually got after rounding the width to whole SIMD chunks
+  f32 framebuffer_set_render_scale (Framebuffer *, f32);
+
+  // What's been drawn is scrambled, set it before drawing
+  void framebuffer_set_layout (Framebuffer *, Framebuffer_layout);
+
+  // Rows of pixels the frame takes up, tiled ones round up to whole
+  // tiles
+  i32 framebuffer_get_rows (Framebuffer const &);
+
+  // The frame in linear rows, pitch bytes apart, for uploads and
+  // captures whatever the layout. Split across the jobs if there are
+  // any.
+  void framebuffer_copy_linear (Framebuffer const &, u32 *, i32, Job_system *);
+
+  template <Framebuffer_layout layout>
+  inline size_t
+  get_pixel_index (Framebuffer const &framebuffer, i32 x, i32 y)
+  {
+    constexpr i32 tile_mask = framebuffer_tile_size - 1;
+
+    if constexpr (layout == Framebuffer_layout::linear)
+      return (size_t) y * (size_t) framebuffer.width + (size_t) x;
+    else
+      return (size_t) (y & ~tile_mask) * (size_t) framebuffer.width
+        + (size_t) ((x & ~tile_mask) * framebuffer_tile_size + (y & tile_mask) * framebuffer_tile_size + (x & tile_mask));
+  }
+
+  inline size_t
+  get_pixel_index (Framebuffer const &framebuffer, i32 x, i32 y)
+  {
+    if (framebuffer.layout == Framebuffer_layout::tiled)
+      return get_pixel_index<Framebuffer_layout::tiled> (framebuffer, x, y);
+
+    return get_pixel_index<Framebuffer_layout::linear> (framebuffer, x, y);
+  }
+
   void set_background_colour (Renderer_context *, Colour);
 
+  void set_background_colour (Renderer_context *, Colour_preset);
+
   void draw_triangle_outline (Renderer_context *, std::array<Vec2<f32>, 3> const &, Colour);
 
   void draw_triangle_filled (Renderer_context *, std::array<Vec2<f32>, 3> const &, Colour);
 
+  // Colours are blended across the triangle from its vertices, pixels
+  // are filled when their center is inside like polygons
+  void draw_triangle_shaded (Renderer_context *, std::array<Vec2<f32>, 3> const &, std::array<Colour, 3> const &);
+
+  // Any simple polygon in one pass, even-odd rule. Pixels are filled
+  // when their center is inside, so polygons sharing an edge never
+  // touch the same pixel.
+  void draw_polygon_filled (Renderer_context *, Vec2<f32> const *, u32, Colour);
+
   void draw_circle_outline (Renderer_context *, f32, f32, f32, Colour);
 
   void draw_circle_filled (Renderer_context *, f32, f32, f32, Colour);
@@ -0,0 +1,270 @@
+//
+// Offline baker for asset packs, see hyper_asset_pack.hh for the
+// format. Sources are text, one asset per block:
+//
+//   # comment
+//   vertices NAME      x y
+//   quads NAME         x y width height
+//   palette NAME       r g b a
+//   spawns NAME        x y rotation kind
+//   ...one element per line...
+//   end
+//
+// usage: hyper-asset-baker OUTPUT SOURCE...
+//
+#include "hyper_asset_pack.hh"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+struct Baked_asset
+{
+  std::string name;
+  hyper::Asset_entry entry;
+  std::vector<std::byte> data;
+};
+
+static bool
+parse_asset_type (std::string const &word, hyper::Asset_type &type)
+{
+  if (word == "vertices")
+    type = hyper::Asset_type::vertices;
+  else if (word == "quads")
+    type = hyper::Asset_type::quads;
+  else if (word == "palette")
+    type = hyper::Asset_type::palette;
+  else if (word == "spawns")
+    type = hyper::Asset_type::spawns;
+  else
+    return false;
+
+  return true;
+}
+
+template <typename T>
+static void
+append_element (Baked_asset &asset, T const &element)
+{
+  auto const *bytes = reinterpret_cast<std::byte const *> (&element);
+  asset.data.insert (asset.data.end (), bytes, bytes + sizeof (T));
+}
+
+static bool
+parse_element (std::istringstream &line, Baked_asset &asset)
+{
+  switch (asset.entry.type)
+    {
+    case hyper::Asset_type::vertices:
+      {
+        hyper::Vec2<f32> vertex;
+        if (!(line >> vertex.x >> vertex.y))
+          return false;
+
+        append_element (asset, vertex);
+        break;
+      }
+    case hyper::Asset_type::quads:
+      {
+        hyper::Quad quad;
+        if (!(line >> quad.position.x >> quad.position.y >> quad.width >> quad.height))
+          return false;
+
+        append_element (asset, quad);
+        break;
+      }
+    case hyper::Asset_type::palette:
+      {
+        // Base 0, so 0x80 works too
+        std::string channels[4];
+        if (!(line >> channels[0] >> channels[1] >> channels[2] >> channels[3]))
+          return false;
+
+        u8 values[4];
+        for (u32 i = 0; i < 4; ++i)
+          {
+            char *end;
+            unsigned long const value = strtoul (channels[i].c_str (), &end, 0);
+            if (*end || value > 0xFF)
+              return false;
+
+            values[i] = (u8) value;
+          }
+
+        append_element (asset, hyper::Colour { values[0], values[1], values[2], values[3] });
+        break;
+      }
+    case hyper::Asset_type::spawns:
+      {
+        hyper::Spawn spawn;
+        if (!(line >> spawn.position.x >> spawn.position.y >> spawn.rotation >> spawn.kind))
+          return false;
+
+        append_element (asset, spawn);
+        break;
+      }
+    default:
+      return false;
+    }
+
+  ++asset.entry.count;
+
+  // Nothing else on the line
+  std::string rest;
+  return !(line >> rest);
+}
+
+static bool
+parse_source (char const *path, std::vector<Baked_asset> &assets)
+{
+  std::ifstream file { path };
+  if (!file)
+    {
+      std::cerr << "couldn't open " << path << '\n';
+      return false;
+    }
+
+  std::string text;
+  u32 line_number = 0;
+  Baked_asset *asset = nullptr;
+
+  while (std::getline (file, text))
+    {
+      ++line_number;
+
+      std::istringstream line { text };
+      std::string word;
+
+      // Blank or comment
+      if (!(line >> word) || word[0] == '#')
+        continue;
+
+      if (!asset)
+        {
+          hyper::Asset_type type;
+          std::string name;
+
+          if (!parse_asset_type (word, type) || !(line >> name))
+            {
+              std::cerr << path << ':' << line_number << ": expected an asset type and a name\n";
+              return false;
+            }
+
+          assets.push_back ({});
+          asset = &assets.back ();
+          asset->name = name;
+          asset->entry.name_hash = hyper::get_asset_name_hash (name.c_str ());
+          asset->entry.type = type;
+          asset->entry.count = 0;
+          continue;
+        }
+
+      if (word == "end")
+        {
+          asset = nullptr;
+          continue;
+        }
+
+      // Put the first number back
+      line.clear ();
+      line.seekg (0);
+
+      if (!parse_element (line, *asset))
+        {
+          std::cerr << path << ':' << line_number << ": bad element for " << asset->name << '\n';
+          return false;
+        }
+    }
+
+  if (asset)
+    {
+      std::cerr << path << ": " << asset->name << " has no end\n";
+      return false;
+    }
+
+  return true;
+}
+
+static bool
+write_pack (char const *path, std::vector<Baked_asset> &assets)
+{
+  // Sorted by hash for the binary search, insertion sort is plenty for
+  // a few hundred assets
+  for (size_t i = 1; i < assets.size (); ++i)
+    for (size_t j = i; j > 0 && assets[j - 1].entry.name_hash > assets[j].entry.name_hash; --j)
+      std::swap (assets[j - 1], assets[j]);
+
+  for (size_t i = 1; i < assets.size (); ++i)
+    if (assets[i - 1].entry.name_hash == assets[i].entry.name_hash)
+      {
+        std::cerr << assets[i - 1].name << " and " << assets[i].name << " have the same name hash\n";
+        return false;
+      }
+
+  auto const align = [] (u64 offset) { return (offset + hyper::asset_pack_alignment - 1) & ~(hyper::asset_pack_alignment - 1); };
+
+  hyper::Asset_pack_header header {};
+  header.magic = hyper::asset_pack_magic;
+  header.version = hyper::asset_pack_version;
+  header.entry_count = (u32) assets.size ();
+  header.entries_offset = sizeof (header);
+
+  u64 offset = align (header.entries_offset + assets.size () * sizeof (hyper::Asset_entry));
+  for (Baked_asset &asset : assets)
+    {
+      asset.entry.offset = offset;
+      asset.entry.size = asset.data.size ();
+      offset = align (offset + asset.entry.size);
+    }
+
+  header.size = offset;
+
+  std::vector<std::byte> output (header.size);
+  memcpy (output.data (), &header, sizeof (header));
+
+  for (size_t i = 0; i < assets.size (); ++i)
+    {
+      memcpy (output.data () + header.entries_offset + i * sizeof (hyper::Asset_entry), &assets[i].entry, sizeof (hyper::Asset_entry));
+      memcpy (output.data () + assets[i].entry.offset, assets[i].data.data (), assets[i].data.size ());
+    }
+
+  FILE *file = fopen (path, "wb");
+  if (!file)
+    {
+      std::cerr << "couldn't create " << path << '\n';
+      return false;
+    }
+
+  bool const written = fwrite (output.data (), 1, output.size (), file) == output.size ();
+  if (fclose (file) != 0 || !written)
+    {
+      std::cerr << "couldn't write " << path << '\n';
+      return false;
+    }
+
+  std::cout << path << ": " << assets.size () << " assets, " << header.size << " bytes\n";
+  return true;
+}
+
+int
+main (int argc, char **argv)
+{
+  if (argc < 3)
+    {
+      std::cerr << "usage: " << argv[0] << " OUTPUT SOURCE...\n";
+      return EXIT_FAILURE;
+    }
+
+  std::vector<Baked_asset> assets;
+
+  for (int i = 2; i < argc; ++i)
+    if (!parse_source (argv[i], assets))
+      return EXIT_FAILURE;
+
+  return write_pack (argv[1], assets) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
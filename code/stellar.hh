@@ -3,13 +3,39 @@
 #include "hyper_common.hh"
 #include "hyper_geometry.hh"
 #include "hyper_colour.hh"
+#include "hyper_physics.hh"
+#include "hyper_transform_hierarchy.hh"
+#include "hyper_input.hh"
+#include "hyper_frame_capture.hh"
 
 #include <array>
 
 namespace stellar
 {
+  // A ship's transform nodes, the root follows the physics body and
+  // the parts hang off it in this order
+  enum class Ship_node : u32
+    {
+      root,
+      hull,
+      body,
+      wing_left,
+      wing_right,
+      cockpit,
+      // Both quads' anchors
+      thrusters,
+      // Both glows, three vertices each
+      exhaust,
+
+      count
+    };
+
+  // Part vertices are in ship space, centered on the physics body
   struct Ship
   {
+    u32 physics_body;
+    // Root of the ship's nodes, see Ship_node
+    u32 transform_node;
     struct Thrusters
     {
       std::array<hyper::Quad, 2> data;
@@ -17,6 +43,13 @@ namespace stellar
       f32 width;
       f32 height;
     } thrusters;
+    // Glow under each thruster, added on top of whatever is behind
+    struct Exhaust
+    {
+      std::array<hyper::Triangle, 2> data;
+      // Both corners at the thruster, then the tip
+      std::array<hyper::Colour, 3> colours;
+    } exhaust;
     struct Wings
     {
       hyper::Triangle left;
@@ -27,39 +60,177 @@ namespace stellar
     {
       hyper::Triangle data;
       hyper::Colour colour;
-      f32 width;
-      f32 height;
     } body;
     struct Cockpit
     {
       hyper::Triangle data;
       hyper::Colour colour;
-      f32 width;
-      f32 height;
     } cockpit;
+    // Outline of the body and both wings, filled in one go under them
+    struct Hull
+    {
+      hyper::Polygon data;
+      hyper::Colour colour;
+    } hull;
+  };
+
+  // Everyone but the player, drawn with the player's ship parts
+  inline constexpr u32 fleet_max_ships = hyper::physics_max_bodies - 1;
+
+  struct Fleet
+  {
+    std::array<u32, fleet_max_ships> physics_bodies;
+    std::array<u32, fleet_max_ships> transform_nodes;
+    u32 count;
   };
 
   struct Star
   {
     hyper::Circle body;
     hyper::Colour colour;
+    // Grows with the star's index inside its sector, stars are drawn
+    // while it's below the fraction the zoom level allows
+    f32 lod_rank;
+  };
+
+  inline constexpr f32 star_sector_size = 128.0f;
+  inline constexpr u32 star_sector_max_stars = 24;
+  // Sectors are cached in sets of star_cache_ways, least recently used
+  // gets evicted
+  inline constexpr u32 star_cache_sets = 64;
+  inline constexpr u32 star_cache_ways = 4;
+  inline constexpr u32 star_cache_capacity = star_cache_sets * star_cache_ways;
+  // Sectors across the largest square of them the cache holds
+  inline constexpr i32 star_cache_side = 16;
+  static_assert ((u32) (star_cache_side * star_cache_side) == star_cache_capacity, "the square fills the cache");
+
+  struct Star_sector
+  {
+    i32 x;
+    i32 y;
+    u32 star_count;
+    bool valid;
+    u64 last_used_frame;
+    std::array<Star, star_sector_max_stars> stars;
+  };
+
+  // The world is split in sectors and each one's stars come from a hash
+  // of its coordinates, so only the ones on screen need to exist
+  struct Starfield
+  {
+    std::array<Star_sector, star_cache_capacity> cache;
+    u64 seed;
+    u64 frame;
+    f32 world_width;
+    f32 world_height;
+  };
+
+  struct Star_sector_range
+  {
+    i32 x_start;
+    i32 y_start;
+    i32 x_end;
+    i32 y_end;
   };
 
+  // A task that generates the sectors the camera is about to reach, so
+  // panning doesn't have to do it while rendering
+  struct Starfield_prefetch
+  {
+    Starfield *starfield;
+    Star_sector_range range;
+    // Next sector to look at, row by row through the range
+    i32 x;
+    i32 y;
+  };
+
+  // Kept by the platform and reached through Frame_context::game_cache,
+  // rewinding to a snapshot leaves it alone
+  struct Game_cache
+  {
+    Starfield starfield;
+    Starfield_prefetch starfield_prefetch;
+  };
+
+  struct Camera
+  {
+    // Center of the view in world space
+    f32 x;
+    f32 y;
+    // Scales the world coordinates to screen coordinates
+    f32 zoom;
+  };
+
+  // Units per second while an arrow key is held
+  inline constexpr f32 camera_speed = 150.0f;
+
   struct Game_data
   {
-    std::array<Star, 1024> stars;
     Ship ship;
+    Fleet fleet;
+    hyper::Physics_world physics;
+    Camera camera;
+    // As of the end of the last tick, simulated from the input events
+    std::array<bool, (size_t) hyper::Key::count> keys_held;
   };
 
   struct Config
   {
+    // Frames per second, 0 means uncapped
     f32 target_fps;
+    // Start frames as late as possible so they end at the deadline
+    bool just_in_time_rendering;
     struct
     {
       i32 width;
       i32 height;
     } resolution;
     bool vsync;
+    // Everything random in the simulation derives from this
+    u64 seed;
+    bool has_seed;
+    // Set from the command line, null when not in use
+    char const *record_path;
+    char const *replay_path;
+    // One tick per frame without waiting, for perf runs
+    bool replay_fast;
+    // Lower the render resolution when frames take too long, never
+    // below min_render_scale of the window
+    bool dynamic_resolution;
+    f32 min_render_scale;
+    // Performance overlay
+    bool show_hud;
+    // Smooth edges, costs a little on every shape
+    bool anti_aliasing;
+    // Draw into 8x8 tiles instead of rows, detiled on upload. Tall
+    // shapes get faster, long horizontal spans slower.
+    bool tiled_framebuffer;
+    // Arena sizes in megabytes
+    u32 linear_arena_megabytes;
+    u32 stack_arena_megabytes;
+    // Don't fault the arenas in at startup, pages get committed the
+    // first time they're touched
+    bool lazy_arenas;
+    // Every rendered frame goes to disk, null when not in use
+    char const *capture_path;
+    hyper::Capture_format capture_format;
+    // Baked content, mapped at startup. The default is next to the
+    // executable, wherever it's started from.
+    char const *assets_path;
+    // How far back rewinding can go, 0 turns snapshots off
+    f32 rewind_seconds;
+    // Hardware counters per frame stage and draw function, printed
+    // when the game quits
+    bool perf_counters;
+    // Primitives, spans and pixels drawn, in the HUD and printed when
+    // the game quits
+    bool render_stats;
+    // Scene to benchmark or "all", null when playing
+    char const *bench_scene;
+    // Measured frames per scene, the JSON goes to stdout if there's no
+    // path
+    u32 bench_frames;
+    char const *bench_output;
   };
 
   struct World
@@ -69,17 +240,10 @@ namespace stellar
     f32 meters_per_pixel;
   };
 
-  struct Camera
-  {
-    // Center of the view in world space
-    f32 x;
-    f32 y;
-    // Scales the world coordinates to screen coordinates
-    f32 zoom;
-  };
-
   struct State
   {
     bool running;
+    // Held down, the simulation runs backwards through the snapshots
+    bool rewinding;
   };
 };
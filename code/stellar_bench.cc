@@ -0,0 +1,107 @@
+#include "stellar_bench.hh"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <iterator>
+
+namespace stellar
+{
+  static char const *const bench_stage_names[] = { "update", "render", "upload", "present" };
+  static_assert (std::size (bench_stage_names) == (size_t) Bench_stage::count);
+
+  Bench_scene const *
+  bench_find_scene (char const *name)
+  {
+    for (Bench_scene const &scene : bench_scenes)
+      if (!strcmp (scene.name, name))
+        return &scene;
+
+    return nullptr;
+  }
+
+  // Smallest sample with at least percent of them at or below it
+  static u64
+  get_percentile (u64 const *sorted, u32 count, u32 percent)
+  {
+    u32 const rank = (u32) (((u64) count * percent + 99) / 100);
+
+    return sorted[hyper::max (rank, 1u) - 1];
+  }
+
+  Bench_timings
+  bench_get_timings (u64 *samples, u32 count)
+  {
+    Bench_timings timings {};
+    if (!count)
+      return timings;
+
+    std::sort (samples, samples + count);
+
+    u64 sum = 0;
+    for (u32 i = 0; i < count; ++i)
+      sum += samples[i];
+
+    timings.p50 = get_percentile (samples, count, 50);
+    timings.p95 = get_percentile (samples, count, 95);
+    timings.p99 = get_percentile (samples, count, 99);
+    timings.max = samples[count - 1];
+    timings.mean = sum / count;
+
+    return timings;
+  }
+
+  static void
+  write_timings (FILE *file, Bench_timings const &timings)
+  {
+    // Milliseconds, nanoseconds are too many digits to read
+    fprintf (file, "{ \"p50\": %.4f, \"p95\": %.4f, \"p99\": %.4f, \"max\": %.4f, \"mean\": %.4f }",
+             (f64) timings.p50 / 1e6, (f64) timings.p95 / 1e6, (f64) timings.p99 / 1e6,
+             (f64) timings.max / 1e6, (f64) timings.mean / 1e6);
+  }
+
+  bool
+  bench_write_json (char const *path, Bench_result const *results, u32 count, i32 width, i32 height, u64 seed, bool anti_aliasing)
+  {
+    FILE *file = path ? fopen (path, "w") : stdout;
+    if (!file)
+      {
+        std::cerr << "couldn't create " << path << '\n';
+        return false;
+      }
+
+    fprintf (file, "{\n  \"width\": %d,\n  \"height\": %d,\n  \"seed\": %llu,\n  \"anti_aliasing\": %s,\n  \"warmup_frames\": %u,\n  \"scenes\": [\n",
+             width, height, (unsigned long long) seed, anti_aliasing ? "true" : "false", bench_warmup_frames);
+
+    for (u32 i = 0; i < count; ++i)
+      {
+        Bench_result const &result = results[i];
+
+        fprintf (file, "    {\n      \"name\": \"%s\",\n      \"frames\": %u,\n      \"frame_ms\": ", result.scene->name, result.frame_count);
+        write_timings (file, result.frame);
+        fprintf (file, ",\n      \"stage_ms\": {\n");
+
+        for (size_t stage = 0; stage < result.stages.size (); ++stage)
+          {
+            fprintf (file, "        \"%s\": ", bench_stage_names[stage]);
+            write_timings (file, result.stages[stage]);
+            fprintf (file, stage + 1 < result.stages.size () ? ",\n" : "\n");
+          }
+
+        fprintf (file, "      },\n      \"max_draw_calls\": %u,\n      \"stack_arena_peak\": %zu,\n      \"linear_arena_used\": %zu\n    }%s\n",
+                 result.max_draw_calls, result.stack_arena_peak, result.linear_arena_used, i + 1 < count ? "," : "");
+      }
+
+    fprintf (file, "  ]\n}\n");
+
+    bool const written = !ferror (file);
+    if ((path && fclose (file) != 0) || !written)
+      {
+        std::cerr << "couldn't write " << (path ? path : "the results") << '\n';
+        return false;
+      }
+
+    return true;
+  }
+};
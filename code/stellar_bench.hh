@@ -0,0 +1,95 @@
+//
+// Scene benchmarks. Scripted scenes run for a fixed number of frames
+// through the same update and render as the game, one tick per frame
+// and nothing waiting, and the results go out as JSON so runs from
+// different commits can be compared.
+//
+#pragma once
+
+#include "hyper.hh"
+#include "stellar.hh"
+
+#include <array>
+
+namespace stellar
+{
+  // Frames run before measuring, caches and sectors settle down
+  inline constexpr u32 bench_warmup_frames = 60;
+  // A sample is kept for every frame measured
+  inline constexpr u32 bench_max_frames = 100'000;
+
+  struct Bench_scene
+  {
+    char const *name;
+    // The normal world is scaled by this on each side
+    f32 world_scale;
+    u32 fleet_ships;
+    // Part of the world the fleet is spread over, around its centre
+    f32 fleet_spread;
+    // Top drift speed, 0 holds the ships still
+    f32 fleet_speed;
+    f32 zoom;
+    // Where the camera starts, as a fraction of the world
+    hyper::Vec2<f32> camera;
+    // Right is held the whole time
+    bool pan;
+  };
+
+  inline constexpr std::array<Bench_scene, 6> bench_scenes {{
+      // The game as it is
+      { "default", 1.0f, 0, 0.0f, 0.0f, 1.0f, { 0.5f, 0.5f }, false },
+      // About 10k stars in the world, streamed through the sector
+      // cache while panning across it
+      { "stars", 3.0f, 0, 0.0f, 0.0f, 0.5f, { 0.2f, 0.5f }, true },
+      // As many ships as physics takes, all of them on screen
+      { "ships", 1.0f, fleet_max_ships, 1.0f, 20.0f, 0.8f, { 0.5f, 0.5f }, false },
+      // The same ships holding still, their transforms stay cached
+      { "formation", 1.0f, fleet_max_ships, 1.0f, 0.0f, 0.8f, { 0.5f, 0.5f }, false },
+      // Close up on a crowd, overlapping exhaust glows everywhere
+      { "glow", 1.0f, 256, 0.15f, 20.0f, 2.0f, { 0.5f, 0.5f }, false },
+      // Everything gets culled
+      { "offscreen", 1.0f, fleet_max_ships, 1.0f, 20.0f, 1.0f, { -4.0f, -4.0f }, false },
+    }};
+
+  enum class Bench_stage
+    {
+      update,
+      render,
+      // Framebuffer to the texture
+      upload,
+      present,
+
+      count
+    };
+
+  // Nanoseconds
+  struct Bench_timings
+  {
+    u64 p50;
+    u64 p95;
+    u64 p99;
+    u64 max;
+    u64 mean;
+  };
+
+  struct Bench_result
+  {
+    Bench_scene const *scene;
+    u32 frame_count;
+    Bench_timings frame;
+    std::array<Bench_timings, (size_t) Bench_stage::count> stages;
+    u32 max_draw_calls;
+    size_t stack_arena_peak;
+    size_t linear_arena_used;
+  };
+
+  // Null if there's no scene with that name
+  Bench_scene const *bench_find_scene (char const *);
+
+  // Nearest rank percentiles, sorts the samples
+  Bench_timings bench_get_timings (u64 *, u32);
+
+  // To stdout when the path is null. Takes the results, their count,
+  // the resolution, the seed and whether edges were anti-aliased.
+  bool bench_write_json (char const *, Bench_result const *, u32, i32, i32, u64, bool);
+};
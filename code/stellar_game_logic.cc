@@ -2,52 +2,166 @@
 #include "hyper_renderer.hh"
 #include "hyper_colour.hh"
 #include "hyper_math.hh"
+#include "hyper_physics.hh"
+#include "hyper_transform_hierarchy.hh"
+#include "hyper_input.hh"
+#include "stellar_starfield.hh"
 
 #include <array>
+#include <cmath>
 
-STELLAR_API void
-game_update ([[maybe_unused]] hyper::Frame_context &context, [[maybe_unused]] stellar::Game_data &game_data)
+// The draw functions take triangles by value
+static std::array<hyper::Vec2<f32>, 3>
+get_triangle (hyper::Vec2<f32> const *vertices)
 {
-  // here I'm going to do my physics update stuff
+  return { vertices[0], vertices[1], vertices[2] };
 }
 
-STELLAR_API void
-game_render (hyper::Frame_context &context, stellar::Game_data &game_data)
+// Seconds each key spent held during the tick, the held state moves
+// on to the end of the tick on the way
+static std::array<f32, (size_t) hyper::Key::count>
+get_key_held_times (hyper::Tick_input const &input, std::array<bool, (size_t) hyper::Key::count> &keys_held, f32 fixed_timestep)
 {
-  // Draw black background
-  hyper::set_background_colour (context.renderer_context, hyper::get_colour_from_preset (hyper::BLACK));
+  std::array<f32, (size_t) hyper::Key::count> held_times {};
+  f32 previous_time = 0.0f;
 
-  // Draw background stars (FIXME: blink stars)
-  for (size_t i = 0; i < game_data.stars.size (); ++i)
+  for (u32 i = 0; i < input.event_count; ++i)
     {
-      hyper::draw_circle_filled (context.renderer_context,
-                                 game_data.stars[i].body.center.x,
-                                 game_data.stars[i].body.center.y,
-                                 game_data.stars[i].body.radius,
-                                 game_data.stars[i].colour);
+      hyper::Input_event const &event = input.events[i];
+      f32 const time = hyper::clamp ((f32) event.timestamp_us * 1e-6f, previous_time, fixed_timestep);
+
+      for (size_t key = 0; key < keys_held.size (); ++key)
+        if (keys_held[key])
+          held_times[key] += time - previous_time;
+
+      keys_held[(size_t) event.key] = event.down;
+      previous_time = time;
     }
 
+  for (size_t key = 0; key < keys_held.size (); ++key)
+    if (keys_held[key])
+      held_times[key] += fixed_timestep - previous_time;
+
+  return held_times;
+}
+
+STELLAR_API void
+game_update (hyper::Frame_context &context, stellar::Game_data &game_data)
+{
+  std::array<f32, (size_t) hyper::Key::count> const held_times = get_key_held_times (*context.input, game_data.keys_held, context.fixed_timestep);
+
+  game_data.camera.x += stellar::camera_speed * (held_times[(size_t) hyper::Key::right] - held_times[(size_t) hyper::Key::left]);
+  game_data.camera.y += stellar::camera_speed * (held_times[(size_t) hyper::Key::down] - held_times[(size_t) hyper::Key::up]);
+
+  hyper::physics_integrate (game_data.physics, context.fixed_timestep);
+}
+
+// Every ship is drawn with the same parts, the world vertices come from
+// its transform nodes
+static void
+draw_ship (hyper::Renderer_context *renderer_context, stellar::Ship const &ship, hyper::Transform_hierarchy const &transforms, u32 root)
+{
+  auto const get_vertices = [&] (stellar::Ship_node node) { return hyper::transform_get_world_vertices (transforms, root + (u32) node); };
+
+  // Draw hull, the outlines go on top
+  hyper::draw_polygon_filled (renderer_context,
+                              get_vertices (stellar::Ship_node::hull),
+                              transforms.vertex_counts[root + (u32) stellar::Ship_node::hull],
+                              ship.hull.colour);
+
   // Draw body
-  hyper::draw_triangle_outline (context.renderer_context, game_data.ship.body.data.vertices, game_data.ship.body.colour);
+  hyper::draw_triangle_outline (renderer_context, get_triangle (get_vertices (stellar::Ship_node::body)), ship.body.colour);
   // Left wing
-  hyper::draw_triangle_outline (context.renderer_context, game_data.ship.wings.left.vertices, game_data.ship.wings.colour);
+  hyper::draw_triangle_outline (renderer_context, get_triangle (get_vertices (stellar::Ship_node::wing_left)), ship.wings.colour);
   // Right wing
-  hyper::draw_triangle_outline (context.renderer_context, game_data.ship.wings.right.vertices, game_data.ship.wings.colour);
+  hyper::draw_triangle_outline (renderer_context, get_triangle (get_vertices (stellar::Ship_node::wing_right)), ship.wings.colour);
 
   // Draw cockpit
-  hyper::draw_triangle_filled (context.renderer_context, game_data.ship.cockpit.data.vertices, game_data.ship.cockpit.colour);
+  hyper::draw_triangle_filled (renderer_context, get_triangle (get_vertices (stellar::Ship_node::cockpit)), ship.cockpit.colour);
 
   // Draw thrusters
+  hyper::Vec2<f32> const *thrusters = get_vertices (stellar::Ship_node::thrusters);
   // Left
-  hyper::draw_quad_filled (context.renderer_context,
-                           game_data.ship.thrusters.data[0].position,
-                           game_data.ship.thrusters.width,
-                           game_data.ship.thrusters.height,
-                           game_data.ship.thrusters.colour);
+  hyper::draw_quad_filled (renderer_context, thrusters[0], ship.thrusters.width, ship.thrusters.height, ship.thrusters.colour);
   // Right
-  hyper::draw_quad_filled (context.renderer_context,
-                           game_data.ship.thrusters.data[1].position,
-                           game_data.ship.thrusters.width,
-                           game_data.ship.thrusters.height,
-                           game_data.ship.thrusters.colour);
+  hyper::draw_quad_filled (renderer_context, thrusters[1], ship.thrusters.width, ship.thrusters.height, ship.thrusters.colour);
+
+  // Exhaust glow, brightens what's under it
+  hyper::Vec2<f32> const *exhaust = get_vertices (stellar::Ship_node::exhaust);
+  renderer_context->blend_mode = hyper::Blend_mode::additive;
+  hyper::draw_triangle_shaded (renderer_context, get_triangle (exhaust), ship.exhaust.colours);
+  hyper::draw_triangle_shaded (renderer_context, get_triangle (exhaust + 3), ship.exhaust.colours);
+  renderer_context->blend_mode = hyper::Blend_mode::opaque;
+}
+
+STELLAR_API void
+game_render (hyper::Frame_context &context, stellar::Game_data &game_data)
+{
+  // Draw black background
+  hyper::set_background_colour (context.renderer_context, hyper::BLACK);
+
+  // Draw background stars (FIXME: blink stars), only the sectors on
+  // screen get generated
+  stellar::Game_cache &cache = *static_cast<stellar::Game_cache *> (context.game_cache);
+  stellar::Starfield &starfield = cache.starfield;
+  ++starfield.frame;
+
+  stellar::Star_sector_range const sectors = stellar::starfield_get_visible_sectors (starfield, context.renderer_context);
+  // The camera's own zoom, the render scale shrinks the stars' spacing
+  // and their size alike so the density on screen doesn't change
+  f32 const lod_fraction = stellar::starfield_get_lod_fraction (game_data.camera.zoom);
+
+  for (i32 sector_y = sectors.y_start; sector_y <= sectors.y_end; ++sector_y)
+    {
+      for (i32 sector_x = sectors.x_start; sector_x <= sectors.x_end; ++sector_x)
+        {
+          stellar::Star_sector const &sector = stellar::starfield_get_sector (starfield, sector_x, sector_y);
+
+          // Ranks grow with the index, the rest are thinned out too
+          for (u32 i = 0; i < sector.star_count && sector.stars[i].lod_rank < lod_fraction; ++i)
+            {
+              hyper::draw_circle_filled (context.renderer_context,
+                                         sector.stars[i].body.center.x,
+                                         sector.stars[i].body.center.y,
+                                         sector.stars[i].body.radius,
+                                         sector.stars[i].colour);
+            }
+        }
+    }
+
+  // The task fills in the border around these between frames
+  stellar::starfield_prefetch_update (cache.starfield_prefetch, starfield, context.renderer_context);
+
+  // Blend the last two physics states, so motion is smooth even when
+  // rendering faster than the fixed timestep
+  auto *render_state = static_cast<hyper::Physics_render_state *> (context.renderer_context->stack_arena->resource.allocate (sizeof (hyper::Physics_render_state),
+                                                                                                                            alignof (hyper::Physics_render_state)));
+  hyper::physics_interpolate (game_data.physics, context.alpha_rendering, *render_state);
+
+  // Ships follow their bodies, the ones that didn't move since last
+  // frame don't cost any transform work
+  hyper::Transform_hierarchy &transforms = *context.transforms;
+  auto const place_ship = [&] (u32 node, u32 body) {
+    hyper::transform_set_local (transforms, node, { render_state->position_x[body], render_state->position_y[body] }, render_state->rotation[body]);
+  };
+
+  for (u32 i = 0; i < game_data.fleet.count; ++i)
+    place_ship (game_data.fleet.transform_nodes[i], game_data.fleet.physics_bodies[i]);
+
+  place_ship (game_data.ship.transform_node, game_data.ship.physics_body);
+  hyper::transform_hierarchy_update (transforms);
+
+  // The rest of the fleet first, the player's ship on top
+  for (u32 i = 0; i < game_data.fleet.count; ++i)
+    draw_ship (context.renderer_context, game_data.ship, transforms, game_data.fleet.transform_nodes[i]);
+
+  draw_ship (context.renderer_context, game_data.ship, transforms, game_data.ship.transform_node);
+}
+
+STELLAR_API void
+game_add_tasks (hyper::Task_scheduler &tasks, hyper::Frame_context &context)
+{
+  // Tasks only write to the cache, the simulation stays in game_update
+  stellar::Game_cache &cache = *static_cast<stellar::Game_cache *> (context.game_cache);
+  hyper::task_scheduler_add (tasks, stellar::starfield_prefetch_step, &cache.starfield_prefetch);
 }
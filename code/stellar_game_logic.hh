@@ -2,6 +2,7 @@
 
 #include "hyper.hh"
 #include "stellar.hh"
+#include "hyper_task_scheduler.hh"
 
 // NOTE: this file will be compiled into a shared library and will be
 // hot reloaded! Careful with what I put here, especially state
@@ -12,8 +13,8 @@
 // libraries with hidden visiblity and then being explicit about which
 // functions should be visible. What do I know anyway
 
-// Function names should be game_update and game_render for hyper to
-// pick them up
+// Function names should be game_update, game_render and game_add_tasks
+// for hyper to pick them up
 
 #define STELLAR_API __attribute__((visibility ("default")))
 
@@ -22,4 +23,8 @@ extern "C"
   STELLAR_API void game_update (hyper::Frame_context &, stellar::Game_data &);
 
   STELLAR_API void game_render (hyper::Frame_context &, stellar::Game_data &);
+
+  // Called again after every reload, the steps of the old library are
+  // gone with it
+  STELLAR_API void game_add_tasks (hyper::Task_scheduler &, hyper::Frame_context &);
 }
@@ -1,5 +1,8 @@
+#include <cerrno>
 #include <cstdlib>
+#include <cstring>
 #include <iostream>
+#include <iterator>
 #include <random>
 #include <SDL3/SDL.h>
 
@@ -10,8 +13,28 @@
 #include "hyper_renderer.hh"
 #include "stellar_hot_reload.hh"
 #include "stellar_game_logic.hh"
+#include "stellar_starfield.hh"
 #include "hyper_stack_arena.hh"
 #include "hyper_geometry.hh"
+#include "hyper_physics.hh"
+#include "hyper_jobs.hh"
+#include "hyper_input.hh"
+#include "hyper_replay.hh"
+#include "hyper_clock.hh"
+#include "hyper_frame_pacer.hh"
+#include "hyper_dynamic_resolution.hh"
+#include "hyper_font.hh"
+#include "hyper_perf_hud.hh"
+#include "hyper_virtual_memory.hh"
+#include "hyper_frame_capture.hh"
+#include "hyper_asset_pack.hh"
+#include "hyper_snapshot.hh"
+#include "hyper_perf_counters.hh"
+#include "hyper_transform_hierarchy.hh"
+#include "hyper_random.hh"
+#include "hyper_task_scheduler.hh"
+#include "hyper_render_stats.hh"
+#include "stellar_bench.hh"
 
 static void quit ();
 
@@ -19,27 +42,68 @@ static void quit ();
 #define GAME_LOGIC_SHARED_LIBRARY_NAME "libgamelogic.so"
 #define GAME_WORLD_WIDTH 1250.0f
 #define GAME_WORLD_HEIGHT 937.5f
+#define SHIP_SPAWN_KIND 0
 
 static f32 constexpr fixed_timestep = 1.0f / 60.0f;
+// Tasks stop this long before the next frame starts, and get this much
+// time when there's no frame rate cap to leave time over
+static u64 constexpr task_margin_ns = 500'000;
+static u64 constexpr task_uncapped_slice_ns = 200'000;
+// Looked for next to the executable when --assets isn't given
+static char const *const default_assets_file_name = "stellar.pack";
+// 3600 snapshots at the fixed timestep
+static f32 constexpr max_rewind_seconds = 60.0f;
+static f32 constexpr min_target_fps = 1.0f;
+static f32 constexpr max_target_fps = 1000.0f;
 
 // SDL globals
 static SDL_Window *sdl_window = nullptr;
 static SDL_Texture *sdl_texture = nullptr;
+static SDL_Texture *sdl_hud_texture = nullptr;
 static SDL_Renderer *sdl_renderer = nullptr;
 
 // Game globals
 static stellar::Config game_config;
 static stellar::State game_state;
 static hyper::Fixed_memory_resource fixed_resource;
-static std::array<std::byte, hyper::megabytes (128)> linear_arena_backing_buffer;
-static std::array<std::byte, hyper::megabytes (32)> stack_arena_backing_buffer;
+static hyper::Arena_backing linear_arena_backing;
+static hyper::Arena_backing stack_arena_backing;
 static hyper::Framebuffer game_framebuffer;
 static hyper::Renderer_context game_renderer_context;
 static hyper::Frame_context game_frame_context;
+static hyper::Job_system game_jobs;
 static stellar::Hot_reload_library_data game_logic_shared_library;
 static stellar::World game_world;
-static stellar::Camera game_camera;
 static stellar::Game_data game_data;
+static hyper::Replay_recorder game_replay_recorder;
+static hyper::Replay_player game_replay_player;
+// Key transitions waiting for the tick they happened in
+static hyper::Input_queue game_input_queue;
+// What the platform says is down right now
+static std::array<bool, (size_t) hyper::Key::count> game_keys_held;
+static hyper::Frame_pacer game_frame_pacer;
+static hyper::Dynamic_resolution game_dynamic_resolution;
+static hyper::Font game_font;
+static hyper::Perf_stats game_perf_stats;
+// Window sized whatever the render scale, only the top rows get used
+static hyper::Framebuffer game_hud_framebuffer;
+static i32 game_hud_rows;
+static hyper::Frame_capture game_frame_capture;
+static char game_default_assets_path[PATH_MAX];
+// Mapped for the whole run, content points into it
+static hyper::Asset_pack game_assets;
+// Game_data after every fixed tick, for rewinding
+static hyper::Snapshot_ring game_snapshots;
+// Only open with --perf-counters, the renderer context points to it
+static hyper::Perf_counters game_perf_counters;
+// The framebuffer points to it with --render-stats or the heatmap on
+static hyper::Render_stats game_render_stats;
+// Incremental work run in the time left over after each frame
+static hyper::Task_scheduler game_tasks;
+// Every ship's parts, the world vertices are cached between frames
+static hyper::Transform_hierarchy game_transforms;
+// The starfield's sectors, out of game_data so snapshots leave them be
+static stellar::Game_cache game_cache;
 
 // Internal functions
 [[noreturn]] static void
@@ -50,6 +114,22 @@ panic (char const *title, char const *msg)
   exit (EXIT_FAILURE);
 }
 
+// Counts at the start of a frame stage, nothing to do when the
+// counters are off
+static void
+begin_stage (hyper::Perf_counter_reading &start)
+{
+  if (game_renderer_context.perf_counters)
+    hyper::perf_counters_read (game_perf_counters, start);
+}
+
+static void
+end_stage (hyper::Perf_scope stage, hyper::Perf_counter_reading const &start)
+{
+  if (game_renderer_context.perf_counters)
+    hyper::perf_counters_add (game_perf_counters, stage, start);
+}
+
 static void
 toggle_vsync (void)
 {
@@ -58,15 +138,599 @@ toggle_vsync (void)
 }
 
 static void
-init (std::pmr::monotonic_buffer_resource &game_linear_arena, hyper::Stack_arena &stack_arena)
+cycle_target_fps (void)
+{
+  static f32 constexpr presets[] = { 60.0f, 144.0f, 240.0f, 0.0f };
+  size_t i = 0;
+
+  while (i < std::size (presets) && presets[i] != game_config.target_fps)
+    ++i;
+
+  game_config.target_fps = presets[(i + 1) % std::size (presets)];
+  hyper::frame_pacer_set_target_fps (game_frame_pacer, game_config.target_fps);
+
+  if (game_config.dynamic_resolution)
+    hyper::dynamic_resolution_set_target_fps (game_dynamic_resolution, game_config.target_fps);
+}
+
+static void
+toggle_just_in_time_rendering (void)
+{
+  game_config.just_in_time_rendering = !game_config.just_in_time_rendering;
+  game_frame_pacer.just_in_time = game_config.just_in_time_rendering;
+}
+
+static void
+toggle_dynamic_resolution (void)
+{
+  game_config.dynamic_resolution = !game_config.dynamic_resolution;
+  hyper::dynamic_resolution_set_target_fps (game_dynamic_resolution,
+                                            game_config.dynamic_resolution ? game_config.target_fps : 0.0f);
+}
+
+static void
+toggle_hud (void)
+{
+  game_config.show_hud = !game_config.show_hud;
+}
+
+static void
+toggle_anti_aliasing (void)
+{
+  game_config.anti_aliasing = !game_config.anti_aliasing;
+  game_renderer_context.anti_aliasing = game_config.anti_aliasing;
+}
+
+static void
+toggle_overdraw_heatmap (void)
+{
+  game_render_stats.heatmap = !game_render_stats.heatmap;
+
+  // The heatmap needs the counts, stats asked for stay on either way
+  game_framebuffer.stats = game_render_stats.heatmap || game_config.render_stats ? &game_render_stats : nullptr;
+}
+
+// Only the part that got rendered. Linear frames are a plain copy,
+// tiled ones get detiled straight into the texture.
+static void
+upload_framebuffer (void)
+{
+  SDL_Rect const render_rect = { 0, 0, game_framebuffer.width, game_framebuffer.height };
+
+  if (game_framebuffer.layout == hyper::Framebuffer_layout::linear)
+    {
+      SDL_UpdateTexture (sdl_texture, &render_rect, game_framebuffer.pixels.data (), game_framebuffer.pitch);
+      return;
+    }
+
+  void *pixels;
+  int pitch;
+  if (!SDL_LockTexture (sdl_texture, &render_rect, &pixels, &pitch))
+    panic ("SDL_LockTexture", SDL_GetError ());
+
+  hyper::framebuffer_copy_linear (game_framebuffer, static_cast<u32 *> (pixels), pitch, &game_jobs);
+  SDL_UnlockTexture (sdl_texture);
+}
+
+// Only the rows the HUD drew this frame
+static void
+upload_hud (void)
+{
+  SDL_Rect const hud_rect = { 0, 0, game_hud_framebuffer.width, game_hud_rows };
+  SDL_UpdateTexture (sdl_hud_texture, &hud_rect, game_hud_framebuffer.pixels.data (), game_hud_framebuffer.pitch);
+}
+
+static void
+print_usage (char const *program)
+{
+  std::cerr << "usage: " << program << " [--fps N] [--jit] [--dynamic-resolution [MIN_SCALE]] [--hud] [--anti-aliasing] [--tiled-framebuffer] [--linear-arena MB] [--stack-arena MB] [--lazy-arenas] [--perf-counters] [--render-stats] [--rewind SECONDS] [--seed N] [--record FILE] [--replay FILE [--fast]] [--capture FILE [--capture-format ppm|raw|rle]] [--assets FILE] [--bench SCENE|all [--bench-frames N] [--bench-output FILE]]\n";
+}
+
+// A whole number, nothing after it
+static bool
+parse_count (char const *text, u32 max, u32 &count)
+{
+  char *end;
+  unsigned long const value = strtoul (text, &end, 0);
+  if (end == text || *end || value > max)
+    return false;
+
+  count = (u32) value;
+  return true;
+}
+
+// Any 64-bit number, which strtoull only says didn't fit through errno
+static bool
+parse_seed (char const *text, u64 &seed)
+{
+  char *end;
+  errno = 0;
+  unsigned long long const value = strtoull (text, &end, 0);
+  if (end == text || *end || errno == ERANGE)
+    return false;
+
+  seed = value;
+  return true;
+}
+
+// Fast math would let NaN and infinity through a range check, so
+// they're caught on the bits
+static bool
+parse_real (char const *text, f32 &real)
+{
+  char *end;
+  f32 const value = strtof (text, &end);
+  u32 bits;
+  std::memcpy (&bits, &value, sizeof (bits));
+  if (end == text || *end || (bits & 0x7f800000u) == 0x7f800000u)
+    return false;
+
+  real = value;
+  return true;
+}
+
+static bool
+parse_seconds (char const *text, f32 &seconds)
+{
+  f32 value;
+  if (!parse_real (text, value) || value < 0.0f)
+    return false;
+
+  seconds = value;
+  return true;
+}
+
+// Zero is uncapped, anything else has to be a rate the frame time
+// conversions can take
+static bool
+parse_fps (char const *text, f32 &fps)
+{
+  f32 value;
+  if (!parse_real (text, value) || (value != 0.0f && (value < min_target_fps || value > max_target_fps)))
+    return false;
+
+  fps = value;
+  return true;
+}
+
+static bool
+parse_arguments (int argc, char **argv)
+{
+  game_config.target_fps = 144.0f;
+  game_config.min_render_scale = 0.5f;
+  game_config.linear_arena_megabytes = 128;
+  game_config.stack_arena_megabytes = 32;
+  game_config.capture_format = hyper::Capture_format::rle;
+  game_config.assets_path = nullptr;
+  game_config.rewind_seconds = 2.0f;
+  game_config.bench_frames = 1000;
+
+  for (int i = 1; i < argc; ++i)
+    {
+      bool const has_value = i + 1 < argc;
+
+      if (!strcmp (argv[i], "--fps") && has_value)
+        {
+          if (!parse_fps (argv[++i], game_config.target_fps))
+            return false;
+        }
+      else if (!strcmp (argv[i], "--jit"))
+        game_config.just_in_time_rendering = true;
+      else if (!strcmp (argv[i], "--dynamic-resolution"))
+        {
+          game_config.dynamic_resolution = true;
+
+          // The minimum scale is optional
+          if (has_value && argv[i + 1][0] != '-')
+            {
+              if (!parse_real (argv[++i], game_config.min_render_scale) || game_config.min_render_scale <= 0.0f || game_config.min_render_scale > 1.0f)
+                return false;
+            }
+        }
+      else if (!strcmp (argv[i], "--hud"))
+        game_config.show_hud = true;
+      else if (!strcmp (argv[i], "--tiled-framebuffer"))
+        game_config.tiled_framebuffer = true;
+      else if (!strcmp (argv[i], "--anti-aliasing"))
+        game_config.anti_aliasing = true;
+      else if (!strcmp (argv[i], "--linear-arena") && has_value)
+        {
+          // Has to fit the i32 megabytes () takes
+          if (!parse_count (argv[++i], INT32_MAX, game_config.linear_arena_megabytes))
+            return false;
+        }
+      else if (!strcmp (argv[i], "--stack-arena") && has_value)
+        {
+          if (!parse_count (argv[++i], INT32_MAX, game_config.stack_arena_megabytes))
+            return false;
+        }
+      else if (!strcmp (argv[i], "--lazy-arenas"))
+        game_config.lazy_arenas = true;
+      else if (!strcmp (argv[i], "--perf-counters"))
+        game_config.perf_counters = true;
+      else if (!strcmp (argv[i], "--render-stats"))
+        game_config.render_stats = true;
+      else if (!strcmp (argv[i], "--rewind") && has_value)
+        {
+          if (!parse_seconds (argv[++i], game_config.rewind_seconds) || game_config.rewind_seconds > max_rewind_seconds)
+            return false;
+        }
+      else if (!strcmp (argv[i], "--seed") && has_value)
+        {
+          if (!parse_seed (argv[++i], game_config.seed))
+            return false;
+
+          game_config.has_seed = true;
+        }
+      else if (!strcmp (argv[i], "--record") && has_value)
+        game_config.record_path = argv[++i];
+      else if (!strcmp (argv[i], "--replay") && has_value)
+        game_config.replay_path = argv[++i];
+      else if (!strcmp (argv[i], "--fast"))
+        game_config.replay_fast = true;
+      else if (!strcmp (argv[i], "--assets") && has_value)
+        game_config.assets_path = argv[++i];
+      else if (!strcmp (argv[i], "--bench") && has_value)
+        {
+          game_config.bench_scene = argv[++i];
+
+          if (strcmp (game_config.bench_scene, "all") && !stellar::bench_find_scene (game_config.bench_scene))
+            return false;
+        }
+      else if (!strcmp (argv[i], "--bench-frames") && has_value)
+        {
+          if (!parse_count (argv[++i], stellar::bench_max_frames, game_config.bench_frames))
+            return false;
+        }
+      else if (!strcmp (argv[i], "--bench-output") && has_value)
+        game_config.bench_output = argv[++i];
+      else if (!strcmp (argv[i], "--capture") && has_value)
+        game_config.capture_path = argv[++i];
+      else if (!strcmp (argv[i], "--capture-format") && has_value)
+        {
+          char const *format = argv[++i];
+
+          if (!strcmp (format, "ppm"))
+            game_config.capture_format = hyper::Capture_format::ppm;
+          else if (!strcmp (format, "raw"))
+            game_config.capture_format = hyper::Capture_format::raw;
+          else if (!strcmp (format, "rle"))
+            game_config.capture_format = hyper::Capture_format::rle;
+          else
+            return false;
+        }
+      else
+        return false;
+    }
+
+  // The stack arena takes a 32 bit size, the one it ends up with once
+  // it's rounded up to whole huge pages
+  if (!game_config.linear_arena_megabytes || !game_config.stack_arena_megabytes
+      || hyper::arena_backing_get_size (hyper::megabytes ((i32) game_config.stack_arena_megabytes)) > UINT32_MAX)
+    return false;
+
+  // Scenes are scripted, recorded input would fight with them
+  if (game_config.bench_scene
+      && (!game_config.bench_frames || game_config.record_path || game_config.replay_path))
+    return false;
+
+  // Fast only makes sense when there's no human playing
+  return !game_config.replay_fast || game_config.replay_path;
+}
+
+// Only the keys that affect the simulation, the rest never get
+// recorded
+static bool
+get_game_key (SDL_Keycode keycode, hyper::Key &key)
+{
+  switch (keycode)
+    {
+    case SDLK_UP:
+      key = hyper::Key::up;
+      return true;
+    case SDLK_DOWN:
+      key = hyper::Key::down;
+      return true;
+    case SDLK_LEFT:
+      key = hyper::Key::left;
+      return true;
+    case SDLK_RIGHT:
+      key = hyper::Key::right;
+      return true;
+    default:
+      return false;
+    }
+}
+
+// Adds every sample from the platform up to the end of the tick,
+// stamped relative to its start. Anything later stays queued for the
+// ticks it belongs to.
+static void
+get_tick_input (u64 tick_end_ns, hyper::Tick_input &input)
+{
+  u64 const fixed_timestep_ns = (u64) (game_frame_context.fixed_timestep * 1e9f);
+  u64 const tick_start_ns = tick_end_ns > fixed_timestep_ns ? tick_end_ns - fixed_timestep_ns : 0;
+  hyper::Input_sample sample;
+
+  while (input.event_count < hyper::tick_input_max_events && hyper::input_queue_pop_before (game_input_queue, tick_end_ns, sample))
+    {
+      // Late frames leave samples from before the tick, they happen
+      // as it starts
+      u64 const offset_ns = sample.timestamp_ns > tick_start_ns ? sample.timestamp_ns - tick_start_ns : 0;
+
+      hyper::Input_event event;
+      event.timestamp_us = (u32) (offset_ns / 1000);
+      event.key = sample.key;
+      event.down = sample.down;
+
+      hyper::tick_input_push (input, event);
+    }
+}
+
+// Restored snapshots remember the keys as they were back then, the
+// ones that changed since are fixed as the tick starts
+static void
+push_held_key_changes (hyper::Tick_input &input)
+{
+  for (size_t key = 0; key < game_keys_held.size (); ++key)
+    if (game_data.keys_held[key] != game_keys_held[key])
+      {
+        hyper::Input_event event;
+        event.timestamp_us = 0;
+        event.key = (hyper::Key) key;
+        event.down = game_keys_held[key];
+
+        hyper::tick_input_push (input, event);
+      }
+}
+
+// Packed 32 bit formats hyper can render to directly
+static bool
+get_pixel_format (SDL_PixelFormat sdl_format, hyper::Pixel_format &format)
+{
+  switch (sdl_format)
+    {
+    case SDL_PIXELFORMAT_RGBA8888:
+    case SDL_PIXELFORMAT_RGBX8888:
+      format = hyper::Pixel_format::rgba8888;
+      return true;
+    case SDL_PIXELFORMAT_ARGB8888:
+    case SDL_PIXELFORMAT_XRGB8888:
+      format = hyper::Pixel_format::argb8888;
+      return true;
+    case SDL_PIXELFORMAT_ABGR8888:
+    case SDL_PIXELFORMAT_XBGR8888:
+      format = hyper::Pixel_format::abgr8888;
+      return true;
+    case SDL_PIXELFORMAT_BGRA8888:
+    case SDL_PIXELFORMAT_BGRX8888:
+      format = hyper::Pixel_format::bgra8888;
+      return true;
+    default:
+      return false;
+    }
+}
+
+// The renderer lists its texture formats best first, pick the first
+// one I can write so SDL never has to convert on upload
+static SDL_PixelFormat
+choose_texture_format (hyper::Pixel_format &format)
+{
+  SDL_PropertiesID const properties = SDL_GetRendererProperties (sdl_renderer);
+  auto const *formats = static_cast<SDL_PixelFormat const *> (SDL_GetPointerProperty (properties,
+                                                                                      SDL_PROP_RENDERER_TEXTURE_FORMATS_POINTER,
+                                                                                      nullptr));
+
+  for (; formats && *formats != SDL_PIXELFORMAT_UNKNOWN; ++formats)
+    {
+      if (get_pixel_format (*formats, format))
+        return *formats;
+    }
+
+  format = hyper::Pixel_format::rgba8888;
+  return SDL_PIXELFORMAT_RGBA8888;
+}
+
+// Same layout as the frame's texture but with alpha, the HUD lets the
+// frame through where it has no text
+static SDL_PixelFormat
+get_alpha_texture_format (hyper::Pixel_format format)
+{
+  switch (format)
+    {
+    case hyper::Pixel_format::argb8888:
+      return SDL_PIXELFORMAT_ARGB8888;
+    case hyper::Pixel_format::abgr8888:
+      return SDL_PIXELFORMAT_ABGR8888;
+    case hyper::Pixel_format::bgra8888:
+      return SDL_PIXELFORMAT_BGRA8888;
+    case hyper::Pixel_format::rgba8888:
+    default:
+      return SDL_PIXELFORMAT_RGBA8888;
+    }
+}
+
+// Asset with exactly count elements, anything else means the pack
+// doesn't match the game
+template <typename T>
+static T const *
+get_assets (hyper::Asset_pack const &pack, char const *name, u32 count)
+{
+  u32 found;
+  T const *data = hyper::asset_pack_get<T> (pack, name, found);
+  if (!data || found != count)
+    panic ("missing asset", name);
+
+  return data;
+}
+
+static hyper::Spawn
+get_spawn (hyper::Asset_pack const &pack, char const *name, u32 kind)
+{
+  u32 count;
+  hyper::Spawn const *spawns = hyper::asset_pack_get<hyper::Spawn> (pack, name, count);
+
+  for (u32 i = 0; i < count; ++i)
+    if (spawns[i].kind == kind)
+      return spawns[i];
+
+  panic ("missing spawn", name);
+}
+
+// The ship is small and lives in Game_data, so it's copied out of the
+// pack instead of pointing into it
+static void
+load_ship (hyper::Asset_pack const &pack)
+{
+  stellar::Ship &ship = game_data.ship;
+
+  std::memcpy (ship.body.data.vertices.data (), get_assets<hyper::Vec2<f32>> (pack, "ship.body", 3), sizeof (ship.body.data.vertices));
+  std::memcpy (ship.wings.left.vertices.data (), get_assets<hyper::Vec2<f32>> (pack, "ship.wing.left", 3), sizeof (ship.wings.left.vertices));
+  std::memcpy (ship.wings.right.vertices.data (), get_assets<hyper::Vec2<f32>> (pack, "ship.wing.right", 3), sizeof (ship.wings.right.vertices));
+  std::memcpy (ship.cockpit.data.vertices.data (), get_assets<hyper::Vec2<f32>> (pack, "ship.cockpit", 3), sizeof (ship.cockpit.data.vertices));
+
+  // Any outline up to the polygon's limit
+  u32 hull_count;
+  hyper::Vec2<f32> const *hull = hyper::asset_pack_get<hyper::Vec2<f32>> (pack, "ship.hull", hull_count);
+  if (!hull || hull_count < 3 || hull_count > hyper::polygon_max_vertices)
+    panic ("missing asset", "ship.hull");
+
+  std::memcpy (ship.hull.data.vertices.data (), hull, hull_count * sizeof (hyper::Vec2<f32>));
+  ship.hull.data.vertex_count = hull_count;
+
+  hyper::Quad const *thrusters = get_assets<hyper::Quad> (pack, "ship.thrusters", 2);
+  ship.thrusters.data[0] = thrusters[0];
+  ship.thrusters.data[1] = thrusters[1];
+  ship.thrusters.width = thrusters[0].width;
+  ship.thrusters.height = thrusters[0].height;
+
+  hyper::Vec2<f32> const *exhaust = get_assets<hyper::Vec2<f32>> (pack, "ship.exhaust", 6);
+  std::memcpy (ship.exhaust.data[0].vertices.data (), exhaust, sizeof (ship.exhaust.data[0].vertices));
+  std::memcpy (ship.exhaust.data[1].vertices.data (), exhaust + 3, sizeof (ship.exhaust.data[1].vertices));
+  std::memcpy (ship.exhaust.colours.data (), get_assets<hyper::Colour> (pack, "ship.exhaust.colours", 3), sizeof (ship.exhaust.colours));
+
+  // body, wings, cockpit, thrusters, hull
+  hyper::Colour const *colours = get_assets<hyper::Colour> (pack, "ship.colours", 5);
+  ship.body.colour = colours[0];
+  ship.wings.colour = colours[1];
+  ship.cockpit.colour = colours[2];
+  ship.thrusters.colour = colours[3];
+  ship.hull.colour = colours[4];
+}
+
+// A root that follows the ship's body and one child per part, in
+// Ship_node order. Returns the root.
+static u32
+add_ship_transforms (stellar::Ship const &ship)
+{
+  u32 const root = hyper::transform_add_node (game_transforms, hyper::transform_no_parent, { 0.0f, 0.0f }, 0.0f, nullptr, 0);
+  auto const add_part = [root] (hyper::Vec2<f32> const *vertices, u32 count) {
+    return hyper::transform_add_node (game_transforms, root, { 0.0f, 0.0f }, 0.0f, vertices, count);
+  };
+
+  hyper::Vec2<f32> const thrusters[] = { ship.thrusters.data[0].position, ship.thrusters.data[1].position };
+  hyper::Vec2<f32> exhaust[6];
+  std::memcpy (exhaust, ship.exhaust.data[0].vertices.data (), sizeof (ship.exhaust.data[0].vertices));
+  std::memcpy (exhaust + 3, ship.exhaust.data[1].vertices.data (), sizeof (ship.exhaust.data[1].vertices));
+
+  add_part (ship.hull.data.vertices.data (), ship.hull.data.vertex_count);
+  add_part (ship.body.data.vertices.data (), 3);
+  add_part (ship.wings.left.vertices.data (), 3);
+  add_part (ship.wings.right.vertices.data (), 3);
+  add_part (ship.cockpit.data.vertices.data (), 3);
+  add_part (thrusters, 2);
+
+  // Full if the last one didn't fit
+  if (add_part (exhaust, 6) == hyper::transform_max_nodes)
+    panic ("transform_add_node", "no room for another ship");
+
+  return root;
+}
+
+// The world, the starfield and the player's ship, needs the assets and
+// the framebuffer
+static void
+init_game_data (f32 world_width, f32 world_height)
+{
+  game_data.camera.x = static_cast<f32> (game_renderer_context.framebuffer->width >> 1);
+  game_data.camera.y = static_cast<f32> (game_renderer_context.framebuffer->height >> 1);
+  game_data.camera.zoom = 1.0f;
+
+  game_world.width = world_width;
+  game_world.height = world_height;
+  game_world.meters_per_pixel = 1.0f / game_data.camera.zoom; // FIXME: is this right?
+  game_renderer_context.meters_per_pixel = game_world.meters_per_pixel;
+
+  // Stars are generated lazily, per sector, from the seed
+  stellar::starfield_init (game_cache.starfield, game_config.seed, game_world.width, game_world.height);
+
+  // Initialise ship, parts are relative to its physics body
+  hyper::physics_init (game_data.physics);
+  hyper::Spawn const ship_spawn = get_spawn (game_assets, "level.spawns", SHIP_SPAWN_KIND);
+  game_data.ship.physics_body = hyper::physics_add_body (game_data.physics, ship_spawn.position, ship_spawn.rotation);
+
+  load_ship (game_assets);
+
+  hyper::transform_hierarchy_init (game_transforms);
+  game_data.ship.transform_node = add_ship_transforms (game_data.ship);
+}
+
+static void
+init (hyper::Counting_memory_resource &game_linear_arena, hyper::Stack_arena &stack_arena)
 {
   // Initialise game config
   game_config.resolution.width = 1024;
   game_config.resolution.height = 768;
-  game_config.target_fps = fixed_timestep;
   game_config.vsync = false;
   game_state.running = true;
 
+  // Recording and replaying, the seed comes from the replay if there's one
+  if (game_config.replay_path)
+    {
+      if (!hyper::replay_player_open (game_replay_player, game_config.replay_path, &game_linear_arena))
+        panic ("replay_player_open", game_config.replay_path);
+
+      if (game_replay_player.fixed_timestep != fixed_timestep)
+        std::cerr << "replay was recorded with a different fixed timestep, it won't match\n";
+
+      game_config.seed = game_replay_player.seed;
+      game_config.has_seed = true;
+    }
+
+  // Bench runs get compared with each other, same stars every time
+  if (game_config.bench_scene && !game_config.has_seed)
+    {
+      game_config.seed = 0;
+      game_config.has_seed = true;
+    }
+
+  if (!game_config.has_seed)
+    {
+      std::random_device random_seed;
+      game_config.seed = (u64) random_seed () << 32 | random_seed ();
+    }
+
+  if (game_config.record_path
+      && !hyper::replay_recorder_open (game_replay_recorder, game_config.record_path, game_config.seed, fixed_timestep, &game_linear_arena))
+    panic ("replay_recorder_open", game_config.record_path);
+
+  // Content, baked by make
+  if (!game_config.assets_path)
+    {
+      char const *base_path = SDL_GetBasePath ();
+      if (!base_path)
+        panic ("SDL_GetBasePath", SDL_GetError ());
+
+      i32 const length = snprintf (game_default_assets_path, sizeof (game_default_assets_path), "%s%s", base_path, default_assets_file_name);
+      if (length < 0 || (size_t) length >= sizeof (game_default_assets_path))
+        panic ("asset_pack_open", "path too long");
+
+      game_config.assets_path = game_default_assets_path;
+    }
+
+  if (!hyper::asset_pack_open (game_assets, game_config.assets_path))
+    panic ("asset_pack_open", game_config.assets_path);
+
   // Initialise SDL stuff using game's config
   if (!SDL_Init (SDL_INIT_VIDEO))
     panic ("SDL_Init", SDL_GetError ());
@@ -79,187 +743,190 @@ init (std::pmr::monotonic_buffer_resource &game_linear_arena, hyper::Stack_arena
   if (!sdl_renderer)
     panic ("SDL_CreateRenderer", SDL_GetError ());
 
+  hyper::Pixel_format framebuffer_format;
+  SDL_PixelFormat const texture_format = choose_texture_format (framebuffer_format);
+
   sdl_texture = SDL_CreateTexture (sdl_renderer,
-                                   SDL_PIXELFORMAT_RGBA8888,
+                                   texture_format,
                                    SDL_TEXTUREACCESS_STREAMING,
                                    game_config.resolution.width,
                                    game_config.resolution.height);
   if (!sdl_texture)
     panic ("SDL_CreateTexture", SDL_GetError ());
 
+  // The HUD is drawn over the frame after it's scaled up, so its text
+  // stays sharp at any render scale
+  sdl_hud_texture = SDL_CreateTexture (sdl_renderer,
+                                       get_alpha_texture_format (framebuffer_format),
+                                       SDL_TEXTUREACCESS_STREAMING,
+                                       game_config.resolution.width,
+                                       game_config.resolution.height);
+  if (!sdl_hud_texture)
+    panic ("SDL_CreateTexture", SDL_GetError ());
+
+  SDL_SetTextureBlendMode (sdl_hud_texture, SDL_BLENDMODE_BLEND);
+
   // Frame and context
-  game_framebuffer.width = game_config.resolution.width;
-  game_framebuffer.height = game_config.resolution.height;
-  game_framebuffer.pitch = game_framebuffer.width * (i32) sizeof (u32);
+  // Allocated once at full size, lower render scales use the front of it
+  game_framebuffer.max_width = game_config.resolution.width;
+  game_framebuffer.max_height = game_config.resolution.height;
+  // Rounded up to whole rows of tiles in case it's tiled
+  i32 const max_rows = (game_framebuffer.max_height + hyper::framebuffer_tile_size - 1) & ~(hyper::framebuffer_tile_size - 1);
   std::pmr::vector<u32> data {&game_linear_arena};
-  data.resize ((u32) game_framebuffer.width * (u32) game_framebuffer.height, 0x00);
+  data.resize ((u32) game_framebuffer.max_width * (u32) max_rows, 0x00);
   game_framebuffer.pixels = std::move (data);
-  game_framebuffer.simd_chunks = game_framebuffer.pixels.size () / 8; // AVX2
+  hyper::framebuffer_set_layout (&game_framebuffer, game_config.tiled_framebuffer ? hyper::Framebuffer_layout::tiled : hyper::Framebuffer_layout::linear);
+  hyper::framebuffer_set_render_scale (&game_framebuffer, 1.0f);
+  hyper::framebuffer_set_format (&game_framebuffer, framebuffer_format);
+
+  // Cleared to transparent, the HUD can be turned on while playing
+  game_hud_framebuffer.max_width = game_config.resolution.width;
+  game_hud_framebuffer.max_height = game_config.resolution.height;
+  std::pmr::vector<u32> hud_data {&game_linear_arena};
+  hud_data.resize ((u32) game_hud_framebuffer.max_width * (u32) game_hud_framebuffer.max_height, 0x00);
+  game_hud_framebuffer.pixels = std::move (hud_data);
+  hyper::framebuffer_set_layout (&game_hud_framebuffer, hyper::Framebuffer_layout::linear);
+  hyper::framebuffer_set_render_scale (&game_hud_framebuffer, 1.0f);
+  hyper::framebuffer_set_format (&game_hud_framebuffer, framebuffer_format);
+
+  // Allocated either way, the heatmap can be turned on while playing
+  hyper::render_stats_init (game_render_stats, game_framebuffer, &game_linear_arena);
+  if (game_config.render_stats)
+    game_framebuffer.stats = &game_render_stats;
+
+  // Needs the framebuffer's full size and format
+  if (game_config.capture_path
+      && !hyper::frame_capture_open (game_frame_capture, game_config.capture_path, game_config.capture_format, game_framebuffer, &game_linear_arena))
+    panic ("frame_capture_open", game_config.capture_path);
+
+  hyper::dynamic_resolution_init (game_dynamic_resolution, game_config.min_render_scale);
+  if (game_config.dynamic_resolution)
+    hyper::dynamic_resolution_set_target_fps (game_dynamic_resolution, game_config.target_fps);
 
   game_renderer_context.framebuffer = &game_framebuffer;
   game_renderer_context.stack_arena = &stack_arena;
+  game_renderer_context.anti_aliasing = game_config.anti_aliasing;
+
+  hyper::font_init (game_font);
+  game_renderer_context.font = &game_font;
+
+  // The game runs without them if they can't be opened
+  if (game_config.perf_counters && hyper::perf_counters_open (game_perf_counters))
+    game_renderer_context.perf_counters = &game_perf_counters;
+
+  // Workers are owned by the engine so they survive hot reloads
+  if (!hyper::jobs_init (game_jobs, &game_linear_arena, 0))
+    panic ("jobs_init", "couldn't initialise the job system");
+
+  game_renderer_context.jobs = &game_jobs;
 
   // Hot reloading mechanism
   if (!stellar::hot_reload_init (game_logic_shared_library, GAME_LOGIC_SHARED_LIBRARY_NAME))
     panic ("hot_reload_init", "couldn't initialise hot reloading");
 
   game_frame_context.renderer_context = &game_renderer_context;
+  game_frame_context.jobs = &game_jobs;
+  game_frame_context.transforms = &game_transforms;
+  game_frame_context.game_cache = &game_cache;
   game_frame_context.physics_accumulator = 0.0f;
   game_frame_context.fixed_timestep = fixed_timestep;
   game_frame_context.alpha_rendering = 0.0f;
-  game_frame_context.last_frame_time = SDL_GetTicks ();
+  game_frame_context.input = nullptr;
+  game_frame_context.tick = 0;
+  game_frame_context.last_frame_time = hyper::get_time_ns ();
 
-  game_camera.x = static_cast<f32> (game_renderer_context.framebuffer->width >> 1);
-  game_camera.y = static_cast<f32> (game_renderer_context.framebuffer->height >> 1);
-  game_camera.zoom = 1.0f;
+  // Fast replays and benchmarks run flat out
+  hyper::frame_pacer_init (game_frame_pacer,
+                           game_config.replay_fast || game_config.bench_scene ? 0.0f : game_config.target_fps,
+                           game_config.just_in_time_rendering);
 
-  game_world.width = GAME_WORLD_WIDTH;
-  game_world.height = GAME_WORLD_HEIGHT;
-  game_world.meters_per_pixel = 1.0f / game_camera.zoom; // FIXME: is this right?
-  game_renderer_context.meters_per_pixel = game_world.meters_per_pixel;
-
-  game_renderer_context.meters_per_pixel = game_world.meters_per_pixel;
-
-  // Initialise stars
-  std::random_device random_seed;
-  std::mt19937 generator (random_seed ());
-  std::uniform_real_distribution<f32> distribution_x (0, game_world.width);
-  std::uniform_real_distribution<f32> distribution_y (0, game_world.height);
-  for (size_t i = 0; i < game_data.stars.size (); ++i)
-    {
-      game_data.stars[i].body.center.x = distribution_x (generator);
-      game_data.stars[i].body.center.y = distribution_y (generator);
-      game_data.stars[i].body.radius = 1.0f;
-      game_data.stars[i].colour = hyper::get_colour_from_preset (hyper::WHITE);
-    }
-
-  // Initialise ship
-  game_data.ship.body.width = 20.0f;
-  game_data.ship.body.height = 20.0f;
-
-  game_data.ship.body.data.vertices[0] = { (game_world.width / 2.0f) - (game_data.ship.body.width / 2.0f),
-                                           (game_world.height / 2.0f) + (game_data.ship.body.height / 2.0f) };
-
-  game_data.ship.body.data.vertices[1] = { (game_world.width / 2.0f) + (game_data.ship.body.width / 2.0f),
-                                           (game_world.height / 2.0f) + (game_data.ship.body.height / 2.0f) };
-
-  game_data.ship.body.data.vertices[2] = { (game_world.width / 2.0f),
-                                           (game_world.height / 2.0f) - (game_data.ship.body.height / 2.0f) };
-
-  game_data.ship.body.colour = hyper::get_colour_from_preset (hyper::GREY);
+  init_game_data (GAME_WORLD_WIDTH, GAME_WORLD_HEIGHT);
 
-  // Left wing
-  game_data.ship.wings.left.vertices[0] = {
-    game_data.ship.body.data.vertices[2].x,
-    game_data.ship.body.data.vertices[2].y,
-  };
-
-  game_data.ship.wings.left.vertices[1] = {
-    game_data.ship.wings.left.vertices[0].x - 80.0f,
-    game_data.ship.wings.left.vertices[0].y + 70.0f
-  };
-
-  game_data.ship.wings.left.vertices[2] = {
-    game_data.ship.body.data.vertices[0].x,
-    game_data.ship.body.data.vertices[0].y,
-  };
-
-  // Right wing
-  game_data.ship.wings.right.vertices[0] = {
-    game_data.ship.body.data.vertices[2].x,
-    game_data.ship.body.data.vertices[2].y,
-  };
-
-  game_data.ship.wings.right.vertices[1] = {
-    game_data.ship.wings.right.vertices[0].x + 80.0f,
-    game_data.ship.wings.right.vertices[0].y + 70.0f
-  };
-
-  game_data.ship.wings.right.vertices[2] = {
-    game_data.ship.body.data.vertices[1].x,
-    game_data.ship.body.data.vertices[1].y,
-  };
+  hyper::task_scheduler_init (game_tasks);
+  game_logic_shared_library.add_tasks (game_tasks, game_frame_context);
 
-  game_data.ship.wings.colour = hyper::get_colour_from_preset (hyper::GREY);
+  // Going back in time would make recordings and replays diverge, and
+  // benchmarks only measure the game
+  if (game_config.record_path || game_config.replay_path || game_config.bench_scene)
+    game_config.rewind_seconds = 0.0f;
 
-  // Cockpit
-  game_data.ship.cockpit.width = 10.0f;
-  game_data.ship.cockpit.height = 10.0f;
-
-  game_data.ship.cockpit.data.vertices[0] = {
-    game_data.ship.body.data.vertices[0].x + 5.0f,
-    game_data.ship.body.data.vertices[2].y + 3.0f,
-  };
-
-  game_data.ship.cockpit.data.vertices[1] = {
-    game_data.ship.cockpit.data.vertices[0].x + game_data.ship.cockpit.width,
-    game_data.ship.cockpit.data.vertices[0].y,
-  };
-
-  game_data.ship.cockpit.data.vertices[2] = {
-    game_data.ship.cockpit.data.vertices[0].x + game_data.ship.cockpit.width / 2.0f,
-    game_data.ship.cockpit.data.vertices[0].y - game_data.ship.cockpit.height,
-  };
-
-  game_data.ship.cockpit.colour = hyper::get_colour_from_preset (hyper::GREY);
-
-  // Thrusters
-  game_data.ship.thrusters.width = 5.0f;
-  game_data.ship.thrusters.height = 15.0f;
-
-  // Left
-  game_data.ship.thrusters.data[0] = {
-    { game_data.ship.wings.left.vertices[0].x - 70.0f,
-      game_data.ship.wings.left.vertices[0].y + 60.0f },
-    game_data.ship.thrusters.width,
-    game_data.ship.thrusters.height
-  };
-
-  // Right
-  game_data.ship.thrusters.data[1] = {
-    { game_data.ship.wings.right.vertices[0].x + 70.0f,
-      game_data.ship.wings.right.vertices[0].y + 60.0f },
-    game_data.ship.thrusters.width,
-    game_data.ship.thrusters.height
-  };
+  // Tick 0 is the oldest it can go back to at first
+  if (game_config.rewind_seconds > 0.0f)
+    {
+      u32 const slot_count = (u32) (game_config.rewind_seconds / fixed_timestep) + 1;
+      if (hyper::snapshot_ring_get_size (sizeof (game_data), slot_count) > game_linear_arena.capacity - game_linear_arena.used)
+        panic ("snapshot_ring_init", "not enough room in the linear arena, lower --rewind or raise --linear-arena");
 
-  game_data.ship.thrusters.colour = hyper::get_colour_from_preset (hyper::GREY);
+      hyper::snapshot_ring_init (game_snapshots, sizeof (game_data), slot_count, &game_linear_arena);
+      hyper::snapshot_save (game_snapshots, &game_data, game_frame_context.tick);
+    }
 }
 
 static void
-run ()
+run (hyper::Counting_memory_resource const &game_linear_arena)
 {
   // Run main game's loop
   u64 frame_count = 0;
-  u64 last_time = SDL_GetTicks ();
+  u64 last_time = hyper::get_time_ns ();
   u64 fps_update_time = last_time;
   f32 current_fps = 0.0f;
-  char window_title[32];
+  // Worst distance from the target frame time over the last second
+  f32 frame_jitter = 0.0f;
+  char window_title[96];
   SDL_Event event;
+  u64 const simulation_start_ns = SDL_GetTicksNS ();
+  u64 replay_frame_count = 0;
+  // Last tick went backwards, rewinding can stop between frames
+  bool rewound = false;
 
   while (game_state.running)
     {
+      // Sleeps until it's time for the next frame
+      hyper::frame_pacer_begin_frame (game_frame_pacer);
+
+      if (game_renderer_context.perf_counters)
+        hyper::perf_counters_next_frame (game_perf_counters);
+
+      hyper::Perf_counter_reading stage_start;
+
 #if DEBUG
-      if (stellar::hot_reload_library_was_updated ())
-        stellar::hot_reload_load (game_logic_shared_library);
+      // New versions are loaded in the background, this only swaps
+      // pointers and no jobs are in flight between frames. The tasks'
+      // steps pointed into the old library.
+      if (stellar::hot_reload_swap (game_logic_shared_library))
+        {
+          hyper::task_scheduler_init (game_tasks);
+          game_logic_shared_library.add_tasks (game_tasks, game_frame_context);
+        }
 #endif
-      u64 const current_time = SDL_GetTicks ();
-      f32 frame_time = (f32) (current_time - last_time) / 1000.0f;
+      u64 const current_time = hyper::get_time_ns ();
+      u64 const frame_ns = current_time - last_time;
+      f32 frame_time = hyper::get_seconds (frame_ns);
       last_time = current_time;
+      game_frame_context.last_frame_time = current_time;
+
+      if (game_frame_pacer.period_ns)
+        frame_jitter = hyper::max (frame_jitter, hyper::abs (frame_time - hyper::get_seconds (game_frame_pacer.period_ns)));
 
       // Cap max frame rate, avoid spiral of death, that is to say,
       // constantly trying to catch up if I miss a deadline
       if (frame_time > 0.25f)
         frame_time = 0.25f;
 
+      // Exactly one tick per frame so runs are comparable
+      if (game_config.replay_fast)
+        frame_time = game_frame_context.fixed_timestep;
+
       // FPS display every second
       u64 const time_since_fps_update = current_time - fps_update_time;
-      if (time_since_fps_update > 1000)
+      if (time_since_fps_update > hyper::nanoseconds_per_second)
         {
-          current_fps = (f32) frame_count * 1000.0f / (f32) time_since_fps_update;
-          (void) snprintf (window_title, sizeof (window_title), "Stellar-Arsenal FPS: %.2f", current_fps);
+          current_fps = (f32) frame_count / hyper::get_seconds (time_since_fps_update);
+          (void) snprintf (window_title, sizeof (window_title), "Stellar-Arsenal FPS: %.2f jitter: %.2f ms %dx%d",
+                           (f64) current_fps, (f64) (frame_jitter * 1000.0f), game_framebuffer.width, game_framebuffer.height);
           SDL_SetWindowTitle (sdl_window, window_title);
           frame_count = 0;
+          frame_jitter = 0.0f;
           fps_update_time = current_time;
         }
 
@@ -273,10 +940,15 @@ run ()
               break;
             }
 
-          if (event.type == SDL_EVENT_KEY_DOWN)
-            {
-              SDL_Keycode const key = event.key.key;
+          if (event.type != SDL_EVENT_KEY_DOWN && event.type != SDL_EVENT_KEY_UP)
+            continue;
 
+          SDL_Keycode const key = event.key.key;
+          bool const key_down = event.type == SDL_EVENT_KEY_DOWN;
+
+          // Engine keys act right away and aren't part of the simulation
+          if (key_down)
+            {
               switch (key)
                 {
                 case SDLK_ESCAPE:
@@ -288,58 +960,392 @@ run ()
                   toggle_vsync ();
                   break;
                 case SDLK_F2:
+                  cycle_target_fps ();
                   break;
                 case SDLK_F3:
+                  toggle_just_in_time_rendering ();
                   break;
-                case SDLK_UP:
-                  game_camera.y -= 150.0f * game_frame_context.fixed_timestep;
+                case SDLK_F4:
+                  toggle_dynamic_resolution ();
                   break;
-                case SDLK_DOWN:
-                  game_camera.y += 150.0f * game_frame_context.fixed_timestep;
+                case SDLK_F5:
+                  toggle_hud ();
                   break;
-                case SDLK_LEFT:
-                  game_camera.x -= 150.0f * game_frame_context.fixed_timestep;
+                case SDLK_F6:
+                  toggle_anti_aliasing ();
                   break;
-                case SDLK_RIGHT:
-                  game_camera.x += 150.0f * game_frame_context.fixed_timestep;
+                case SDLK_F7:
+                  toggle_overdraw_heatmap ();
                   break;
                 default:
                   break;
                 }
             }
+
+          // Only while it's held
+          if (key == SDLK_BACKSPACE && game_snapshots.slot_count)
+            game_state.rewinding = key_down;
+
+          // While replaying the recorded input is the only input.
+          // SDL only pumps events on the main thread, so this is the
+          // producer, its timestamps say when keys actually changed.
+          hyper::Key game_key;
+          if (!game_config.replay_path && !event.key.repeat && get_game_key (key, game_key))
+            {
+              game_keys_held[(size_t) game_key] = key_down;
+              hyper::input_queue_push (game_input_queue, { event.common.timestamp, game_key, key_down });
+            }
         }
 
+      // Ticks run this frame catch the simulation up to now, less what
+      // stays in the accumulator, same clock as the event timestamps
+      u64 const input_time_ns = SDL_GetTicksNS ();
+
       // fixed timestep physics and logic updates
+      u64 const update_start = hyper::get_time_ns ();
+      begin_stage (stage_start);
+      u32 ticks = 0;
+
       while (game_frame_context.physics_accumulator >= game_frame_context.fixed_timestep)
         {
+          u64 const lag_ns = (u64) ((game_frame_context.physics_accumulator - game_frame_context.fixed_timestep) * 1e9f);
+          u64 const tick_end_ns = input_time_ns > lag_ns ? input_time_ns - lag_ns : 0;
+          hyper::Tick_input tick_input;
+          tick_input.event_count = 0;
+
+          // Backwards one tick at a time, at the same speed, and it
+          // stays at the oldest snapshot once it gets there. A hot
+          // reload that broke the simulation can be rewound past too.
+          if (game_state.rewinding)
+            {
+              u64 tick;
+              if (hyper::snapshot_restore (game_snapshots, &game_data, 1, tick))
+                game_frame_context.tick = tick;
+
+              // Nothing gets simulated, the held keys are caught up
+              // once it's over
+              get_tick_input (tick_end_ns, tick_input);
+              rewound = true;
+              game_frame_context.physics_accumulator -= game_frame_context.fixed_timestep;
+              ++ticks;
+              continue;
+            }
+
+          if (game_config.replay_path)
+            {
+              if (!hyper::replay_player_read_tick (game_replay_player, game_frame_context.tick, tick_input))
+                {
+                  game_state.running = false;
+                  break;
+                }
+            }
+          else
+            {
+              if (rewound)
+                push_held_key_changes (tick_input);
+
+              get_tick_input (tick_end_ns, tick_input);
+              rewound = false;
+            }
+
+          hyper::replay_recorder_write_tick (game_replay_recorder, game_frame_context.tick, tick_input);
 
+          game_frame_context.input = &tick_input;
           game_logic_shared_library.update (game_frame_context, game_data);
+          game_frame_context.input = nullptr;
+
           game_frame_context.physics_accumulator -= game_frame_context.fixed_timestep;
+          ++game_frame_context.tick;
+          ++ticks;
+
+          if (game_snapshots.slot_count)
+            hyper::snapshot_save (game_snapshots, &game_data, game_frame_context.tick);
         }
 
+      end_stage (hyper::Perf_scope::update, stage_start);
+      u64 const update_time = hyper::get_time_ns () - update_start;
+
+      // Size picked from the previous frames' render times, the zoom
+      // follows so the same part of the world stays on screen
+      f32 const render_scale = hyper::framebuffer_set_render_scale (&game_framebuffer, game_dynamic_resolution.scale);
+
       // render as fast as possible with interpolation
-      game_renderer_context.camera_x = game_camera.x;
-      game_renderer_context.camera_y = game_camera.y;
-      game_renderer_context.camera_zoom = game_camera.zoom;
+      u64 const render_start = hyper::get_time_ns ();
+      begin_stage (stage_start);
+      game_renderer_context.camera_x = game_data.camera.x;
+      game_renderer_context.camera_y = game_data.camera.y;
+      game_renderer_context.camera_zoom = game_data.camera.zoom * render_scale;
       game_frame_context.alpha_rendering = game_frame_context.physics_accumulator / game_frame_context.fixed_timestep;
+      game_renderer_context.draw_calls = 0;
+
+      // After the render scale, the overdraw is cleared at this size
+      if (game_framebuffer.stats)
+        hyper::render_stats_next_frame (game_render_stats, game_framebuffer);
+
       game_logic_shared_library.render (game_frame_context, game_data);
 
-      // copy my updated framebuffer to the SDL texture
-      SDL_UpdateTexture (sdl_texture, nullptr, game_framebuffer.pixels.data (), game_framebuffer.pitch);
+      end_stage (hyper::Perf_scope::render, stage_start);
+      u64 const render_end = hyper::get_time_ns ();
+
+      // The game only, without the HUD
+      if (game_config.capture_path)
+        hyper::frame_capture_submit (game_frame_capture, game_framebuffer, replay_frame_count);
+
+      if (game_render_stats.heatmap)
+        hyper::draw_overdraw_heatmap (&game_renderer_context, game_render_stats);
+
+      // On top of everything, after the render time is taken
+      begin_stage (stage_start);
+      if (game_config.show_hud)
+        {
+          game_perf_stats.ticks = ticks;
+          game_perf_stats.draw_calls = game_renderer_context.draw_calls;
+          game_perf_stats.snapshot_pages = game_snapshots.pages_copied;
+          game_perf_stats.transforms_updated = game_transforms.updated_count;
+          game_perf_stats.task_ns = game_tasks.run_ns;
+          game_perf_stats.task_steps = game_tasks.steps;
+          game_perf_stats.stack_arena_used = game_renderer_context.stack_arena->resource.used;
+          game_perf_stats.stack_arena_peak = game_renderer_context.stack_arena->resource.peak;
+          game_perf_stats.stack_arena_capacity = game_renderer_context.stack_arena->resource.capacity;
+          game_perf_stats.linear_arena_used = game_linear_arena.used;
+          game_perf_stats.linear_arena_capacity = game_linear_arena.capacity;
+          game_perf_stats.arena_pages = hyper::get_page_kind_name (linear_arena_backing.pages);
+
+          // Last frame's text goes first, only the rows it took
+          std::memset (game_hud_framebuffer.pixels.data (), 0, (size_t) game_hud_rows * (size_t) game_hud_framebuffer.pitch);
+          game_hud_rows = hyper::draw_perf_hud (&game_renderer_context, &game_hud_framebuffer, game_perf_stats);
+        }
+
+      end_stage (hyper::Perf_scope::hud, stage_start);
+      u64 const hud_end = hyper::get_time_ns ();
+      hyper::perf_stats_record (game_perf_stats, frame_ns, update_time, render_end - render_start, hud_end - render_end);
+
+      // copy my updated framebuffer to the SDL texture, only the part
+      // that got rendered, and let SDL stretch it to the window
+      SDL_FRect const source_rect = { 0.0f, 0.0f, (f32) game_framebuffer.width, (f32) game_framebuffer.height };
+      begin_stage (stage_start);
+      upload_framebuffer ();
+      if (game_config.show_hud)
+        upload_hud ();
+      end_stage (hyper::Perf_scope::upload, stage_start);
+
+      // Present is left out, with vsync on it's mostly waiting
+      hyper::dynamic_resolution_update (game_dynamic_resolution, hyper::get_time_ns () - render_start);
 
+      begin_stage (stage_start);
       SDL_RenderClear (sdl_renderer);
-      SDL_RenderTexture (sdl_renderer, sdl_texture, nullptr, nullptr);
+      SDL_RenderTexture (sdl_renderer, sdl_texture, &source_rect, nullptr);
+      if (game_config.show_hud)
+        {
+          SDL_FRect const hud_rect = { 0.0f, 0.0f, (f32) game_hud_framebuffer.width, (f32) game_hud_rows };
+          SDL_RenderTexture (sdl_renderer, sdl_hud_texture, &hud_rect, &hud_rect);
+        }
       SDL_RenderPresent (sdl_renderer);
+      end_stage (hyper::Perf_scope::present, stage_start);
 
       ++frame_count;
+      ++replay_frame_count;
 
       hyper::stack_arena_release (game_renderer_context.stack_arena);
+
+      hyper::frame_pacer_end_frame (game_frame_pacer);
+
+      // Whatever's left until the next frame starts goes to the tasks
+      u64 const next_start_ns = hyper::frame_pacer_get_next_start (game_frame_pacer);
+      u64 const task_deadline_ns = next_start_ns
+        ? (next_start_ns > task_margin_ns ? next_start_ns - task_margin_ns : 0)
+        : hyper::get_time_ns () + task_uncapped_slice_ns;
+      hyper::task_scheduler_run (game_tasks, task_deadline_ns);
+    }
+
+  if (game_config.replay_path)
+    {
+      f64 const elapsed = (f64) (SDL_GetTicksNS () - simulation_start_ns) / 1e9;
+      std::cout << "replay: " << game_frame_context.tick << " ticks, " << replay_frame_count << " frames in "
+                << elapsed << " s, " << (elapsed * 1000.0 / (f64) hyper::max (replay_frame_count, (u64) 1)) << " ms per frame\n";
+    }
+}
+
+// Starts the simulation over with the scene's world, fleet and camera.
+// The fleet comes from the seed, every run gets the same one.
+static void
+setup_bench_scene (stellar::Bench_scene const &scene)
+{
+  f32 const world_width = GAME_WORLD_WIDTH * scene.world_scale;
+  f32 const world_height = GAME_WORLD_HEIGHT * scene.world_scale;
+
+  std::memset (&game_data, 0, sizeof (game_data));
+  init_game_data (world_width, world_height);
+
+  u64 const key = hyper::hash_u64 (game_config.seed ^ 0xF1EE7ull);
+  for (u32 i = 0; i < scene.fleet_ships; ++i)
+    {
+      u32 const counter = i * 6;
+      hyper::Vec2<f32> const position = { world_width * (0.5f + (hyper::random_f32 (key, counter) - 0.5f) * scene.fleet_spread),
+                                          world_height * (0.5f + (hyper::random_f32 (key, counter + 1) - 0.5f) * scene.fleet_spread) };
+      f32 const rotation = hyper::random_f32 (key, counter + 2) * 6.2831853f;
+
+      // Drifting and turning slowly, they stay about where they are
+      u32 const body = hyper::physics_add_body (game_data.physics, position, rotation);
+      hyper::physics_set_velocity (game_data.physics, body,
+                                   { (hyper::random_f32 (key, counter + 3) - 0.5f) * scene.fleet_speed,
+                                     (hyper::random_f32 (key, counter + 4) - 0.5f) * scene.fleet_speed },
+                                   (hyper::random_f32 (key, counter + 5) - 0.5f) * scene.fleet_speed * 0.05f);
+
+      game_data.fleet.physics_bodies[i] = body;
+      game_data.fleet.transform_nodes[i] = add_ship_transforms (game_data.ship);
+    }
+
+  game_data.fleet.count = scene.fleet_ships;
+
+  game_data.camera.x = world_width * scene.camera.x;
+  game_data.camera.y = world_height * scene.camera.y;
+  game_data.camera.zoom = scene.zoom;
+  game_data.keys_held[(size_t) hyper::Key::right] = scene.pan;
+
+  game_frame_context.physics_accumulator = 0.0f;
+  game_frame_context.alpha_rendering = 0.0f;
+  game_frame_context.tick = 0;
+}
+
+// Every scene asked for, one tick and one frame at a time as fast as
+// they go, then the results as JSON. Closing the window stops it
+// without writing anything.
+static void
+run_bench (hyper::Counting_memory_resource &game_linear_arena)
+{
+  u32 const frame_count = game_config.bench_frames;
+  u32 constexpr stage_count = (u32) stellar::Bench_stage::count;
+
+  // Whole frame first, then the stages, reused by every scene
+  std::pmr::vector<u64> samples {&game_linear_arena};
+  samples.resize ((size_t) frame_count * (stage_count + 1));
+
+  std::array<stellar::Bench_result, stellar::bench_scenes.size ()> results;
+  u32 result_count = 0;
+  SDL_Event event;
+
+  for (stellar::Bench_scene const &scene : stellar::bench_scenes)
+    {
+      if (strcmp (game_config.bench_scene, "all") && strcmp (game_config.bench_scene, scene.name))
+        continue;
+
+      std::cerr << "bench: " << scene.name << '\n';
+
+      setup_bench_scene (scene);
+      game_renderer_context.stack_arena->resource.peak = 0;
+      u32 max_draw_calls = 0;
+
+      for (u32 frame = 0; frame < stellar::bench_warmup_frames + frame_count; ++frame)
+        {
+          while (SDL_PollEvent (&event))
+            if (event.type == SDL_EVENT_QUIT || (event.type == SDL_EVENT_KEY_DOWN && event.key.key == SDLK_ESCAPE))
+              game_state.running = false;
+
+          if (!game_state.running)
+            return;
+
+          if (game_renderer_context.perf_counters)
+            hyper::perf_counters_next_frame (game_perf_counters);
+
+          hyper::Perf_counter_reading stage_start;
+          u64 const frame_start = hyper::get_time_ns ();
+          begin_stage (stage_start);
+
+          // Scenes are driven by the keys held when they were set up
+          hyper::Tick_input tick_input;
+          tick_input.event_count = 0;
+
+          game_frame_context.input = &tick_input;
+          game_logic_shared_library.update (game_frame_context, game_data);
+          game_frame_context.input = nullptr;
+          ++game_frame_context.tick;
+
+          end_stage (hyper::Perf_scope::update, stage_start);
+          u64 const update_end = hyper::get_time_ns ();
+          begin_stage (stage_start);
+
+          game_renderer_context.camera_x = game_data.camera.x;
+          game_renderer_context.camera_y = game_data.camera.y;
+          game_renderer_context.camera_zoom = game_data.camera.zoom;
+          game_renderer_context.draw_calls = 0;
+
+          if (game_framebuffer.stats)
+            hyper::render_stats_next_frame (game_render_stats, game_framebuffer);
+
+          game_logic_shared_library.render (game_frame_context, game_data);
+
+          end_stage (hyper::Perf_scope::render, stage_start);
+          u64 const render_end = hyper::get_time_ns ();
+          begin_stage (stage_start);
+
+          SDL_FRect const source_rect = { 0.0f, 0.0f, (f32) game_framebuffer.width, (f32) game_framebuffer.height };
+          upload_framebuffer ();
+
+          end_stage (hyper::Perf_scope::upload, stage_start);
+          u64 const upload_end = hyper::get_time_ns ();
+          begin_stage (stage_start);
+
+          SDL_RenderClear (sdl_renderer);
+          SDL_RenderTexture (sdl_renderer, sdl_texture, &source_rect, nullptr);
+          SDL_RenderPresent (sdl_renderer);
+          end_stage (hyper::Perf_scope::present, stage_start);
+
+          hyper::stack_arena_release (game_renderer_context.stack_arena);
+
+          u64 const frame_end = hyper::get_time_ns ();
+
+          if (frame < stellar::bench_warmup_frames)
+            continue;
+
+          u32 const sample = frame - stellar::bench_warmup_frames;
+          samples[sample] = frame_end - frame_start;
+          samples[((size_t) 1 + (size_t) stellar::Bench_stage::update) * frame_count + sample] = update_end - frame_start;
+          samples[((size_t) 1 + (size_t) stellar::Bench_stage::render) * frame_count + sample] = render_end - update_end;
+          samples[((size_t) 1 + (size_t) stellar::Bench_stage::upload) * frame_count + sample] = upload_end - render_end;
+          samples[((size_t) 1 + (size_t) stellar::Bench_stage::present) * frame_count + sample] = frame_end - upload_end;
+          max_draw_calls = hyper::max (max_draw_calls, game_renderer_context.draw_calls);
+        }
+
+      stellar::Bench_result &result = results[result_count++];
+      result.scene = &scene;
+      result.frame_count = frame_count;
+      result.frame = stellar::bench_get_timings (samples.data (), frame_count);
+
+      for (u32 stage = 0; stage < stage_count; ++stage)
+        result.stages[stage] = stellar::bench_get_timings (samples.data () + (size_t) (stage + 1) * frame_count, frame_count);
+
+      result.max_draw_calls = max_draw_calls;
+      result.stack_arena_peak = game_renderer_context.stack_arena->resource.peak;
+      result.linear_arena_used = game_linear_arena.used;
     }
+
+  stellar::bench_write_json (game_config.bench_output, results.data (), result_count,
+                             game_framebuffer.width, game_framebuffer.height, game_config.seed, game_config.anti_aliasing);
 }
 
 static void
 quit ()
 {
+  if (game_renderer_context.perf_counters)
+    {
+      hyper::perf_counters_print (game_perf_counters);
+      hyper::perf_counters_close (game_perf_counters);
+      game_renderer_context.perf_counters = nullptr;
+    }
+
+  if (game_config.render_stats)
+    {
+      hyper::render_stats_print (game_render_stats);
+      game_framebuffer.stats = nullptr;
+    }
+
+  hyper::replay_recorder_close (game_replay_recorder, game_frame_context.tick);
+  hyper::frame_capture_close (game_frame_capture);
+  hyper::jobs_quit (game_jobs);
+  stellar::hot_reload_quit (game_logic_shared_library);
+  hyper::asset_pack_close (game_assets);
+  SDL_DestroyTexture (sdl_hud_texture);
   SDL_DestroyTexture (sdl_texture);
   SDL_DestroyRenderer (sdl_renderer);
   SDL_DestroyWindow (sdl_window);
@@ -347,26 +1353,51 @@ quit ()
 }
 
 int
-main ()
+main (int argc, char **argv)
 {
-  // Memory allocations (all I'm going to have) inside the game
+  if (!parse_arguments (argc, argv))
+    {
+      print_usage (argv[0]);
+      return EXIT_FAILURE;
+    }
+
+  // Memory allocations (all I'm going to have) inside the game, faulted
+  // in now unless told otherwise so the first frames don't hitch
+  bool const populate = !game_config.lazy_arenas;
+  if (!hyper::arena_backing_reserve (linear_arena_backing, hyper::megabytes ((i32) game_config.linear_arena_megabytes), populate)
+      || !hyper::arena_backing_reserve (stack_arena_backing, hyper::megabytes ((i32) game_config.stack_arena_megabytes), populate))
+    {
+      std::cerr << "couldn't reserve memory for the arenas\n";
+      hyper::arena_backing_release (linear_arena_backing);
+      return EXIT_FAILURE;
+    }
+
   // The linear arena is for the framebuffer
-  std::pmr::monotonic_buffer_resource game_linear_arena { linear_arena_backing_buffer.data (),
-                                                          linear_arena_backing_buffer.size (),
-                                                          &fixed_resource };
+  std::pmr::monotonic_buffer_resource linear_arena { linear_arena_backing.data,
+                                                     linear_arena_backing.size,
+                                                     &fixed_resource };
+
+  // Allocate through this one, it counts what's in use for the HUD
+  hyper::Counting_memory_resource game_linear_arena { &linear_arena, linear_arena_backing.size };
 
   // This is for scratch operations that only live for a particular frame
   hyper::Stack_arena_arguments stack_arena_arguments { &fixed_resource,
-                                                       stack_arena_backing_buffer.data (),
-                                                       stack_arena_backing_buffer.size ()};
+                                                       stack_arena_backing.data,
+                                                       (u32) stack_arena_backing.size };
 
   hyper::Stack_arena stack_arena {stack_arena_arguments};
 
   init (game_linear_arena, stack_arena);
 
-  run ();
+  if (game_config.bench_scene)
+    run_bench (game_linear_arena);
+  else
+    run (game_linear_arena);
 
   quit ();
 
+  hyper::arena_backing_release (stack_arena_backing);
+  hyper::arena_backing_release (linear_arena_backing);
+
   return EXIT_SUCCESS;
 }
@@ -1,111 +1,124 @@
 #include "stellar_hot_reload.hh"
 
-#include <linux/limits.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/eventfd.h>
 #include <sys/inotify.h>
+#include <sys/stat.h>
 #include <dlfcn.h>
 #include <unistd.h>
 #include <string.h>
+#include <stdio.h>
 #include <iostream>
 
 namespace stellar
 {
   static Hot_reload_watcher watcher;
 
-  static bool
-  watcher_init (char const *path)
+  static void
+  clear_library (Hot_reload_library_data &library)
   {
-    watcher.path = path;
+    library.handle = NULL;
+    library.render = NULL;
+    library.update = NULL;
+    library.add_tasks = NULL;
+    library.shadow_path[0] = '\0';
+  }
 
-    watcher.inotify_fd = inotify_init1 (IN_NONBLOCK);
-    if (watcher.inotify_fd == -1)
-      {
-        std::cerr << "couldn't initialise inotify: " << strerror (errno) << '\n';
-        return false;
-      }
+  static void
+  close_library (Hot_reload_library_data &library)
+  {
+    if (library.handle)
+      dlclose (library.handle);
 
-    watcher.watch_fd = inotify_add_watch (watcher.inotify_fd, watcher.path, IN_ALL_EVENTS);
-    if (watcher.watch_fd == -1)
-      {
-        close (watcher.inotify_fd);
-        std::cerr << "couldn't add watch: " << strerror (errno) << '\n';
-        return false;
-      }
+    if (library.shadow_path[0])
+      unlink (library.shadow_path);
 
-    return true;
+    clear_library (library);
   }
 
   static bool
-  restart_watcher ()
+  copy_file (char const *source_path, char const *destination_path)
   {
-    if (inotify_rm_watch (watcher.inotify_fd, watcher.watch_fd) == -1)
+    i32 const source = open (source_path, O_RDONLY);
+    if (source == -1)
       {
-        std::cerr << "couldn't remove watch: " << strerror (errno) << '\n';
+        std::cerr << "couldn't open " << source_path << ": " << strerror (errno) << '\n';
         return false;
       }
 
-    return watcher_init (watcher.path);
-  }
-
-  bool
-  hot_reload_init (Hot_reload_library_data &library, char const *path)
-  {
-    library.path = path;
-    library.handle = NULL;
-    library.render = NULL;
-    library.update = NULL;
-
-    if (!watcher_init (path))
+    struct stat source_stat;
+    if (fstat (source, &source_stat) == -1)
       {
+        close (source);
         return false;
       }
 
-    return hot_reload_load (library);
-  }
+    i32 const destination = open (destination_path, O_WRONLY | O_CREAT | O_TRUNC, 0755);
+    if (destination == -1)
+      {
+        std::cerr << "couldn't create " << destination_path << ": " << strerror (errno) << '\n';
+        close (source);
+        return false;
+      }
 
-  bool
-  hot_reload_library_was_updated ()
-  {
-    char buffer[sizeof (struct inotify_event) + NAME_MAX + 1];
-    bool modified = false;
+    // Let the kernel do it, no round trip through user space
+    off_t remaining = source_stat.st_size;
+    bool success = true;
 
-    while (read (watcher.inotify_fd, buffer, sizeof (buffer)) > 0)
+    while (remaining > 0)
       {
-        struct inotify_event *event = (struct inotify_event *) buffer;
-        if (event->mask & (IN_OPEN | IN_ATTRIB))
+        ssize_t const copied = copy_file_range (source, NULL, destination, NULL, (size_t) remaining, 0);
+        if (copied <= 0)
           {
-            restart_watcher ();
-            modified = true;
+            if (copied == -1 && errno == EINTR)
+              continue;
+
+            std::cerr << "couldn't copy " << source_path << ": " << strerror (errno) << '\n';
+            success = false;
             break;
           }
-      }
 
-    if (modified)
-      {
-        // XXX: don't try to open the new library immediately because
-        // it might have not been fully created yet!
-        usleep (50'000);
+        remaining -= copied;
       }
 
-    return modified;
+    close (source);
+    close (destination);
+
+    return success;
   }
 
-  bool
-  hot_reload_load (Hot_reload_library_data &library)
+  static bool
+  load_library (Hot_reload_library_data &library, char const *path, u32 version)
   {
-    if (library.handle)
+    library.path = path;
+    library.version = version;
+    clear_library (library);
+
+    // A different file name every time, otherwise dlopen would hand me
+    // back the library that's already loaded
+    i32 const length = snprintf (library.shadow_path, sizeof (library.shadow_path), "%s/%s.hot.%u", watcher.directory, watcher.file_name, version);
+    if (length < 0 || (size_t) length >= sizeof (library.shadow_path))
+      {
+        std::cerr << "path too long for lib " << path << '\n';
+        clear_library (library);
+        return false;
+      }
+
+    if (!copy_file (path, library.shadow_path))
       {
-        dlclose (library.handle);
-        library.handle = NULL;
-        library.render = NULL;
-        library.update = NULL;
+        unlink (library.shadow_path);
+        clear_library (library);
+        return false;
       }
 
     // RTLD_NOW: find all symbols immediately.
-    library.handle = dlopen (library.path, RTLD_NOW);
+    library.handle = dlopen (library.shadow_path, RTLD_NOW);
     if (!library.handle)
       {
-        std::cerr << "couldn't open lib " << library.path << ':' << strerror (errno) << '\n';
+        std::cerr << "couldn't open lib " << library.shadow_path << ':' << dlerror () << '\n';
+        close_library (library);
         return false;
       }
 
@@ -118,6 +131,7 @@ namespace stellar
     if (error)
       {
         std::cerr << "couldn't find game_update symbol for lib " << library.path << ':' << error << '\n';
+        close_library (library);
         return false;
       }
 
@@ -130,22 +144,236 @@ namespace stellar
     if (error)
       {
         std::cerr << "couldn't find game_render symbol for lib " << library.path << ':' << error << '\n';
+        close_library (library);
         return false;
       }
 
     library.render = reinterpret_cast<function_ptr_signature> (function_ptr);
 
+    dlerror ();
+
+    function_ptr = dlsym (library.handle, HYPER_ADD_TASKS_FUNCTION_NAME);
+    error = dlerror ();
+    if (error)
+      {
+        std::cerr << "couldn't find game_add_tasks symbol for lib " << library.path << ':' << error << '\n';
+        close_library (library);
+        return false;
+      }
+
+    library.add_tasks = reinterpret_cast<add_tasks_function_ptr_signature> (function_ptr);
+
+    return true;
+  }
+
+  static bool
+  library_was_written ()
+  {
+    alignas (struct inotify_event) char buffer[4096];
+    bool written = false;
+    ssize_t length;
+
+    while ((length = read (watcher.inotify_fd, buffer, sizeof (buffer))) > 0)
+      {
+        for (char *cursor = buffer; cursor < buffer + length;)
+          {
+            auto *event = reinterpret_cast<struct inotify_event *> (cursor);
+
+            // Only once the writer is done with it, either closing it or
+            // renaming a finished file over it. Opening it doesn't count,
+            // which is what dlopen does.
+            if ((event->mask & (IN_CLOSE_WRITE | IN_MOVED_TO))
+                && event->len
+                && !strcmp (event->name, watcher.file_name))
+              written = true;
+
+            cursor += sizeof (struct inotify_event) + event->len;
+          }
+      }
+
+    return written;
+  }
+
+  static void
+  load_pending ()
+  {
+    if (watcher.pending_ready.load (std::memory_order_acquire))
+      {
+        // The main thread hasn't picked the last one up yet
+        watcher.reload_again = true;
+        return;
+      }
+
+    watcher.reload_again = false;
+
+    if (load_library (watcher.pending, watcher.path, watcher.next_version++))
+      watcher.pending_ready.store (true, std::memory_order_release);
+  }
+
+  // Only reloads in debug builds
+  [[maybe_unused]] static void
+  watcher_main ()
+  {
+    struct pollfd fds[2];
+    fds[0].fd = watcher.inotify_fd;
+    fds[0].events = POLLIN;
+    fds[1].fd = watcher.wake_fd;
+    fds[1].events = POLLIN;
+
+    while (watcher.running.load (std::memory_order_acquire))
+      {
+        if (poll (fds, 2, -1) == -1)
+          {
+            if (errno == EINTR)
+              continue;
+
+            std::cerr << "hot reload watcher stopped: " << strerror (errno) << '\n';
+            return;
+          }
+
+        if (fds[1].revents & POLLIN)
+          {
+            u64 value;
+            (void) !read (watcher.wake_fd, &value, sizeof (value));
+
+            if (watcher.retired_ready.load (std::memory_order_acquire))
+              {
+                close_library (watcher.retired);
+                watcher.retired_ready.store (false, std::memory_order_release);
+              }
+
+            if (watcher.reload_again)
+              load_pending ();
+          }
+
+        if ((fds[0].revents & POLLIN) && library_was_written ())
+          load_pending ();
+      }
+  }
+
+  static bool
+  watcher_init (char const *path)
+  {
+    // Watch the directory, not the file: the file gets replaced and
+    // that would kill a watch on it
+    char const *slash = strrchr (path, '/');
+    if (slash)
+      {
+        (void) snprintf (watcher.directory, sizeof (watcher.directory), "%.*s", (int) (slash - path), path);
+        watcher.file_name = slash + 1;
+      }
+    else
+      {
+        (void) snprintf (watcher.directory, sizeof (watcher.directory), ".");
+        watcher.file_name = path;
+      }
+
+    watcher.inotify_fd = inotify_init1 (IN_NONBLOCK | IN_CLOEXEC);
+    if (watcher.inotify_fd == -1)
+      {
+        std::cerr << "couldn't initialise inotify: " << strerror (errno) << '\n';
+        return false;
+      }
+
+    watcher.watch_fd = inotify_add_watch (watcher.inotify_fd, watcher.directory, IN_CLOSE_WRITE | IN_MOVED_TO);
+    if (watcher.watch_fd == -1)
+      {
+        close (watcher.inotify_fd);
+        std::cerr << "couldn't add watch: " << strerror (errno) << '\n';
+        return false;
+      }
+
+    watcher.wake_fd = eventfd (0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (watcher.wake_fd == -1)
+      {
+        inotify_rm_watch (watcher.inotify_fd, watcher.watch_fd);
+        close (watcher.inotify_fd);
+        std::cerr << "couldn't create eventfd: " << strerror (errno) << '\n';
+        return false;
+      }
+
+    watcher.path = path;
+
+    return true;
+  }
+
+  static void
+  wake_watcher ()
+  {
+    u64 const value = 1;
+    (void) !write (watcher.wake_fd, &value, sizeof (value));
+  }
+
+  bool
+  hot_reload_init (Hot_reload_library_data &library, char const *path)
+  {
+    clear_library (library);
+
+    if (!watcher_init (path))
+      {
+        return false;
+      }
+
+    // First version is loaded right away, the game can't start without it
+    if (!load_library (library, path, watcher.next_version++))
+      return false;
+
+#if DEBUG
+    watcher.running.store (true, std::memory_order_release);
+    watcher.thread = std::thread (watcher_main);
+#endif
+
+    return true;
+  }
+
+  bool
+  hot_reload_swap (Hot_reload_library_data &library)
+  {
+    if (!watcher.pending_ready.load (std::memory_order_acquire))
+      return false;
+
+    // The watcher hasn't closed the previous one yet, try next frame
+    if (watcher.retired_ready.load (std::memory_order_acquire))
+      return false;
+
+    watcher.retired = library;
+    library = watcher.pending;
+    clear_library (watcher.pending);
+
+    watcher.retired_ready.store (true, std::memory_order_release);
+    watcher.pending_ready.store (false, std::memory_order_release);
+
+    // dlclose can take its time, let the watcher do it
+    wake_watcher ();
+
     return true;
   }
 
   void
   hot_reload_quit (Hot_reload_library_data &library)
   {
-    if (library.handle)
-      dlclose (library.handle);
+    // Never got initialised
+    if (!watcher.path)
+      return;
+
+    if (watcher.thread.joinable ())
+      {
+        watcher.running.store (false, std::memory_order_release);
+        wake_watcher ();
+        watcher.thread.join ();
+      }
+
+    close_library (library);
+
+    if (watcher.retired_ready.load ())
+      close_library (watcher.retired);
+
+    if (watcher.pending_ready.load ())
+      close_library (watcher.pending);
 
     inotify_rm_watch (watcher.inotify_fd, watcher.watch_fd);
     close (watcher.inotify_fd);
-    close (watcher.watch_fd);
+    close (watcher.wake_fd);
+    watcher.path = nullptr;
   }
 };
@@ -2,10 +2,16 @@
 
 #include "hyper.hh"
 #include "stellar.hh"
+#include "hyper_task_scheduler.hh"
+
+#include <linux/limits.h>
+#include <atomic>
+#include <thread>
 
 namespace stellar
 {
   using function_ptr_signature = void (*)(hyper::Frame_context &, stellar::Game_data &);
+  using add_tasks_function_ptr_signature = void (*)(hyper::Task_scheduler &, hyper::Frame_context &);
 
   struct Hot_reload_library_data
   {
@@ -13,20 +19,42 @@ namespace stellar
     char const *path;
     function_ptr_signature update;
     function_ptr_signature render;
+    add_tasks_function_ptr_signature add_tasks;
+    // The library is never opened directly, it's copied first so the
+    // compiler can overwrite it while the game keeps running
+    char shadow_path[PATH_MAX];
+    u32 version;
   };
 
+  // Watches the library's directory from its own thread, loads new
+  // versions in the background and leaves them in pending until the
+  // main thread swaps them in
   struct Hot_reload_watcher
   {
     int32_t inotify_fd;
     int32_t watch_fd;
+    // eventfd, wakes the thread up to retire a library or to quit
+    int32_t wake_fd;
     char const *path;
+    char directory[PATH_MAX];
+    char const *file_name;
+    std::thread thread;
+    std::atomic<bool> running;
+    Hot_reload_library_data pending;
+    std::atomic<bool> pending_ready;
+    // Library swapped out by the main thread, closed by the watcher
+    Hot_reload_library_data retired;
+    std::atomic<bool> retired_ready;
+    // The library changed again while pending was still waiting
+    bool reload_again;
+    u32 next_version;
   };
 
   bool hot_reload_init (Hot_reload_library_data &, char const *);
 
-  bool hot_reload_library_was_updated ();
-
-  bool hot_reload_load (Hot_reload_library_data &);
+  // Never blocks, call it at a frame boundary. Returns true if a new
+  // version was swapped in.
+  bool hot_reload_swap (Hot_reload_library_data &);
 
   void hot_reload_quit (Hot_reload_library_data &);
 };
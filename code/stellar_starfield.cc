@@ -0,0 +1,209 @@
+#include "stellar_starfield.hh"
+#include "hyper_random.hh"
+#include "hyper_math.hh"
+
+#include <cstring>
+
+namespace stellar
+{
+  // Around 14 stars per sector, what 1024 stars in the original world
+  // used to be
+  static constexpr u32 star_sector_min_stars = 8;
+
+  static void
+  generate_sector (Starfield const &starfield, Star_sector &sector, i32 x, i32 y)
+  {
+    u64 const key = hyper::hash_coordinates (x, y, starfield.seed);
+    u32 counter = 0;
+
+    u32 const star_count = star_sector_min_stars + hyper::random_u32 (key, counter++) % (star_sector_max_stars - star_sector_min_stars + 1);
+    f32 const sector_x = (f32) x * star_sector_size;
+    f32 const sector_y = (f32) y * star_sector_size;
+
+    sector.x = x;
+    sector.y = y;
+    sector.valid = true;
+    sector.star_count = 0;
+
+    for (u32 i = 0; i < star_count; ++i)
+      {
+        f32 const star_x = sector_x + hyper::random_f32 (key, counter++) * star_sector_size;
+        f32 const star_y = sector_y + hyper::random_f32 (key, counter++) * star_sector_size;
+
+        // Sectors on the border hang off the world
+        if (star_x >= starfield.world_width || star_y >= starfield.world_height)
+          continue;
+
+        Star &star = sector.stars[sector.star_count];
+        star.body.center = { star_x, star_y };
+        star.body.radius = 1.0f;
+        star.colour = hyper::get_colour_from_preset (hyper::WHITE);
+        star.lod_rank = (f32) sector.star_count / (f32) star_sector_max_stars;
+        ++sector.star_count;
+      }
+  }
+
+  void
+  starfield_init (Starfield &starfield, u64 seed, f32 world_width, f32 world_height)
+  {
+    std::memset (&starfield.cache, 0, sizeof (starfield.cache));
+    starfield.seed = seed;
+    starfield.frame = 0;
+    starfield.world_width = world_width;
+    starfield.world_height = world_height;
+  }
+
+  // The cached sector, or null and where it should go
+  static Star_sector *
+  find_sector (Starfield &starfield, i32 x, i32 y, Star_sector *&victim)
+  {
+    u32 const set = (u32) hyper::hash_coordinates (x, y, 0) & (star_cache_sets - 1);
+    Star_sector *ways = &starfield.cache[set * star_cache_ways];
+    victim = &ways[0];
+
+    for (u32 i = 0; i < star_cache_ways; ++i)
+      {
+        if (ways[i].valid && ways[i].x == x && ways[i].y == y)
+          return &ways[i];
+
+        if (!ways[i].valid || (victim->valid && ways[i].last_used_frame < victim->last_used_frame))
+          victim = &ways[i];
+      }
+
+    return nullptr;
+  }
+
+  Star_sector const &
+  starfield_get_sector (Starfield &starfield, i32 x, i32 y)
+  {
+    Star_sector *victim;
+    Star_sector *sector = find_sector (starfield, x, y, victim);
+
+    if (!sector)
+      {
+        sector = victim;
+        generate_sector (starfield, *sector, x, y);
+      }
+
+    sector->last_used_frame = starfield.frame;
+
+    return *sector;
+  }
+
+  // Keeps the middle count of the inclusive range
+  static void
+  shrink_range (i32 &start, i32 &end, i32 count)
+  {
+    start += (end - start + 1 - count) / 2;
+    end = start + count - 1;
+  }
+
+  Star_sector_range
+  starfield_get_visible_sectors (Starfield const &starfield, hyper::Renderer_context const *context)
+  {
+    f32 const half_width = (f32) (context->framebuffer->width >> 1) / context->camera_zoom;
+    f32 const half_height = (f32) (context->framebuffer->height >> 1) / context->camera_zoom;
+    i32 const last_x = (i32) hyper::floor ((starfield.world_width - 1.0f) / star_sector_size);
+    i32 const last_y = (i32) hyper::floor ((starfield.world_height - 1.0f) / star_sector_size);
+
+    Star_sector_range range;
+    range.x_start = hyper::max ((i32) hyper::floor ((context->camera_x - half_width) / star_sector_size), 0);
+    range.y_start = hyper::max ((i32) hyper::floor ((context->camera_y - half_height) / star_sector_size), 0);
+    range.x_end = hyper::min ((i32) hyper::floor ((context->camera_x + half_width) / star_sector_size), last_x);
+    range.y_end = hyper::min ((i32) hyper::floor ((context->camera_y + half_height) / star_sector_size), last_y);
+
+    // More sectors than the cache holds would evict each other every
+    // frame, zoomed out that far only the middle of the view is drawn
+    i32 columns = range.x_end - range.x_start + 1;
+    i32 rows = range.y_end - range.y_start + 1;
+    if (columns > 0 && rows > 0 && columns * rows > (i32) star_cache_capacity)
+      {
+        if (rows <= star_cache_side)
+          columns = (i32) star_cache_capacity / rows;
+        else if (columns <= star_cache_side)
+          rows = (i32) star_cache_capacity / columns;
+        else
+          columns = rows = star_cache_side;
+
+        shrink_range (range.x_start, range.x_end, columns);
+        shrink_range (range.y_start, range.y_end, rows);
+      }
+
+    return range;
+  }
+
+  void
+  starfield_prefetch_update (Starfield_prefetch &prefetch, Starfield &starfield, hyper::Renderer_context const *context)
+  {
+    Star_sector_range range = starfield_get_visible_sectors (starfield, context);
+    i32 const last_x = (i32) hyper::floor ((starfield.world_width - 1.0f) / star_sector_size);
+    i32 const last_y = (i32) hyper::floor ((starfield.world_height - 1.0f) / star_sector_size);
+
+    range.x_start = hyper::max (range.x_start - star_prefetch_border, 0);
+    range.y_start = hyper::max (range.y_start - star_prefetch_border, 0);
+    range.x_end = hyper::min (range.x_end + star_prefetch_border, last_x);
+    range.y_end = hyper::min (range.y_end + star_prefetch_border, last_y);
+
+    prefetch.starfield = &starfield;
+    if (range.x_start == prefetch.range.x_start && range.y_start == prefetch.range.y_start
+        && range.x_end == prefetch.range.x_end && range.y_end == prefetch.range.y_end)
+      return;
+
+    prefetch.range = range;
+    prefetch.x = range.x_start;
+    prefetch.y = range.y_start;
+  }
+
+  hyper::Task_status
+  starfield_prefetch_step (void *data)
+  {
+    Starfield_prefetch &prefetch = *static_cast<Starfield_prefetch *> (data);
+    if (!prefetch.starfield)
+      return hyper::Task_status::idle;
+
+    Starfield &starfield = *prefetch.starfield;
+    Star_sector_range const &range = prefetch.range;
+    u32 generated = 0;
+
+    while (prefetch.y <= range.y_end)
+      {
+        i32 const x = prefetch.x;
+        i32 const y = prefetch.y;
+
+        if (++prefetch.x > range.x_end)
+          {
+            prefetch.x = range.x_start;
+            ++prefetch.y;
+          }
+
+        Star_sector *victim;
+        if (find_sector (starfield, x, y, victim))
+          continue;
+
+        // The sectors on screen stay, when the cache can't hold the
+        // border too it goes without
+        if (victim->valid && victim->last_used_frame == starfield.frame)
+          continue;
+
+        generate_sector (starfield, *victim, x, y);
+        victim->last_used_frame = starfield.frame;
+
+        if (++generated == star_prefetch_step_sectors)
+          return hyper::Task_status::more;
+      }
+
+    // Looked at all of them, the next run checks again in case some
+    // got evicted
+    prefetch.x = range.x_start;
+    prefetch.y = range.y_start;
+
+    return hyper::Task_status::idle;
+  }
+
+  f32
+  starfield_get_lod_fraction (f32 zoom)
+  {
+    // Zooming out by 2 shows 4 times the area
+    return hyper::min (hyper::max (zoom * zoom, 1.0f / (f32) star_sector_max_stars), 1.0f);
+  }
+};
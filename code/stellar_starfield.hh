@@ -0,0 +1,33 @@
+#pragma once
+
+#include "hyper.hh"
+#include "stellar.hh"
+#include "hyper_task_scheduler.hh"
+
+namespace stellar
+{
+  // Sectors around the visible ones that get generated ahead of the
+  // camera, and how many at most in one step
+  inline constexpr i32 star_prefetch_border = 1;
+  inline constexpr u32 star_prefetch_step_sectors = 4;
+
+  void starfield_init (Starfield &, u64, f32, f32);
+
+  // Generates the sector if it's not cached
+  Star_sector const &starfield_get_sector (Starfield &, i32, i32);
+
+  // Inclusive range of the sectors visible from the camera, clamped to
+  // the world and to what the cache holds
+  Star_sector_range starfield_get_visible_sectors (Starfield const &, hyper::Renderer_context const *);
+
+  // Call it once the camera is set for the frame, it starts over when
+  // it has moved to another range
+  void starfield_prefetch_update (Starfield_prefetch &, Starfield &, hyper::Renderer_context const *);
+
+  // Task step, generates a few of the missing sectors
+  hyper::Task_status starfield_prefetch_step (void *);
+
+  // Fraction of each sector's stars to draw at this zoom, keeps the
+  // density on screen constant when zooming out
+  f32 starfield_get_lod_fraction (f32);
+};